@@ -3,46 +3,224 @@
 // Copyright (c) 2024 namazso <admin@namazso.eu>
 
 #include "clock_gen.h"
+#include "clock_plan.h"
+#include "resample.h"
 
 #include <hardware/clocks.h>
+#include <hardware/pio.h>
 #include <pico/stdlib.h>
 
-#define adc_rate_40mhz 78125
+// PCM1802 runs in 512 fs mode from clock 0
+#define ADC_FS_MULT 512
 
+// clock 0 is GPOUT0, it also goes to the PCM1802
 #define CLOCK_PIN 21
 
+// GPOUT1-3 are on GPIO23-25 which the Pico uses for itself (SMPS mode, VBUS sense, LED),
+// so clock 1 comes from a PIO state machine instead
+#ifndef CLOCK_GEN_CLK1_PIN
+#define CLOCK_GEN_CLK1_PIN 22
+#endif
+
+static const uint32_t cxadc_clocks[CLOCK_GEN_CXADC_CLOCK_COUNT] =
+{
+	CLOCK_GEN_CXADC_CLOCK_F0_HZ,
+	CLOCK_GEN_CXADC_CLOCK_F1_HZ,
+	CLOCK_GEN_CXADC_CLOCK_F2_HZ,
+	CLOCK_GEN_CXADC_CLOCK_F3_HZ,
+};
+
+static bool init_success = false;
+static clock_plan plan;
+static uint8_t selected[CLOCK_GEN_OUTPUTS];
+static uint32_t actual_hz[CLOCK_GEN_OUTPUTS];
+
+// ADC rate follows clock 0, the options are it and the standard rates resample.h can make from it,
+// lowest first as the UAC2 range wants them
+static uint32_t adc_rate;
+static uint32_t adc_rates[1 + RESAMPLE_RATE_COUNT];
+static uint8_t adc_rate_count = 0;
+// what the host picked, core1 resamples to it unless it is adc_rate
+static volatile uint32_t stream_rate;
+
+// clock 1: set pins 1 [n]; set pins 0 [m]
+static PIO clk1_pio;
+static uint clk1_sm;
+static int clk1_offset = -1;
+static uint16_t clk1_instructions[2];
+static pio_program_t clk1_program = { .instructions = clk1_instructions, .length = 2, .origin = -1 };
+
+static void set_adc_rate(uint32_t rate)
+{
+	// RESAMPLE_RATES is highest first, the ones it can make are all below the ADC rate
+	static const uint32_t standard[RESAMPLE_RATE_COUNT] = RESAMPLE_RATES;
+	adc_rate = rate;
+	adc_rate_count = 0;
+	for(int i=RESAMPLE_RATE_COUNT-1; i>=0; --i)
+		if( resample_taps_for(rate, standard[i]) )
+			adc_rates[adc_rate_count++] = standard[i];
+	adc_rates[adc_rate_count++] = rate;
+	
+	// a standard rate stays if the new ADC rate can still make it, anything else follows the ADC
+	uint32_t keep = adc_rate;
+	for(int i=0; i<adc_rate_count; ++i)
+		if( adc_rates[i] == stream_rate )
+			keep = stream_rate;
+	stream_rate = keep;
+}
+
 bool clock_gen_init()
 {
-    // slightly underclock the pico at 120 MHz
-    set_sys_clock_khz(120000, true);
-    gpio_set_dir(CLOCK_PIN, true);
-    // output 120/3 = 40 MHz
-    clock_gpio_init_int_frac(CLOCK_PIN, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, 3, 0);
-    return true;
+	clock_plan_limits limits;
+	clock_plan_default_limits(&limits);
+	limits.sys_max_hz = CLOCK_GEN_SYS_CLOCK_MAX_KHZ * 1000;
+	// the PCM1802 runs from clock 0 too, a fractional divider would add jitter to the ADC
+	limits.allow_fractional = false;
+	
+	// 40 MHz must be exact, the others are used to pick between otherwise equal system clocks
+	const uint32_t targets[] = { CLOCK_GEN_CXADC_CLOCK_F2_HZ, CLOCK_GEN_CXADC_CLOCK_F0_HZ, CLOCK_GEN_CXADC_CLOCK_F3_HZ, CLOCK_GEN_CXADC_CLOCK_F1_HZ };
+	bool success = clock_plan_solve(&limits, targets, 4, &plan) && (plan.exact_mask & 1);
+	if( !success )
+	{
+		// should never happen with sane limits, run with the known good 120 MHz / 3 and report it
+		set_sys_clock_khz(120000, true);
+		gpio_set_dir(CLOCK_PIN, true);
+		clock_gpio_init_int_frac(CLOCK_PIN, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, 3, 0);
+		actual_hz[0] = CLOCK_GEN_CXADC_CLOCK_F2_HZ;
+		set_adc_rate(actual_hz[0] / ADC_FS_MULT);
+		return false;
+	}
+	
+	// with the default limits this is 1440 MHz / 6 / 2 = 120 MHz
+	set_sys_clock_pll(plan.vco_hz, plan.postdiv1, plan.postdiv2);
+	gpio_set_dir(CLOCK_PIN, true);
+	
+	clk1_pio = pio1;
+	clk1_sm = pio_claim_unused_sm(clk1_pio, true);
+	pio_gpio_init(clk1_pio, CLOCK_GEN_CLK1_PIN);
+	pio_sm_set_consecutive_pindirs(clk1_pio, clk1_sm, CLOCK_GEN_CLK1_PIN, 1, true);
+	
+	init_success = true;
+	return true;
 }
 
-void clock_gen_default()
+uint32_t clock_gen_get_sys_hz()
+{
+	return clock_get_hz(clk_sys);
+}
+
+static void set_clk0(const clock_plan_output* o)
+{
+	clock_gpio_init_int_frac(CLOCK_PIN, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, o->div_int, o->div_frac);
+}
+
+static void set_clk1(const clock_plan_output* o)
+{
+	pio_sm_set_enabled(clk1_pio, clk1_sm, false);
+	if( clk1_offset >= 0 )
+		pio_remove_program(clk1_pio, &clk1_program, clk1_offset);
+	
+	uint16_t clkdiv_int = 1;
+	uint8_t clkdiv_frac = 0;
+	uint32_t high = 1, low = 1;
+	if( o->div_frac == 0 && o->div_int <= 64 )
+	{
+		// integer period, done with delays at full speed so there is no jitter, odd ones are 1 cycle longer low
+		high = o->div_int / 2;
+		low = o->div_int - high;
+	}
+	else
+	{
+		// one cycle high, one low, the 16.8 clock divider does the rest
+		uint32_t div = ((o->div_int << 8) | o->div_frac) / 2;
+		clkdiv_int = div >> 8;
+		clkdiv_frac = div & 0xff;
+	}
+	
+	clk1_instructions[0] = pio_encode_set(pio_pins, 1) | pio_encode_delay(high - 1);
+	clk1_instructions[1] = pio_encode_set(pio_pins, 0) | pio_encode_delay(low - 1);
+	clk1_offset = pio_add_program(clk1_pio, &clk1_program);
+	
+	pio_sm_config cfg = pio_get_default_sm_config();
+	sm_config_set_set_pins(&cfg, CLOCK_GEN_CLK1_PIN, 1);
+	sm_config_set_wrap(&cfg, clk1_offset, clk1_offset + 1);
+	sm_config_set_clkdiv_int_frac(&cfg, clkdiv_int, clkdiv_frac);
+	pio_sm_init(clk1_pio, clk1_sm, clk1_offset, &cfg);
+	pio_sm_set_enabled(clk1_pio, clk1_sm, true);
+}
+
+bool clock_gen_set_output(uint8_t output, uint8_t option)
 {
-        return;
+	if( !init_success || output >= CLOCK_GEN_OUTPUTS || option >= CLOCK_GEN_CXADC_CLOCK_COUNT )
+		return false;
+	
+	// clock 1 can be any clock, it gets a fractional divider if there is no integer one. Clock 0 also drives the
+	// PCM1802, so like in clock_gen_init() it only takes what the system clock divides exactly, the rest is refused
+	clock_plan_output o;
+	clock_plan_output_for(plan.sys_hz, cxadc_clocks[option], output != 0, &o);
+	if( o.div_int == 0 || (output == 0 && (o.div_frac != 0 || o.error_ppb != 0)) )
+		return false;
+	// the PIO needs at least two cycles per period
+	if( output == 1 && o.div_int < 2 )
+		return false;
+	
+	if( output == 0 )
+	{
+		set_clk0(&o);
+		set_adc_rate((o.actual_hz + ADC_FS_MULT / 2) / ADC_FS_MULT);
+	}
+	else
+	{
+		set_clk1(&o);
+	}
+	
+	selected[output] = option;
+	actual_hz[output] = o.actual_hz;
+	return true;
 }
 
+uint8_t clock_gen_get_output(uint8_t output)
+{
+	return (output < CLOCK_GEN_OUTPUTS) ? selected[output] : 0;
+}
+
+uint32_t clock_gen_get_output_hz(uint8_t output)
+{
+	return (output < CLOCK_GEN_OUTPUTS) ? actual_hz[output] : 0;
+}
+
+void clock_gen_default()
+{
+	clock_gen_set_output(0, CLOCK_GEN_CXADC_CLOCK_40);
+	clock_gen_set_output(1, CLOCK_GEN_CXADC_CLOCK_40);
+}
 
-static const uint32_t adc_rates[] = { adc_rate_40mhz };
 
 const uint32_t* clock_gen_get_adc_sample_rate_options(uint8_t* len)
 {
-	// https://www.scaler.com/topics/length-of-an-array-in-c/
-	*len = sizeof(adc_rates) / sizeof(adc_rates[0]);
+	*len = adc_rate_count;
 	return adc_rates;
 }
 
 uint32_t clock_gen_get_adc_sample_rate()
 {
-        return adc_rate_40mhz;
+	return adc_rate;
 }
 
-void clock_gen_set_adc_sample_rate(uint32_t rate_hz)
+bool clock_gen_set_adc_sample_rate(uint32_t rate_hz)
 {
+	for(int i=0; i<adc_rate_count; ++i)
+	{
+		if( adc_rates[i] == rate_hz )
+		{
+			stream_rate = rate_hz;
+			return true;
+		}
+	}
+	return false;
 }
 
-#undef adc_rate_40mhz
+uint32_t clock_gen_get_stream_sample_rate()
+{
+	return stream_rate;
+}
@@ -13,13 +13,47 @@
 #define CLOCK_GEN_CXADC_CLOCK_F2_STR  "40MHz"
 #define CLOCK_GEN_CXADC_CLOCK_F3_STR  "50MHz"
 
+#define CLOCK_GEN_CXADC_CLOCK_F0_HZ   20000000
+#define CLOCK_GEN_CXADC_CLOCK_F1_HZ   28636364 // 8 * NTSC fsc = 315/11 MHz
+#define CLOCK_GEN_CXADC_CLOCK_F2_HZ   40000000
+#define CLOCK_GEN_CXADC_CLOCK_F3_HZ   50000000
+
+// Options for each output, in the order of the selector unit inputs
+#define CLOCK_GEN_CXADC_CLOCK_20      0
+#define CLOCK_GEN_CXADC_CLOCK_28      1
+#define CLOCK_GEN_CXADC_CLOCK_40      2
+#define CLOCK_GEN_CXADC_CLOCK_50      3
+#define CLOCK_GEN_CXADC_CLOCK_COUNT   4
+
+// Clock 0 is GPOUT0 (GPIO21) and also the PCM1802 system clock, clock 1 is generated by PIO.
+// Integer dividers of the system clock are jitter free, the rest use fractional dividers.
+#define CLOCK_GEN_OUTPUTS             2
+
+// Highest system clock the clock plan may pick, the Pico is rated for 133 MHz.
+// Raising this gives more CPU headroom, as long as the clock output divider stays an integer.
+#ifndef CLOCK_GEN_SYS_CLOCK_MAX_KHZ
+#define CLOCK_GEN_SYS_CLOCK_MAX_KHZ   133000
+#endif
+
 
 bool clock_gen_init();
 void clock_gen_default();
-
+uint32_t clock_gen_get_sys_hz();
+
+// option is one of CLOCK_GEN_CXADC_CLOCK_*, returns false if the output can't make that clock
+bool     clock_gen_set_output(uint8_t output, uint8_t option);
+uint8_t  clock_gen_get_output(uint8_t output);
+// actual frequency, rounded
+uint32_t clock_gen_get_output_hz(uint8_t output);
+
+// The options are lowest first, the last one is the rate of the PCM1802 itself, which
+// clock_gen_get_adc_sample_rate() returns. The others are standard rates below it that core1 resamples to
+// (resample.h), the host picks one with clock_gen_set_adc_sample_rate() and clock_gen_get_stream_sample_rate()
+// is what goes over USB then
 const uint32_t* clock_gen_get_adc_sample_rate_options(uint8_t* len);
 uint32_t        clock_gen_get_adc_sample_rate();
-void            clock_gen_set_adc_sample_rate(uint32_t rate_hz);
+bool            clock_gen_set_adc_sample_rate(uint32_t rate_hz);
+uint32_t        clock_gen_get_stream_sample_rate();
 
 #endif
 
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include <string.h>
+#include "clock_plan.h"
+
+// RP2040 datasheet 2.18.2, the feedback divider range with REFDIV = 1
+#define FBDIV_MIN   16
+#define FBDIV_MAX   320
+#define POSTDIV_MAX 7
+
+// GPOUT dividers are 24.8 fixed point
+#define GPOUT_DIV_INT_MAX 0xffffff
+
+void clock_plan_default_limits(clock_plan_limits* limits)
+{
+	limits->xosc_hz = 12000000;
+	limits->sys_min_hz = 48000000;
+	limits->sys_max_hz = 133000000;
+	limits->vco_min_hz = 750000000;
+	limits->vco_max_hz = 1600000000;
+	limits->allow_fractional = true;
+}
+
+void clock_plan_output_for(uint32_t sys_hz, uint32_t target_hz, bool allow_fractional, clock_plan_output* out)
+{
+	memset(out, 0, sizeof(*out));
+	out->target_hz = target_hz;
+
+	if( target_hz == 0 || target_hz > sys_hz )
+		return;
+
+	if( (sys_hz % target_hz) == 0 )
+	{
+		uint32_t div = sys_hz / target_hz;
+		if( div > GPOUT_DIV_INT_MAX )
+			return;
+		out->div_int = div;
+		out->actual_hz = target_hz;
+		return;
+	}
+
+	uint64_t div = (((uint64_t)sys_hz << 8) + (target_hz / 2)) / target_hz;
+	if( !allow_fractional )
+	{
+		// nearest integer divider, exact_mask tells the caller it is off
+		div = (((uint64_t)sys_hz + (target_hz / 2)) / target_hz) << 8;
+	}
+	if( (div >> 8) > GPOUT_DIV_INT_MAX )
+		return;
+
+	out->div_int = (uint32_t)(div >> 8);
+	out->div_frac = (uint8_t)(div & 0xff);
+	out->actual_hz = (uint32_t)((((uint64_t)sys_hz << 8) + (div / 2)) / div);
+
+	// (sys / div - target) / target, kept in integers so this is cheap on the M0+ as well
+	int64_t num = (int64_t)((uint64_t)sys_hz << 8) - (int64_t)target_hz * (int64_t)div;
+	int64_t den = (int64_t)target_hz * (int64_t)div;
+	out->error_ppb = (int32_t)((num * 1000000000) / den);
+}
+
+static uint32_t priority_of(const clock_plan* p)
+{
+	// earlier targets are more important, so output 0 becomes the most significant bit
+	uint32_t ret = 0;
+	for(uint8_t i=0; i<p->n_outputs; ++i)
+		if( p->exact_mask & (1u << i) )
+			ret |= 1u << (p->n_outputs - 1 - i);
+	return ret;
+}
+
+static uint64_t error_of(const clock_plan* p)
+{
+	uint64_t ret = 0;
+	for(uint8_t i=0; i<p->n_outputs; ++i)
+	{
+		const clock_plan_output* o = &(p->outputs[i]);
+		if( o->div_int == 0 )
+			ret += 0xffffffffull; // not reachable at all
+		else
+			ret += (o->error_ppb < 0) ? -(int64_t)o->error_ppb : o->error_ppb;
+	}
+	return ret;
+}
+
+static bool better(const clock_plan* a, const clock_plan* b)
+{
+	uint32_t pa = priority_of(a), pb = priority_of(b);
+	if( pa != pb ) return pa > pb;
+
+	uint64_t ea = error_of(a), eb = error_of(b);
+	if( ea != eb ) return ea < eb;
+
+	if( a->sys_hz != b->sys_hz ) return a->sys_hz > b->sys_hz;
+
+	return a->vco_hz > b->vco_hz;
+}
+
+bool clock_plan_solve(const clock_plan_limits* limits, const uint32_t* targets_hz, uint8_t n_targets, clock_plan* plan)
+{
+	if( n_targets > CLOCK_PLAN_MAX_TARGETS )
+		n_targets = CLOCK_PLAN_MAX_TARGETS;
+
+	bool found = false;
+	clock_plan cand;
+
+	for(uint32_t fbdiv=FBDIV_MIN; fbdiv<=FBDIV_MAX; ++fbdiv)
+	{
+		uint64_t vco = (uint64_t)limits->xosc_hz * fbdiv;
+		if( vco < limits->vco_min_hz || vco > limits->vco_max_hz )
+			continue;
+
+		// same order as the sdk, postdiv2 is never larger than postdiv1
+		for(uint32_t pd1=POSTDIV_MAX; pd1>=1; --pd1)
+		{
+			for(uint32_t pd2=pd1; pd2>=1; --pd2)
+			{
+				uint32_t pd = pd1 * pd2;
+				if( (vco % pd) != 0 )
+					continue;
+				uint32_t sys = (uint32_t)(vco / pd);
+				if( sys < limits->sys_min_hz || sys > limits->sys_max_hz )
+					continue;
+
+				memset(&cand, 0, sizeof(cand));
+				cand.vco_hz = (uint32_t)vco;
+				cand.fbdiv = (uint16_t)fbdiv;
+				cand.postdiv1 = (uint8_t)pd1;
+				cand.postdiv2 = (uint8_t)pd2;
+				cand.sys_hz = sys;
+				cand.n_outputs = n_targets;
+
+				for(uint8_t i=0; i<n_targets; ++i)
+				{
+					clock_plan_output* o = &(cand.outputs[i]);
+					clock_plan_output_for(sys, targets_hz[i], limits->allow_fractional, o);
+					if( o->div_int != 0 && o->div_frac == 0 && o->error_ppb == 0 )
+						cand.exact_mask |= 1u << i;
+				}
+
+				if( !found || better(&cand, plan) )
+				{
+					*plan = cand;
+					found = true;
+				}
+			}
+		}
+	}
+
+	return found;
+}
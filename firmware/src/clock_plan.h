@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _CLOCK_PLAN_H
+#define _CLOCK_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Searches the system PLL settings and GPOUT dividers for a set of output clocks.
+// This has no dependency on the pico sdk, so it is also built into the host tools (see host/clock_plan).
+//
+// A plan is rated in this order:
+//  1. Outputs reachable with an integer GPOUT divider (jitter free), earlier targets weigh more than later ones
+//  2. Smallest total frequency error of the remaining outputs
+//  3. Highest system clock, more CPU headroom
+//  4. Highest VCO frequency, the RP2040 PLL has less jitter at higher VCO frequencies
+
+#define CLOCK_PLAN_MAX_TARGETS 4
+
+typedef struct
+{
+	// crystal frequency, 12 MHz on the Pico
+	uint32_t xosc_hz;
+	// allowed range of the system clock
+	uint32_t sys_min_hz;
+	uint32_t sys_max_hz;
+	// allowed range of the PLL VCO, see RP2040 datasheet 2.18.2
+	uint32_t vco_min_hz;
+	uint32_t vco_max_hz;
+	// if false only integer GPOUT dividers are used, targets that can't be reached that way get the nearest one
+	bool     allow_fractional;
+}
+clock_plan_limits;
+
+typedef struct
+{
+	uint32_t target_hz;
+	// GPOUT divider, 24.8 fixed point as in CLK_GPOUTx_DIV, 0 if the target is not reachable
+	uint32_t div_int;
+	uint8_t  div_frac;
+	// resulting frequency (rounded) and its error against the target in parts per billion
+	uint32_t actual_hz;
+	int32_t  error_ppb;
+}
+clock_plan_output;
+
+typedef struct
+{
+	uint32_t vco_hz;
+	uint16_t fbdiv;
+	uint8_t  postdiv1;
+	uint8_t  postdiv2;
+	uint32_t sys_hz;
+
+	uint8_t           n_outputs;
+	clock_plan_output outputs[CLOCK_PLAN_MAX_TARGETS];
+	// bit i set if output i uses an integer divider with no error
+	uint8_t           exact_mask;
+}
+clock_plan;
+
+// Limits for a Pico at the rated clock (133 MHz max)
+void clock_plan_default_limits(clock_plan_limits* limits);
+
+// Finds the best plan for up to CLOCK_PLAN_MAX_TARGETS output clocks, the first target being the most important one.
+// Returns false if there is no valid PLL setting in the limits at all.
+bool clock_plan_solve(const clock_plan_limits* limits, const uint32_t* targets_hz, uint8_t n_targets, clock_plan* plan);
+
+// Divider for a single output from a fixed system clock, this is what clock_plan_solve() uses for each output
+void clock_plan_output_for(uint32_t sys_hz, uint32_t target_hz, bool allow_fractional, clock_plan_output* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
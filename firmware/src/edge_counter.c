@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "edge_counter.h"
+#include "edge_counter.pio.h"
+#include "pcm1802.h"
+#include "dbg.h"
+#include "hardware/pio.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+
+// a PWM slice only counts edges on its B input, those are the odd GPIOs
+#ifndef EDGE_COUNTER_SCK_PIN
+#define EDGE_COUNTER_SCK_PIN 15
+#endif
+static_assert((EDGE_COUNTER_SCK_PIN & 1) == 1, "EDGE_COUNTER_SCK_PIN must be a PWM B input (odd GPIO)");
+
+// The PWM counter is only 16 bits. Counting every 255th edge it wraps after 0.33 s at 50 MHz,
+// so a timer on core0 picks up the count more often than that.
+#define SCK_DIV     255
+#define SCK_POLL_MS 100
+
+// same order as edge_counter_line
+static const uint line_pins[3] = { PCM_PIO_ADC0_DATA, PCM_PIO_ADC0_BITCLK, PCM_PIO_ADC0_LRCLK };
+
+static PIO pio;
+static int pio_sms[3] = { -1, -1, -1 };
+static uint sck_slice;
+static uint16_t sck_last;
+// running total, only ever used as a difference
+static uint32_t sck_edges;
+static repeating_timer_t sck_timer;
+
+static uint32_t last_count[edge_counter_lines];
+static uint32_t last_time;
+
+static bool sck_poll(repeating_timer_t* rt)
+{
+	uint16_t c = pwm_get_counter(sck_slice);
+	sck_edges += (uint32_t)(uint16_t)(c - sck_last) * SCK_DIV;
+	sck_last = c;
+	return true;
+}
+
+static uint32_t pio_count(uint sm)
+{
+	// the FIFO is full of old words, the one after them was pushed a few cycles ago
+	uint32_t x = 0;
+	for(int i=0; i<5; ++i)
+		x = pio_sm_get_blocking(pio, sm);
+	return 0 - x;
+}
+
+void edge_counter_init()
+{
+	// pio0 next to the capture, it uses one state machine and leaves three
+	pio = pio0;
+	if( pio_can_add_program(pio, &edge_counter_program) )
+	{
+		uint offset = pio_add_program(pio, &edge_counter_program);
+		for(int i=0; i<3; ++i)
+		{
+			int sm = (int)pio_claim_unused_sm(pio, false);
+			if( sm < 0 )
+				break;
+			pio_sm_config cfg = edge_counter_program_get_default_config(offset);
+			sm_config_set_jmp_pin(&cfg, line_pins[i]);
+			pio_sm_init(pio, sm, offset, &cfg);
+			pio_sm_set_enabled(pio, sm, true);
+			pio_sms[i] = sm;
+		}
+	}
+	if( pio_sms[2] < 0 )
+		dbg_say("edge counter: not enough PIO resources\n");
+
+	// reads nothing while SCK is not wired
+	gpio_set_function(EDGE_COUNTER_SCK_PIN, GPIO_FUNC_PWM);
+	gpio_pull_down(EDGE_COUNTER_SCK_PIN);
+	sck_slice = pwm_gpio_to_slice_num(EDGE_COUNTER_SCK_PIN);
+	pwm_config cfg = pwm_get_default_config();
+	pwm_config_set_clkdiv_mode(&cfg, PWM_DIV_B_RISING);
+	pwm_config_set_clkdiv_int(&cfg, SCK_DIV);
+	pwm_init(sck_slice, &cfg, true);
+	add_repeating_timer_ms(SCK_POLL_MS, sck_poll, NULL, &sck_timer);
+
+	last_time = time_us_32();
+}
+
+void edge_counter_measure(uint32_t hz[edge_counter_lines])
+{
+	uint32_t count[edge_counter_lines] = { 0 };
+	for(int i=0; i<3; ++i)
+		if( pio_sms[i] >= 0 )
+			count[i] = pio_count(pio_sms[i]);
+
+	uint32_t irq = save_and_disable_interrupts();
+	sck_poll(NULL);
+	count[edge_counter_sck] = sck_edges;
+	restore_interrupts(irq);
+
+	uint32_t now = time_us_32();
+	uint32_t elapsed = now - last_time;
+	last_time = now;
+	for(int i=0; i<edge_counter_lines; ++i)
+	{
+		hz[i] = elapsed ? (uint32_t)(((uint64_t)(count[i] - last_count[i]) * 1000000) / elapsed) : 0;
+		last_count[i] = count[i];
+	}
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _EDGE_COUNTER_H
+#define _EDGE_COUNTER_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+// Free running edge counters on the PCM1802 lines, so activity and the actual rates are known without polling the pins.
+// DATA, BCK and LRCK are counted by PIO state machines next to the capture (PIO can read any pin), SCK by a PWM
+// slice on EDGE_COUNTER_SCK_PIN. That pin has to be wired to SCK, with an external clock (Domesday Duplicator, MISRC)
+// it is the only way to see what the ADC is actually clocked with.
+typedef enum
+{
+	edge_counter_data,
+	edge_counter_bck,
+	edge_counter_lrck,
+	edge_counter_sck,
+	edge_counter_lines,
+}
+edge_counter_line;
+
+void edge_counter_init();
+// core0, rising edges per second on each line since the last call, 0 for a line without a counter
+void edge_counter_measure(uint32_t hz[edge_counter_lines]);
+
+#endif
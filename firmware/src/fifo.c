@@ -6,13 +6,27 @@
 #include "pico/util/queue.h"
 #include "pico/critical_section.h"
 #include "dbg.h"
+#include "hot_path.h"
+
+// fifo_set_streaming() clamps it at runtime, for whatever rate the stream has
+#if FIFO_PREROLL_MS > FIFO_PREROLL_MAX_MS
+#warning "FIFO_PREROLL_MS is more than the fifo holds at 78125 Hz, the pre-roll is clamped to the fifo size"
+#endif
 
 static usb_audio_buffer buffers[FIFO_SPACE];
+// drop_newest captures into this one
+static usb_audio_buffer scratch;
 
 static queue_t pipe_empty;
 static queue_t pipe_full;
 static critical_section_t mode_mutex;
 static fifo_mode mode;
+static test_pattern_kind test_pattern;
+static volatile bool streaming;
+static volatile bool armed_start;
+static volatile uint32_t stream_generation;
+uint32_t fifo_overload_events;
+uint32_t fifo_dropped_buffers;
 
 void fifo_init()
 {
@@ -22,6 +36,12 @@ void fifo_init()
 	
 	memset(buffers, 0, sizeof(buffers));
 	mode = fifo_mode_normal;
+	test_pattern = test_pattern_counter;
+	streaming = false;
+	armed_start = false;
+	stream_generation = 0;
+	fifo_overload_events = 0;
+	fifo_dropped_buffers = 0;
 	
 	for(int i=0; i<FIFO_SPACE; ++i)
 	{
@@ -30,25 +50,25 @@ void fifo_init()
 	}
 
 	dbg_say("fifo init with ");
-	dbg_u8(FIFO_SPACE);
+	dbg_u32(FIFO_SPACE);
 	dbg_say(" slots in empty\n");
 }
 
-usb_audio_buffer* fifo_take_empty()
+usb_audio_buffer* HOT_PATH(fifo_take_empty)()
 {
 	usb_audio_buffer* ret;
 	queue_remove_blocking(&pipe_empty, &ret);
 	return ret;
 }
 
-usb_audio_buffer* fifo_take_filled()
+usb_audio_buffer* HOT_PATH(fifo_take_filled)()
 {
 	usb_audio_buffer* ret;
 	queue_remove_blocking(&pipe_full, &ret);
 	return ret;
 }
 
-usb_audio_buffer* fifo_try_take_empty()
+usb_audio_buffer* HOT_PATH(fifo_try_take_empty)()
 {
 	usb_audio_buffer* ret;
 	if( queue_try_remove(&pipe_empty, &ret) == true )
@@ -56,7 +76,7 @@ usb_audio_buffer* fifo_try_take_empty()
 	return NULL;
 }
 
-usb_audio_buffer* fifo_try_take_filled()
+usb_audio_buffer* HOT_PATH(fifo_try_take_filled)()
 {
 	usb_audio_buffer* ret;
 	if( queue_try_remove(&pipe_full, &ret) == true )
@@ -64,20 +84,25 @@ usb_audio_buffer* fifo_try_take_filled()
 	return NULL;
 }
 
-void fifo_put_empty(usb_audio_buffer* buffer)
+void HOT_PATH(fifo_put_empty)(usb_audio_buffer* buffer)
 {
 	queue_add_blocking(&pipe_empty, &buffer);
 }
 
-void fifo_put_filled(usb_audio_buffer* buffer)
+void HOT_PATH(fifo_put_filled)(usb_audio_buffer* buffer)
 {
 	queue_add_blocking(&pipe_full, &buffer);
 }
 
+uint32_t HOT_PATH(fifo_filled_level)()
+{
+	return queue_get_level(&pipe_full);
+}
+
 void fifo_set_mode(fifo_mode new_mode)
 {
 	dbg_say("fifo_set_mode ");
-	dbg_say((new_mode == fifo_mode_debug) ? "dbg" : "normal");
+	dbg_say((new_mode == fifo_mode_debug) ? "dbg" : (new_mode == fifo_mode_pattern) ? "pattern" : "normal");
 	dbg_say("\n");
 	
 	critical_section_enter_blocking(&mode_mutex);
@@ -85,10 +110,119 @@ void fifo_set_mode(fifo_mode new_mode)
 	critical_section_exit(&mode_mutex);
 }
 
-fifo_mode fifo_get_mode()
+fifo_mode HOT_PATH(fifo_get_mode)()
 {
 	critical_section_enter_blocking(&mode_mutex);
 	fifo_mode ret = mode;
 	critical_section_exit(&mode_mutex);
 	return ret;
 }
+
+void fifo_set_test_pattern(test_pattern_kind kind)
+{
+	critical_section_enter_blocking(&mode_mutex);
+	test_pattern = kind;
+	critical_section_exit(&mode_mutex);
+}
+
+test_pattern_kind HOT_PATH(fifo_get_test_pattern)()
+{
+	critical_section_enter_blocking(&mode_mutex);
+	test_pattern_kind ret = test_pattern;
+	critical_section_exit(&mode_mutex);
+	return ret;
+}
+
+fifo_overload_policy fifo_get_overload_policy()
+{
+	return FIFO_OVERLOAD_POLICY;
+}
+
+usb_audio_buffer* HOT_PATH(fifo_take_for_capture)()
+{
+	usb_audio_buffer* ret = fifo_try_take_empty();
+	if( ret != NULL )
+		return ret;
+	
+	// no stream, this is the pre-roll ring
+	fifo_overload_policy policy = streaming ? FIFO_OVERLOAD_POLICY : fifo_overload_overwrite_oldest;
+	if( streaming )
+		++fifo_overload_events;
+	
+	switch( policy )
+	{
+	case fifo_overload_drop_newest:
+		++fifo_dropped_buffers;
+		return &scratch;
+	
+	case fifo_overload_overwrite_oldest:
+		ret = fifo_try_take_filled();
+		if( ret != NULL )
+		{
+			if( streaming )
+				++fifo_dropped_buffers;
+			return ret;
+		}
+		// core0 holds every buffer right now, it gives one back within a USB frame
+		break;
+	
+	default:
+		break;
+	}
+	
+	return fifo_take_empty();
+}
+
+void HOT_PATH(fifo_put_captured)(usb_audio_buffer* buffer)
+{
+	if( buffer == &scratch )
+		return;
+	fifo_put_filled(buffer);
+}
+
+void fifo_set_streaming(bool new_streaming, uint32_t sample_rate)
+{
+	if( new_streaming && !streaming )
+	{
+		// keep a couple of buffers empty so core1 does not have to steal one right away
+		uint32_t keep = (uint32_t)(((uint64_t)FIFO_PREROLL_MS * sample_rate) / (1000 * USB_AUDIO_SAMPLES_PER_BUFFER));
+		if( keep > FIFO_SPACE - 2 )
+			keep = FIFO_SPACE - 2;
+		
+		if( armed_start )
+		{
+			// everything up to the next head switch edge goes
+			keep = 0;
+			++stream_generation;
+		}
+		
+		// the oldest ones go, core1 may be taking buffers out of pipe_full at the same time so this just stops when it runs dry
+		while( queue_get_level(&pipe_full) > keep )
+		{
+			usb_audio_buffer* tmp = fifo_try_take_filled();
+			if( tmp == NULL )
+				break;
+			fifo_put_empty(tmp);
+		}
+		
+		dbg_say("fifo pre-roll ");
+		dbg_u32(queue_get_level(&pipe_full));
+		dbg_say("\n");
+	}
+	streaming = new_streaming;
+}
+
+void fifo_set_armed_start(bool armed)
+{
+	armed_start = armed;
+}
+
+bool fifo_get_armed_start()
+{
+	return armed_start;
+}
+
+uint32_t HOT_PATH(fifo_get_stream_generation)()
+{
+	return stream_generation;
+}
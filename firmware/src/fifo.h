@@ -5,10 +5,30 @@
 #define _FIFO_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "usb_audio_format.h"
+#include "hot_path.h"
+#include "test_pattern.h"
 
-// how much entries of space the fifo should have
-#define FIFO_SPACE 8
+// how much entries of space the fifo should have, each is one USB packet (96 frames, ~1.2 ms at 78125 Hz).
+// This doubles as the pre-roll ring, so it is as large as the SRAM allows
+#ifndef FIFO_SPACE
+#if CODE_LAYOUT == CODE_LAYOUT_COPY_TO_RAM
+// the code takes up SRAM too
+#define FIFO_SPACE 64
+#else
+#define FIFO_SPACE 160
+#endif
+#endif
+
+// Pre-roll the fifo holds at 78125 Hz (clock 0 at 40 MHz, the highest rate) with a couple of buffers kept empty,
+// ~194 ms, ~76 ms with copy_to_ram. Lower rates get longer out of the same buffers
+#define FIFO_PREROLL_MAX_MS (((FIFO_SPACE - 2) * USB_AUDIO_SAMPLES_PER_BUFFER * 1000) / 78125)
+
+// how much audio from before the stream was opened the host gets, 100 ms if the fifo holds that
+#ifndef FIFO_PREROLL_MS
+#define FIFO_PREROLL_MS ((FIFO_PREROLL_MAX_MS < 100) ? FIFO_PREROLL_MAX_MS : 100)
+#endif
 
 // initializes the fifo and its buffers. all buffers will be cleared and put into the empty queue
 void fifo_init();
@@ -20,6 +40,8 @@ void              fifo_put_empty(usb_audio_buffer* buffer);
 usb_audio_buffer* fifo_take_filled();
 usb_audio_buffer* fifo_try_take_filled();
 void              fifo_put_filled(usb_audio_buffer* buffer);
+// filled buffers waiting for USB
+uint32_t          fifo_filled_level();
 
 
 // control / comunicates what kind of data is expected to be filled in the packets
@@ -29,11 +51,55 @@ typedef enum
 	fifo_mode_normal,
 	// Debug data
 	fifo_mode_debug,
+	// Synthetic frames from test_pattern.c at the ADC rate, the PCM1802 is not read
+	fifo_mode_pattern,
 }
 fifo_mode;
 
 void              fifo_set_mode(fifo_mode mode);
 fifo_mode         fifo_get_mode();
 
+// which pattern fifo_mode_pattern generates
+void              fifo_set_test_pattern(test_pattern_kind kind);
+test_pattern_kind fifo_get_test_pattern();
+
+
+// what core1 does when it has a buffer to fill but the host did not take any of the filled ones
+typedef enum
+{
+	// capture into a scratch buffer that is thrown away, the PIO never overflows and the stream tag sequence shows the dropped buffers
+	fifo_overload_drop_newest,
+	// reuse the oldest filled buffer, the host always gets the most recent audio
+	fifo_overload_overwrite_oldest,
+	// wait for the host, the PIO overflows and the next buffer is flagged with a gap (STREAM_TAG_FLAG_GAP) and a sample index jump
+	fifo_overload_marked_gap,
+}
+fifo_overload_policy;
+
+// picked at build time (FIRMWARE_OVERLOAD_POLICY in CMakeLists.txt), the status block reports it
+#ifndef FIFO_OVERLOAD_POLICY
+#define FIFO_OVERLOAD_POLICY fifo_overload_marked_gap
+#endif
+
+fifo_overload_policy fifo_get_overload_policy();
+
+// While there is no stream core1 keeps capturing and overwrites the oldest buffers. When the stream opens the
+// newest pre-roll worth of buffers is kept and the host gets those first, from then on the overload policy applies.
+void              fifo_set_streaming(bool streaming, uint32_t sample_rate);
+
+// Armed start: when the stream opens there is no pre-roll, the stream generation goes up instead. core1 then waits
+// for the next head switch edge before it fills a buffer for the new generation, core0 throws away older ones.
+void              fifo_set_armed_start(bool armed);
+bool              fifo_get_armed_start();
+uint32_t          fifo_get_stream_generation();
+
+// for core1, takes an empty buffer or applies the overload policy, buffers from here must go back with fifo_put_captured()
+usb_audio_buffer* fifo_take_for_capture();
+void              fifo_put_captured(usb_audio_buffer* buffer);
+
+// times there was no empty buffer, and buffers thrown away because of it
+extern uint32_t fifo_overload_events;
+extern uint32_t fifo_dropped_buffers;
+
 #endif
 
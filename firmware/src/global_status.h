@@ -5,7 +5,10 @@
 #define _GLOBAL_STATUS_H
 
 #include <stdint.h>
+// the host tools decode the status block with this too, see host/clockgen
+#ifndef HOST_BUILD
 #include "pico/critical_section.h"
+#endif
 
 // This will be prefixed on debug output
 #define GLOBAL_STATUS_MAGIC_NUMBER 0x11223344
@@ -27,7 +30,7 @@ typedef struct __attribute__((packed))
 	// true if the general startup of the si5351 clock generator chip looks fine
 	bool_u8   si5351_init_success;
 	
-	// true if there was activity on the PCM1802 lines, updated occasionally
+	// true if there was activity on the PCM1802 lines in the last second
 	bool_u8   pcm1802_activity_lrck;
 	bool_u8   pcm1802_activity_bck;
 	bool_u8   pcm1802_activity_data;
@@ -38,10 +41,99 @@ typedef struct __attribute__((packed))
 	
 	// Counts RX timeout conditions in main1
 	uint32_t  main1_rxsample_tmo;
+	
+	// Time from the USB IRQ until the ISO pre-load callback ran, last value and maximum in us
+	uint32_t  main0_iso_latency_us;
+	uint32_t  main0_iso_latency_max_us;
+	// Time core0 spent in WFE over the last second, 1000 is fully idle. The IRQ handlers that wake it up (USB,
+	// timers) run before __wfe() returns, so their time counts as idle too, this is only the main loop
+	uint32_t  main0_idle_permille;
+	
+	// Code layout the firmware was built with, see hot_path.h
+	uint8_t   xip_code_layout;
+	// XIP cache hits and accesses over the last second
+	uint32_t  xip_ctr_hit;
+	uint32_t  xip_ctr_acc;
+	// Highest PIO RX FIFO level seen when reading a sample, at 8 the PIO starts dropping samples
+	uint32_t  pcm1802_rx_fifo_peak;
+	
+	// System clock picked by the clock plan
+	uint32_t  clock_sys_hz;
+	// Actual frequency of the CXADC clock outputs
+	uint32_t  clock_out0_hz;
+	uint32_t  clock_out1_hz;
+	
+	// PIO RX FIFO overflows and the frames lost to them
+	uint32_t  pcm1802_rx_stall_events;
+	uint32_t  pcm1802_rx_lost_frames;
+	// No empty buffer for core1, and buffers dropped because of it, see fifo_overload_policy
+	uint32_t  fifo_overload_events;
+	uint32_t  fifo_dropped_buffers;
+	uint8_t   fifo_overload_policy;
+	
+	// Frame index of the last armed start (first frame after the head switch edge), and starts without an edge
+	uint64_t  head_switch_start_index;
+	uint32_t  head_switch_start_timeouts;
+	
+	// Compressed stream: raw and compressed bytes since boot, slowest block in us
+	uint32_t  vendor_bytes_in;
+	uint32_t  vendor_bytes_out;
+	uint32_t  vendor_encode_max_us;
+	
+	// Measured on the PCM1802 lines over the last second, see edge_counter.h. LRCK is the actual sample rate,
+	// DATA is rising edges per second, SCK is 0 unless EDGE_COUNTER_SCK_PIN is wired to it
+	uint32_t  pcm1802_lrck_hz;
+	uint32_t  pcm1802_bck_hz;
+	uint32_t  pcm1802_data_edges;
+	uint32_t  pcm1802_sck_hz;
+	bool_u8   pcm1802_activity_sck;
+	
+	// Rising edges on the sync input and the stream frame index of the last one (as in the tags), see STREAM_TAG_FLAG_SYNC
+	uint32_t  sync_count;
+	uint64_t  sync_index;
+	
+	// Rate the host picked, if it is not the ADC rate core1 resamples to it with this many taps, see resample.h
+	uint32_t  stream_sample_rate;
+	uint32_t  resample_taps;
+	
+	// Levels of ch0 and ch1 over the last window of METER_WINDOW_BUFFERS buffers, see meter.h. Peak and RMS
+	// against 24 bit full scale (0x7fffff), DC is the mean, clips counts samples at full scale since boot
+	uint32_t  meter_ch0_peak;
+	uint32_t  meter_ch1_peak;
+	uint32_t  meter_ch0_rms;
+	uint32_t  meter_ch1_rms;
+	int32_t   meter_ch0_dc;
+	int32_t   meter_ch1_dc;
+	uint32_t  meter_ch0_clips;
+	uint32_t  meter_ch1_clips;
+	// Head switch in the same window: rising edges, and the shortest, longest and mean period between two of them
+	// in frames, all 0 with a dead wire
+	uint32_t  meter_head_switch_edges;
+	uint32_t  meter_head_switch_period_min;
+	uint32_t  meter_head_switch_period_max;
+	uint32_t  meter_head_switch_period_avg;
+	// windows published since boot, if this stands still nothing is being captured
+	uint32_t  meter_windows;
+	
+	// Head switch edges timed by the PIO and put into a stream tag, and the ones dropped (a second one within a buffer, or too far off)
+	uint32_t  head_switch_stamps;
+	uint32_t  head_switch_stamps_dropped;
+	
+	// Capture restarts after a lost word alignment or clock: tried, recovered, frames lost (estimated from the time),
+	// and the time from the last good frame to the first one after the restart, last and longest
+	uint32_t  pcm1802_resync_attempts;
+	uint32_t  pcm1802_resyncs;
+	uint32_t  pcm1802_resync_lost_frames;
+	uint32_t  pcm1802_resync_last_us;
+	uint32_t  pcm1802_resync_max_us;
+	// Outages sent as fill frames (STREAM_TAG_FLAG_FILL), and the frames in them, counted in frames of the stream rate
+	uint32_t  fill_events;
+	uint32_t  fill_frames;
 }
 global_status_fields;
 
 
+#ifndef HOST_BUILD
 // This is the global status, to access it use global_status_access({ my code goes here });
 extern global_status_fields global_status;
 extern critical_section_t global_status_mutex;
@@ -55,6 +147,7 @@ void global_status_init();
 	n ; \
 	critical_section_exit(&global_status_mutex); \
 }
+#endif
 
 
 #endif
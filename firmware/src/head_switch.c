@@ -1,18 +1,89 @@
 // SPDX-License-Identifier: BSD-3-Clause
 // Copyright (c) 2023 Rene Wolf
+// Copyright (c) 2024 namazso <admin@namazso.eu>
 
 #include "head_switch.h"
+#include "head_switch_stamp.pio.h"
+#include "pcm1802.h"
+#include "hot_path.h"
+#include "dbg.h"
+#include "hardware/pio.h"
 
 #define HEAD_SWITCH_PIN 16
 
+// pio0 is full with the capture and the edge counters, pio1 has the clock 1 output
+static PIO stamp_pio;
+static int stamp_sm = -1;
+static uint stamp_offset;
+
+// position of the first frame the state machine counts from
+static uint64_t stamp_origin = 0;
+static bool have_pending = false;
+static head_switch_edge pending;
+
 void head_switch_init()
 {
 	gpio_init(HEAD_SWITCH_PIN);
 	gpio_set_dir(HEAD_SWITCH_PIN, GPIO_IN);
 	gpio_pull_down(HEAD_SWITCH_PIN);
+	
+	stamp_pio = pio1;
+	stamp_sm = pio_claim_unused_sm(stamp_pio, false);
+	if( stamp_sm < 0 || !pio_can_add_program(stamp_pio, &head_switch_stamp_program) )
+	{
+		dbg_say("head switch stamps: no room in pio1\n");
+		stamp_sm = -1;
+		return;
+	}
+	stamp_offset = pio_add_program(stamp_pio, &head_switch_stamp_program);
+	
+	// only reads, the bit clock and LRCK stay with the capture in pio0
+	pio_sm_config cfg = head_switch_stamp_program_get_default_config(stamp_offset);
+	sm_config_set_in_pins(&cfg, PCM_PIO_ADC0_BITCLK);
+	sm_config_set_jmp_pin(&cfg, HEAD_SWITCH_PIN);
+	sm_config_set_in_shift(&cfg, false, false, 32);
+	sm_config_set_fifo_join(&cfg, PIO_FIFO_JOIN_RX);
+	pio_sm_init(stamp_pio, stamp_sm, stamp_offset, &cfg);
 }
 
-bool head_switch_sample_pin()
+bool HOT_PATH(head_switch_sample_pin)()
 {
 	return gpio_get(HEAD_SWITCH_PIN);
 }
+
+void head_switch_stamp_start(uint64_t first_frame)
+{
+	if( stamp_sm < 0 )
+		return;
+	pio_sm_set_enabled(stamp_pio, stamp_sm, false);
+	pio_sm_clear_fifos(stamp_pio, stamp_sm);
+	pio_sm_restart(stamp_pio, stamp_sm);
+	pio_sm_exec(stamp_pio, stamp_sm, pio_encode_jmp(stamp_offset));
+	pio_sm_set_enabled(stamp_pio, stamp_sm, true);
+	stamp_origin = first_frame * 64;
+	have_pending = false;
+}
+
+bool HOT_PATH(head_switch_stamp_peek)(uint64_t near, head_switch_edge* edge)
+{
+	if( !have_pending )
+	{
+		if( stamp_sm < 0 || pio_sm_is_rx_fifo_empty(stamp_pio, stamp_sm) )
+			return false;
+		uint32_t w = pio_sm_get(stamp_pio, stamp_sm);
+		
+		// X counted down from all ones, ~X rising bit clock edges were seen and the first one is bit 0 of frame 0
+		uint32_t position = ((~w >> 1) - 1) & 0x7fffffff;
+		int32_t delta = (int32_t)((position - (uint32_t)(near - stamp_origin)) << 1) >> 1;
+		pending.position = near + delta;
+		pending.high = (w & 1) != 0;
+		have_pending = true;
+	}
+	*edge = pending;
+	return true;
+}
+
+void HOT_PATH(head_switch_stamp_pop)()
+{
+	have_pending = false;
+}
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: BSD-3-Clause
 // Copyright (c) 2023 Rene Wolf
+// Copyright (c) 2024 namazso <admin@namazso.eu>
 
 #ifndef _HEAD_SWITCH_H
 #define _HEAD_SWITCH_H
@@ -10,5 +11,24 @@
 void head_switch_init();
 bool head_switch_sample_pin();
 
-#endif
+// Edges of the head switch timed by a PIO state machine to a PCM1802 bit clock period, 1/64 of a frame (200 ns at
+// 78125 Hz), see head_switch_stamp.pio. The position counts in frames of the sample index, from the first frame of the
+// capture that pcm1802 gives on a (re)start, as long as no frames are lost at an unknown count.
+typedef struct
+{
+	// 64 per frame
+	uint64_t position;
+	// level after the edge
+	bool     high;
+}
+head_switch_edge;
+
+// (Re)starts the state machine, pcm1802 calls this right after starting the capture. first_frame is the sample index
+// of the first frame the capture will read, edges from before are thrown away
+void head_switch_stamp_start(uint64_t first_frame);
+// Oldest edge not taken yet. near is any position within 2^30 of it (~3.5 minutes at 78125 Hz),
+// the PIO only keeps 31 bits. False without a new edge or without the state machine
+bool head_switch_stamp_peek(uint64_t near, head_switch_edge* edge);
+void head_switch_stamp_pop();
 
+#endif
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _HOT_PATH_H
+#define _HOT_PATH_H
+
+// modules shared with the host tools include this too, there is no sdk there
+#ifndef HOST_BUILD
+#include "pico/platform.h"
+#endif
+
+// Selected with FIRMWARE_CODE_LAYOUT in CMakeLists.txt, reported in the status block
+#define CODE_LAYOUT_XIP         0
+#define CODE_LAYOUT_HOT_PATH    1
+#define CODE_LAYOUT_COPY_TO_RAM 2
+
+#ifndef CODE_LAYOUT
+#define CODE_LAYOUT CODE_LAYOUT_XIP
+#endif
+
+// Marks a function on the capture or USB ISO path. A XIP cache miss in one of these can stall long enough
+// to overflow the PIO RX FIFO, so with the hot_path layout they are placed in SRAM. With copy_to_ram
+// everything is in SRAM anyway, and with xip this does nothing.
+#if CODE_LAYOUT == CODE_LAYOUT_HOT_PATH && !defined(HOST_BUILD)
+#define HOT_PATH(func) __not_in_flash_func(func)
+#else
+#define HOT_PATH(func) func
+#endif
+
+#endif
@@ -8,15 +8,37 @@
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "pico/unique_id.h"
+#include "hardware/sync.h"
+#include "hardware/structs/xip_ctrl.h"
 #include "tusb.h"
 
 #include "build_info.h"
 #include "clock_gen.h"
 #include "dbg.h"
+#include "edge_counter.h"
 #include "main1.h"
 #include "fifo.h"
 #include "usb_descriptors.h"
 #include "global_status.h"
+#include "usb_audio.h"
+#include "usb_vendor.h"
+#include "hot_path.h"
+
+// how often the idle time of core0 and the XIP cache counters are published
+#define MAIN0_IDLE_WINDOW_US 1000000
+
+static bool led_blink(repeating_timer_t* rt)
+{
+	uint led_pin = (uint)(uintptr_t)rt->user_data;
+	gpio_put(led_pin, !gpio_get(led_pin));
+	return true;
+}
+
+// Work that is not time critical goes here, it runs on core0 whenever the USB events are handled
+static void main0_deferred_work()
+{
+	usb_vendor_service();
+}
 
 int main(void)
 {
@@ -36,12 +58,15 @@ int main(void)
 	global_status_access(
 	{
 		global_status.si5351_init_success = global_status_to_boolu8(success);
+		global_status.xip_code_layout = CODE_LAYOUT;
+		global_status.clock_sys_hz = clock_gen_get_sys_hz();
 	});
 	
 	dbg_say("Running firmware v" NFO_SEMVER_STR "\n");
 	dbg_say("Build from " NFO_GIT_SHA "\n");
 	
 	fifo_init();
+	edge_counter_init();
 	
 	dbg_say("multicore launch\n");
 	multicore_launch_core1(main1);
@@ -52,23 +77,64 @@ int main(void)
 
 	tusb_init();
 	dbg_say("tusb_init() done\n");
+	usb_audio_init();
+
+	// if clock gen init is not successful then something is really wrong and we blink with about 2Hz, otherwise led is just on.
+	// This runs from a timer IRQ, so the loop below does not have to poll for it.
+	repeating_timer_t led_timer;
+	if( success )
+		gpio_put(led_pin, 1);
+	else
+		add_repeating_timer_ms(250, led_blink, (void*)(uintptr_t)led_pin, &led_timer);
+
+	uint32_t window_start = time_us_32();
+	uint32_t idle_us = 0;
 
 	while (true)
 	{
-		// tinyusb device task
-		tud_task(); 
+		// tinyusb device task, this only handles events the USB IRQ already queued up, and returns once there are none left
+		usb_audio_service_begin();
+		tud_task();
 		
-		// t is now roughly in 250 ms
-		uint32_t t = time_us_32() >> 18;
+		main0_deferred_work();
 		
-		// if clock gen init is not successful then something is really wrong and we blink with about 2Hz, otherwise led is just on
-		if( (success) || ((t & 0x1) == 0) )
-		{
-			gpio_put(led_pin, 1);
-		}
-		else
+		// Sleep until the next interrupt (USB, timer). An IRQ that fires between tud_task() and here sets the
+		// event register on exception entry, so __wfe() returns right away and nothing is missed.
+		// The idle time includes the IRQ handlers that run before it returns.
+		uint32_t t = time_us_32();
+		__wfe();
+		idle_us += time_us_32() - t;
+		
+		t = time_us_32();
+		if( (t - window_start) >= MAIN0_IDLE_WINDOW_US )
 		{
-			gpio_put(led_pin, 0);
+			uint32_t permille = (uint32_t)(((uint64_t)idle_us * 1000) / (t - window_start));
+			// the XIP counters are cleared by writing any value
+			uint32_t xip_hit = xip_ctrl_hw->ctr_hit;
+			uint32_t xip_acc = xip_ctrl_hw->ctr_acc;
+			xip_ctrl_hw->ctr_hit = 0;
+			xip_ctrl_hw->ctr_acc = 0;
+			uint32_t hz[edge_counter_lines];
+			edge_counter_measure(hz);
+			global_status_access(
+			{
+				global_status.main0_idle_permille = permille;
+				global_status.xip_ctr_hit = xip_hit;
+				global_status.xip_ctr_acc = xip_acc;
+				global_status.clock_out0_hz = clock_gen_get_output_hz(0);
+				global_status.clock_out1_hz = clock_gen_get_output_hz(1);
+				global_status.stream_sample_rate = clock_gen_get_stream_sample_rate();
+				global_status.pcm1802_activity_data = global_status_to_boolu8(hz[edge_counter_data]);
+				global_status.pcm1802_activity_bck  = global_status_to_boolu8(hz[edge_counter_bck]);
+				global_status.pcm1802_activity_lrck = global_status_to_boolu8(hz[edge_counter_lrck]);
+				global_status.pcm1802_activity_sck  = global_status_to_boolu8(hz[edge_counter_sck]);
+				global_status.pcm1802_data_edges = hz[edge_counter_data];
+				global_status.pcm1802_bck_hz  = hz[edge_counter_bck];
+				global_status.pcm1802_lrck_hz = hz[edge_counter_lrck];
+				global_status.pcm1802_sck_hz  = hz[edge_counter_sck];
+			});
+			window_start = t;
+			idle_us = 0;
 		}
 	}
 
@@ -89,8 +155,8 @@ void tud_mount_cb()
 // Invoked when device is unmounted
 void tud_umount_cb()
 {
-	// NOOP
 	dbg_say("unmount\n");
+	usb_vendor_reset();
 }
 
 // Invoked when usb bus is suspended
@@ -10,44 +10,519 @@
 #include "pcm1802.h"
 #include "head_switch.h"
 #include "global_status.h"
+#include "hot_path.h"
+#include "clock_gen.h"
+#include "test_pattern.h"
+#include "resample.h"
+#include "meter.h"
+#include "hardware/structs/usb.h"
 
 // The exact value does not matter, it just has to be large enough to not run out
 // between two regular sample values. A value of 0xffff will timout about 100 times per second
 #define TIMEOUT_COUNT_DOWN 0xffff
 
-static bool fill_buffer_normal(usb_audio_buffer* buffer)
+// ADC frames read since boot, including the ones of buffers that were abandoned on a timeout
+static uint64_t sample_index = 0;
+static uint32_t tag_sequence = 0;
+
+// sync input level of the frame before, and the last rising edge
+static bool     sync_level = false;
+static uint32_t sync_count = 0;
+static uint64_t sync_index = 0;
+
+static void HOT_PATH(tag_first_frame)(usb_audio_buffer* buffer, uint64_t index)
 {
-	for(int i=0; i<USB_AUDIO_SAMPLES_PER_BUFFER; ++i)
+	// as close as we get to the moment the first frame left the PIO
+	stream_tag* tag = &(buffer->tag);
+	tag->capture_time_us = time_us_32();
+	tag->capture_usb_frame = usb_hw->sof_rd & USB_SOF_RD_BITS;
+	tag->pio_level = pcm1802_rx_fifo_level;
+	tag->fifo_level = fifo_filled_level();
+	tag->sample_index = index;
+}
+
+// Armed start gives up after this long without a head switch edge and starts anyway (nothing connected, tape stopped)
+#define HEAD_SWITCH_START_TIMEOUT_US 1000000
+
+// stream generation the buffers are currently filled for, see fifo_get_stream_generation()
+static uint32_t started_generation = 0;
+
+typedef enum
+{
+	start_edge,
+	start_timeout,
+	start_rx_timeout,
+}
+start_result;
+
+static start_result HOT_PATH(wait_for_head_switch_edge)(uint8_t* frame)
+{
+	// frame already holds one, keep reading over it until the head switch changes
+	bool level = head_switch_sample_pin();
+	uint32_t start = time_us_32();
+	while( true )
 	{
-		uint8_t* current_frame = buffer->data + ( i * USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE );
-		uint32_t tmo = 0; 
+		uint32_t tmo = 0;
+		while( pcm1802_try_rx_24bit_uac_pcm_type1(frame, frame + USB_AUDIO_BYTES_PER_SAMPLE) == false )
+		{
+			++tmo;
+			if( tmo > TIMEOUT_COUNT_DOWN )
+				return start_rx_timeout;
+		}
+		// the one before was thrown away
+		++sample_index;
+		
+		if( head_switch_sample_pin() != level )
+			return start_edge;
+		if( (time_us_32() - start) > HEAD_SWITCH_START_TIMEOUT_US )
+			return start_timeout;
+	}
+}
 
-		// left goes into ch0, right into ch1
-		while( pcm1802_try_rx_24bit_uac_pcm_type1(current_frame, current_frame + USB_AUDIO_BYTES_PER_SAMPLE ) == false)
+static bool HOT_PATH(armed_start)(usb_audio_buffer* buffer, uint8_t* frame)
+{
+	uint32_t generation = fifo_get_stream_generation();
+	start_result r = wait_for_head_switch_edge(frame);
+	if( r == start_rx_timeout )
+	{
+		global_status_access( global_status.main1_rxsample_tmo += 1 );
+		return false;
+	}
+	
+	started_generation = generation;
+	if( r == start_edge )
+		buffer->tag.flags |= STREAM_TAG_FLAG_START;
+	
+	global_status_access(
+	{
+		if( r == start_edge )
+			global_status.head_switch_start_index = sample_index;
+		else
+			global_status.head_switch_start_timeouts += 1;
+	});
+	return true;
+}
+
+// ADC frames of an outage still to be sent as fill frames, see pcm1802_take_outage_frames()
+static uint32_t fill_pending = 0;
+static bool     filling = false;
+static uint32_t fill_events = 0;
+static uint32_t fill_frames = 0;
+
+typedef enum
+{
+	rx_frame,
+	rx_fill,
+	rx_timeout,
+}
+rx_result;
+
+// Next ADC frame into frame (left into ch0, right into ch1), or rx_fill if it belongs to an outage and has to be a fill frame
+static rx_result HOT_PATH(next_frame)(uint8_t* frame)
+{
+	if( fill_pending == 0 )
+	{
+		uint32_t tmo = 0;
+		while( pcm1802_try_rx_24bit_uac_pcm_type1(frame, frame + USB_AUDIO_BYTES_PER_SAMPLE) == false )
 		{
+			fill_pending = pcm1802_take_outage_frames();
+			if( fill_pending )
+				break;
+			
 			++tmo; // no new data in buffer, increment our timeout countdown
 			if( tmo > TIMEOUT_COUNT_DOWN )
 			{
+				// pcm1802 hands out an outage long before this, something is really wrong
 				global_status_access( global_status.main1_rxsample_tmo += 1 );
-				return false; // reached the timeout something is really wrong, we quit ...
+				return rx_timeout;
 			}
 		}
+		if( fill_pending == 0 )
+		{
+			filling = false;
+			return rx_frame;
+		}
+	}
+	
+	if( !filling )
+		++fill_events;
+	filling = true;
+	--fill_pending;
+	return rx_fill;
+}
 
-		// head switch / sync pin goes into ch2
-		uint32_t pin_pcm_value = head_switch_sample_pin() ? USB_AUDIO_PCM24_MAX : USB_AUDIO_PCM24_MIN;
-		usb_audio_pcm24_host_to_usb(current_frame + (2*USB_AUDIO_BYTES_PER_SAMPLE), pin_pcm_value);
+// Silence in ch0 and ch1, and 0x0000XX in ch2 which is neither head switch level. With the tag byte that is
+// something real audio never has, the host can find every frame the ADC did not deliver
+static void HOT_PATH(write_fill_frame)(usb_audio_buffer* buffer, uint8_t* frame)
+{
+	memset(frame, 0, USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE);
+	buffer->tag.flags |= STREAM_TAG_FLAG_FILL;
+	++buffer->tag.fill_frames;
+	++fill_frames;
+}
+
+// An armed start only takes what comes after the head switch edge, an outage before it is not part of the stream
+static bool HOT_PATH(armed_start_after_outage)(usb_audio_buffer* buffer, uint8_t* frame)
+{
+	if( !armed_start(buffer, frame) )
+		return false;
+	sample_index += fill_pending + pcm1802_take_outage_frames();
+	fill_pending = 0;
+	filling = false;
+	return true;
+}
+
+// head switch edges from the PIO that made it into a tag, and ones that didn't
+static uint32_t head_switch_stamps = 0;
+static uint32_t head_switch_stamps_dropped = 0;
+
+// The first head switch edge that came in while the buffer was filled goes into its tag, see head_switch.h.
+// Positions are in 1/64 frames of the stream rate, the PIO counts ADC frames
+static void HOT_PATH(tag_head_switch_edge)(usb_audio_buffer* buffer, bool resampled)
+{
+	uint64_t first = buffer->tag.sample_index * 64;
+	uint64_t end = first + USB_AUDIO_SAMPLES_PER_BUFFER * 64;
+	head_switch_edge e;
+	while( head_switch_stamp_peek(sample_index * 64, &e) )
+	{
+		uint64_t pos = e.position;
+		if( resampled )
+			pos = pos * resample_get_out_hz() / clock_gen_get_adc_sample_rate();
+		// the PIO is a few frames ahead of the capture, this one is for the next buffer
+		if( pos >= end && pos < end + USB_AUDIO_SAMPLES_PER_BUFFER * 64 )
+			break;
+		head_switch_stamp_pop();
+		
+		// too far off to be in this tag: stale, or the sample index is off after frames were lost at an unknown count
+		if( pos >= end || pos + 32768 < first || (buffer->tag.flags & STREAM_TAG_FLAG_HEAD_SWITCH) )
+		{
+			++head_switch_stamps_dropped;
+			continue;
+		}
+		buffer->tag.flags |= STREAM_TAG_FLAG_HEAD_SWITCH | (e.high ? STREAM_TAG_FLAG_HEAD_SWITCH_HIGH : 0);
+		buffer->tag.head_switch_offset = (int16_t)(int64_t)(pos - first);
+		++head_switch_stamps;
 	}
+}
+
+static void HOT_PATH(finish_captured)(usb_audio_buffer* buffer)
+{
+	buffer->tag.sequence = tag_sequence++;
+	buffer->tagged = true;
+	buffer->generation = started_generation;
 	
 	global_status_access(
 	{
-		// as we just got an entire frame from the ADC we can safely assume we got activity on all pins
-		global_status.pcm1802_activity_lrck = true_u8;
-		global_status.pcm1802_activity_bck = true_u8;
-		global_status.pcm1802_activity_data = true_u8;
 		// after actually getting some samples we update the pcm counters
 		global_status.pcm1802_out_of_sync_drops = pcm1802_out_of_sync_drops;
 		global_status.pcm1802_rch_tmo_count = pcm1802_rch_tmo_count;
 		global_status.pcm1802_rch_tmo_value = pcm1802_rch_tmo_value;
+		global_status.pcm1802_rx_fifo_peak = pcm1802_rx_fifo_peak;
+		global_status.pcm1802_rx_stall_events = pcm1802_rx_stall_events;
+		global_status.pcm1802_rx_lost_frames = pcm1802_rx_lost_frames;
+		global_status.fifo_overload_events = fifo_overload_events;
+		global_status.fifo_dropped_buffers = fifo_dropped_buffers;
+		global_status.fifo_overload_policy = fifo_get_overload_policy();
+		global_status.sync_count = sync_count;
+		global_status.sync_index = sync_index;
+		global_status.head_switch_stamps = head_switch_stamps;
+		global_status.head_switch_stamps_dropped = head_switch_stamps_dropped;
+		global_status.pcm1802_resync_attempts = pcm1802_resync_attempts;
+		global_status.pcm1802_resyncs = pcm1802_resyncs;
+		global_status.pcm1802_resync_lost_frames = pcm1802_resync_lost_frames;
+		global_status.pcm1802_resync_last_us = pcm1802_resync_last_us;
+		global_status.pcm1802_resync_max_us = pcm1802_resync_max_us;
+		global_status.fill_events = fill_events;
+		global_status.fill_frames = fill_frames;
+	});
+}
+
+static bool HOT_PATH(fill_buffer_normal)(usb_audio_buffer* buffer)
+{
+	memset(&(buffer->tag), 0, sizeof(buffer->tag));
+	buffer->tagged = false;
+	
+	for(int i=0; i<USB_AUDIO_SAMPLES_PER_BUFFER; ++i)
+	{
+		uint8_t* current_frame = buffer->data + ( i * USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE );
+		rx_result r = next_frame(current_frame);
+		if( r == rx_timeout )
+		{
+			sample_index += i;
+			return false;
+		}
+
+		if( i == 0 && fifo_get_stream_generation() != started_generation )
+		{
+			if( !armed_start_after_outage(buffer, current_frame) )
+				return false;
+			r = rx_frame;
+		}
+
+		if( i == 0 )
+		{
+			// an overflow while waiting for a buffer shows up with the first frame
+			uint32_t lost = pcm1802_take_lost_frames();
+			sample_index += lost;
+			if( lost )
+				buffer->tag.flags |= STREAM_TAG_FLAG_GAP;
+			tag_first_frame(buffer, sample_index);
+		}
+
+		if( r == rx_fill )
+		{
+			write_fill_frame(buffer, current_frame);
+			continue;
+		}
+
+		// the first frame with the sync input high marks the buffer, a second edge within the same buffer is not marked
+		if( pcm1802_sync_level && !sync_level && !(buffer->tag.flags & STREAM_TAG_FLAG_SYNC) )
+		{
+			buffer->tag.flags |= STREAM_TAG_FLAG_SYNC;
+			buffer->tag.sync_offset = i;
+			sync_index = sample_index + i;
+			++sync_count;
+		}
+		sync_level = pcm1802_sync_level;
+
+		// head switch / sync pin goes into ch2, the low byte is left for the stream tag
+		uint32_t pin_pcm_value = head_switch_sample_pin() ? USB_AUDIO_PCM24_MAX : USB_AUDIO_PCM24_MIN;
+		usb_audio_pcm24_host_to_usb(current_frame + (2*USB_AUDIO_BYTES_PER_SAMPLE), pin_pcm_value & ~0xff);
+	}
+	
+	sample_index += USB_AUDIO_SAMPLES_PER_BUFFER;
+	uint32_t lost = pcm1802_take_lost_frames();
+	sample_index += lost;
+	if( lost )
+		buffer->tag.flags |= STREAM_TAG_FLAG_GAP;
+	tag_head_switch_edge(buffer, false);
+	finish_captured(buffer);
+	return true;
+}
+
+// resample.h is set up for the current rate and continues from sample_index, any other mode in between ends that
+static bool resampling = false;
+
+// Head switch level and fill of the last ADC frames, bit 0 is the newest. An output is at the frame
+// resample_get_delay() back, so its head switch level and fill come from there as well
+static uint64_t resample_head_switch_history;
+static uint64_t resample_fill_history;
+// a sync edge marks the first output at or after it, that comes out only with the delay
+static bool     resample_sync_pending = false;
+static uint64_t resample_sync_index;
+
+static bool HOT_PATH(start_resample)(uint32_t rate)
+{
+	if( !resample_start(clock_gen_get_adc_sample_rate(), rate, sample_index) )
+		return false;
+	resample_head_switch_history = head_switch_sample_pin() ? ~0ull : 0;
+	resample_fill_history = 0;
+	resample_sync_pending = false;
+	return true;
+}
+
+// the frames that went missing have the level there is now
+static void HOT_PATH(skip_resampled)(uint32_t lost)
+{
+	resample_skip(lost);
+	uint64_t level = head_switch_sample_pin() ? ~0ull : 0;
+	if( lost >= 64 )
+	{
+		resample_head_switch_history = level;
+		resample_fill_history = 0;
+		return;
+	}
+	resample_head_switch_history = (resample_head_switch_history << lost) | (level & ((1ull << lost) - 1));
+	resample_fill_history <<= lost;
+}
+
+static inline int32_t HOT_PATH(pcm24_from_usb)(const uint8_t* p)
+{
+	return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+}
+
+// Same as fill_buffer_normal() but every ADC frame goes through resample.h, and a frame of the buffer is filled when
+// an output is due. The sample index of the tags counts output frames then, the sync offset is the first output
+// frame at or after the edge.
+static bool HOT_PATH(fill_buffer_resampled)(usb_audio_buffer* buffer, uint32_t rate)
+{
+	memset(&(buffer->tag), 0, sizeof(buffer->tag));
+	buffer->tagged = false;
+	
+	if( !resampling || resample_get_out_hz() != rate )
+	{
+		// building the filter takes a while, the PIO overflow that causes is a gap like any other
+		if( !start_resample(rate) )
+			return false;
+		resampling = true;
+		global_status_access( global_status.resample_taps = resample_get_taps() );
+	}
+	
+	uint8_t frame[2 * USB_AUDIO_BYTES_PER_SAMPLE];
+	bool first = true;
+	int i = 0;
+	while( i < USB_AUDIO_SAMPLES_PER_BUFFER )
+	{
+		rx_result r = next_frame(frame);
+		if( r == rx_timeout )
+			return false;
+		
+		if( first )
+		{
+			first = false;
+			if( fifo_get_stream_generation() != started_generation )
+			{
+				if( !armed_start_after_outage(buffer, frame) )
+					return false;
+				r = rx_frame;
+				// the history from before the edge was never pushed, the filter settles within taps / 2 frames
+				start_resample(rate);
+			}
+			
+			uint32_t lost = pcm1802_take_lost_frames();
+			sample_index += lost;
+			if( lost )
+			{
+				skip_resampled(lost);
+				buffer->tag.flags |= STREAM_TAG_FLAG_GAP;
+			}
+			tag_first_frame(buffer, resample_next_index());
+		}
+		
+		if( r == rx_fill )
+			memset(frame, 0, sizeof(frame));
+		else
+		{
+			if( pcm1802_sync_level && !sync_level && !resample_sync_pending )
+			{
+				uint32_t in_hz = clock_gen_get_adc_sample_rate();
+				resample_sync_index = (sample_index * resample_get_out_hz() + in_hz - 1) / in_hz;
+				resample_sync_pending = true;
+			}
+			sync_level = pcm1802_sync_level;
+		}
+		
+		// an outage goes through the filter as silence, so the output is due on the same frames as without it
+		++sample_index;
+		resample_head_switch_history = (resample_head_switch_history << 1) | (head_switch_sample_pin() ? 1 : 0);
+		resample_fill_history = (resample_fill_history << 1) | (r == rx_fill ? 1 : 0);
+		int32_t out_l, out_r;
+		if( resample_push(pcm24_from_usb(frame), pcm24_from_usb(frame + USB_AUDIO_BYTES_PER_SAMPLE), &out_l, &out_r) )
+		{
+			uint8_t* current_frame = buffer->data + ( i * USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE );
+			uint64_t out_index = buffer->tag.sample_index + i;
+			// same as without resampling, a second edge within the buffer is not marked
+			if( resample_sync_pending && out_index >= resample_sync_index )
+			{
+				resample_sync_pending = false;
+				if( !(buffer->tag.flags & STREAM_TAG_FLAG_SYNC) )
+				{
+					buffer->tag.flags |= STREAM_TAG_FLAG_SYNC;
+					buffer->tag.sync_offset = i;
+					sync_index = out_index;
+					++sync_count;
+				}
+			}
+			uint32_t delay = resample_get_delay();
+			if( (resample_fill_history >> delay) & 1 )
+			{
+				write_fill_frame(buffer, current_frame);
+				++i;
+				continue;
+			}
+			usb_audio_pcm24_host_to_usb(current_frame, (uint32_t)out_l);
+			usb_audio_pcm24_host_to_usb(current_frame + USB_AUDIO_BYTES_PER_SAMPLE, (uint32_t)out_r);
+			// the head switch is not filtered, it is the level at the ADC frame the output is at
+			uint32_t pin_pcm_value = ((resample_head_switch_history >> delay) & 1) ? USB_AUDIO_PCM24_MAX : USB_AUDIO_PCM24_MIN;
+			usb_audio_pcm24_host_to_usb(current_frame + (2*USB_AUDIO_BYTES_PER_SAMPLE), pin_pcm_value & ~0xff);
+			++i;
+		}
+	}
+	
+	uint32_t lost = pcm1802_take_lost_frames();
+	sample_index += lost;
+	if( lost )
+	{
+		skip_resampled(lost);
+		buffer->tag.flags |= STREAM_TAG_FLAG_GAP;
+	}
+	tag_head_switch_edge(buffer, true);
+	finish_captured(buffer);
+	return true;
+}
+
+
+// fifo_mode_pattern paces itself with the timer, frame n is due at pattern_start_us + (n - pattern_start_index) / fs
+static bool     pattern_running = false;
+static uint32_t pattern_rate;
+static uint64_t pattern_start_us;
+static uint64_t pattern_start_index;
+
+static uint64_t HOT_PATH(pattern_due_us)(uint64_t index)
+{
+	return pattern_start_us + (((index - pattern_start_index) * 1000000) + pattern_rate - 1) / pattern_rate;
+}
+
+static bool HOT_PATH(fill_buffer_pattern)(usb_audio_buffer* buffer, uint32_t rate)
+{
+	memset(&(buffer->tag), 0, sizeof(buffer->tag));
+	buffer->tagged = false;
+	
+	// made up at whatever rate the host asked for, there is nothing to resample
+	if( !pattern_running || rate != pattern_rate )
+	{
+		pattern_running = true;
+		pattern_rate = rate;
+		pattern_start_us = time_us_64();
+		pattern_start_index = sample_index;
+	}
+	
+	// frames the ADC would have delivered while we were blocked on the fifo are lost, same as a PIO overflow.
+	// One buffer of slack so the jitter of this loop does not show up as gaps
+	uint64_t produced = pattern_start_index + ((time_us_64() - pattern_start_us) * pattern_rate) / 1000000;
+	if( produced > sample_index + USB_AUDIO_SAMPLES_PER_BUFFER )
+	{
+		sample_index = produced;
+		buffer->tag.flags |= STREAM_TAG_FLAG_GAP;
+	}
+	
+	// armed start waits for the next edge of the fake head switch, that is skipping frames up to the field boundary
+	if( fifo_get_stream_generation() != started_generation )
+	{
+		started_generation = fifo_get_stream_generation();
+		sample_index += (TEST_PATTERN_FIELD_FRAMES - (sample_index % TEST_PATTERN_FIELD_FRAMES)) % TEST_PATTERN_FIELD_FRAMES;
+		buffer->tag.flags |= STREAM_TAG_FLAG_START;
+		global_status_access( global_status.head_switch_start_index = sample_index );
+	}
+	
+	// the buffer is done when its last frame would have been
+	uint64_t due = pattern_due_us(sample_index + USB_AUDIO_SAMPLES_PER_BUFFER);
+	while( time_us_64() < due )
+		tight_loop_contents();
+	
+	tag_first_frame(buffer, sample_index);
+	buffer->tag.capture_time_us = (uint32_t)pattern_due_us(sample_index + 1);
+	
+	test_pattern_kind kind = fifo_get_test_pattern();
+	for(int i=0; i<USB_AUDIO_SAMPLES_PER_BUFFER; ++i)
+	{
+		uint8_t* current_frame = buffer->data + ( i * USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE );
+		uint32_t values[USB_AUDIO_CHANNELS];
+		test_pattern_frame(kind, sample_index + i, values);
+		for(int ch=0; ch<USB_AUDIO_CHANNELS; ++ch)
+			usb_audio_pcm24_host_to_usb(current_frame + (ch*USB_AUDIO_BYTES_PER_SAMPLE), values[ch]);
+	}
+	
+	sample_index += USB_AUDIO_SAMPLES_PER_BUFFER;
+	buffer->tag.sequence = tag_sequence++;
+	buffer->tagged = true;
+	buffer->generation = started_generation;
+	
+	global_status_access(
+	{
+		global_status.fifo_overload_events = fifo_overload_events;
+		global_status.fifo_dropped_buffers = fifo_dropped_buffers;
+		global_status.fifo_overload_policy = fifo_get_overload_policy();
 	});
 	
 	return true;
@@ -56,6 +531,8 @@ static bool fill_buffer_normal(usb_audio_buffer* buffer)
 static bool fill_buffer_debug(usb_audio_buffer* buffer)
 {
 	memset(buffer->data, 0, USB_AUDIO_PAYLOAD_SIZE);
+	buffer->tagged = false;
+	buffer->generation = fifo_get_stream_generation();
 	
 	int off = 0;
 	
@@ -69,41 +546,49 @@ static bool fill_buffer_debug(usb_audio_buffer* buffer)
 	if( size > left)
 		size = left;
 
-	// NOTE as these activity checks may take a while to perfrom, we do them OUTSIDE of the access lock
-	bool act_bck = pcm1802_activity_on_bck();
-	bool act_lrck = pcm1802_activity_on_lrck();
-	bool act_data = pcm1802_activity_on_data();
-	
+	// the activity and rates of the PCM1802 lines are kept up to date by core0, see edge_counter.h
 	global_status_access(
 	{
-		global_status.pcm1802_activity_bck  = global_status_to_boolu8(act_bck);
-		global_status.pcm1802_activity_lrck = global_status_to_boolu8(act_lrck);
-		global_status.pcm1802_activity_data = global_status_to_boolu8(act_data);
 		memcpy( (buffer->data) + off, &global_status, size );
 	});
 	
 	return true;
 }
 
-static void fill_buffer(usb_audio_buffer* buffer)
+static void HOT_PATH(fill_buffer)(usb_audio_buffer* buffer)
 {
 	while(true)
 	{
 		fifo_mode mode = fifo_get_mode();
+		uint32_t rate = clock_gen_get_stream_sample_rate();
+		bool resampled = (rate != clock_gen_get_adc_sample_rate());
 		bool success = false;
 		
 		if( mode == fifo_mode_normal )
-			success = fill_buffer_normal( buffer );
+			success = resampled ? fill_buffer_resampled( buffer, rate ) : fill_buffer_normal( buffer );
+		
+		if( mode != fifo_mode_normal || !resampled )
+			resampling = false;
 		
 		if( mode == fifo_mode_debug )
 			success = fill_buffer_debug( buffer );
 		
+		if( mode == fifo_mode_pattern )
+			success = fill_buffer_pattern( buffer, rate );
+		else
+			pattern_running = false;
+		
 		if( success )
+		{
+			buffer->rate = rate;
+			if( mode != fifo_mode_debug )
+				meter_add_buffer( buffer );
 			return;
+		}
 	}
 }
 
-void main1()
+void HOT_PATH(main1)()
 {
 	dbg_say("main1()\n");
 	
@@ -113,8 +598,8 @@ void main1()
 	
 	while(1)
 	{
-		usb_audio_buffer* buffer = fifo_take_empty();
+		usb_audio_buffer* buffer = fifo_take_for_capture();
 		fill_buffer(buffer);
-		fifo_put_filled(buffer);
+		fifo_put_captured(buffer);
 	}
 }
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "meter.h"
+#include "global_status.h"
+#include "hot_path.h"
+
+#include <math.h>
+
+#define WINDOW_FRAMES (METER_WINDOW_BUFFERS * USB_AUDIO_SAMPLES_PER_BUFFER)
+
+static uint32_t buffers = 0;
+static uint32_t peak[2];
+static int64_t  sum[2];
+// of the top 16 bits, so each square fits 32 bits
+static uint64_t sum_sq[2];
+// since boot
+static uint32_t clips[2];
+
+static bool     hs_level = false;
+static bool     hs_seen = false;
+// frames since the last rising edge
+static uint32_t hs_since = 0;
+static uint32_t hs_edges;
+static uint32_t hs_periods;
+static uint32_t hs_min = UINT32_MAX;
+static uint32_t hs_max;
+static uint64_t hs_sum;
+
+static void publish()
+{
+	uint32_t rms[2];
+	int32_t dc[2];
+	for(int ch=0; ch<2; ++ch)
+	{
+		rms[ch] = (uint32_t)sqrtf((float)(sum_sq[ch] / WINDOW_FRAMES)) << 8;
+		dc[ch] = (int32_t)(sum[ch] / WINDOW_FRAMES);
+	}
+	
+	global_status_access(
+	{
+		global_status.meter_ch0_peak = peak[0];
+		global_status.meter_ch1_peak = peak[1];
+		global_status.meter_ch0_rms = rms[0];
+		global_status.meter_ch1_rms = rms[1];
+		global_status.meter_ch0_dc = dc[0];
+		global_status.meter_ch1_dc = dc[1];
+		global_status.meter_ch0_clips = clips[0];
+		global_status.meter_ch1_clips = clips[1];
+		global_status.meter_head_switch_edges = hs_edges;
+		global_status.meter_head_switch_period_min = hs_periods ? hs_min : 0;
+		global_status.meter_head_switch_period_max = hs_periods ? hs_max : 0;
+		global_status.meter_head_switch_period_avg = hs_periods ? (uint32_t)(hs_sum / hs_periods) : 0;
+		global_status.meter_windows += 1;
+	});
+	
+	for(int ch=0; ch<2; ++ch)
+	{
+		peak[ch] = 0;
+		sum[ch] = 0;
+		sum_sq[ch] = 0;
+	}
+	hs_edges = 0;
+	hs_periods = 0;
+	hs_min = UINT32_MAX;
+	hs_max = 0;
+	hs_sum = 0;
+}
+
+void HOT_PATH(meter_add_buffer)(const usb_audio_buffer* buffer)
+{
+	for(int ch=0; ch<2; ++ch)
+	{
+		const uint8_t* p = buffer->data + ch * USB_AUDIO_BYTES_PER_SAMPLE;
+		uint32_t pk = peak[ch];
+		// 96 samples of 24 bit can't overflow this
+		int32_t s = 0;
+		uint64_t sq = 0;
+		for(int i=0; i<USB_AUDIO_SAMPLES_PER_BUFFER; ++i, p += USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE)
+		{
+			int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+			uint32_t a = (v < 0) ? -v : v;
+			if( a > pk )
+				pk = a;
+			if( a >= METER_CLIP_LEVEL )
+				++clips[ch];
+			s += v;
+			int32_t h = v >> 8;
+			sq += (uint32_t)(h * h);
+		}
+		peak[ch] = pk;
+		sum[ch] += s;
+		sum_sq[ch] += sq;
+	}
+	
+	// the sign of ch2 is the head switch, the stream tag only goes into the low byte later
+	const uint8_t* p = buffer->data + 2 * USB_AUDIO_BYTES_PER_SAMPLE + 2;
+	for(int i=0; i<USB_AUDIO_SAMPLES_PER_BUFFER; ++i, p += USB_AUDIO_CHANNELS * USB_AUDIO_BYTES_PER_SAMPLE)
+	{
+		// a dead wire leaves it stuck, it must not wrap around to look like a period
+		if( hs_since < UINT32_MAX )
+			++hs_since;
+		
+		// a fill frame (0x0000XX) is neither level, the period across an outage means nothing
+		if( p[0] == 0 && p[-1] == 0 )
+		{
+			hs_seen = false;
+			continue;
+		}
+		
+		bool level = (*p & 0x80) == 0;
+		if( level && !hs_level )
+		{
+			++hs_edges;
+			if( hs_seen )
+			{
+				++hs_periods;
+				hs_sum += hs_since;
+				if( hs_since < hs_min )
+					hs_min = hs_since;
+				if( hs_since > hs_max )
+					hs_max = hs_since;
+			}
+			hs_since = 0;
+			hs_seen = true;
+		}
+		hs_level = level;
+	}
+	
+	if( ++buffers == METER_WINDOW_BUFFERS )
+	{
+		buffers = 0;
+		publish();
+	}
+}
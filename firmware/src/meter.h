@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _METER_H
+#define _METER_H
+
+#include <stdint.h>
+#include "usb_audio_format.h"
+
+// Levels of ch0 and ch1 and the period of the head switch on ch2, kept by core1 over every buffer it fills and
+// published into the status block once per window. A few bytes of telemetry then say if the levels are sane
+// and the head switch wire is connected, without looking at the audio itself.
+
+// ~315 ms at 78125 Hz, enough for a couple of head switch periods
+#define METER_WINDOW_BUFFERS 256
+// samples at least this far from 0 count as clipped, the PCM1802 sticks at full scale
+#define METER_CLIP_LEVEL     0x7fff00
+
+// buffer as it goes to the fifo, before core0 puts the stream tag into it
+void meter_add_buffer(const usb_audio_buffer* buffer);
+
+#endif
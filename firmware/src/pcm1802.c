@@ -8,17 +8,22 @@
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "usb_audio_format.h"
+#include "hot_path.h"
+#include "clock_gen.h"
+#include "head_switch.h"
 
 // see also https://www.pjrc.com/pcm1802-breakout-board-needs-hack/
 #define PCM1802_POWER_DOWN_PIN 17
 
+// a frame is 25.6 us at the slowest clock
+#define LRCLK_WAIT_US 100
 
-// NOTE GPIOs must be consecutive for the PIO to work and in the order of DATA, BITCLK, LRCLK
-#define PCM_PIO_ADC0_DATA   10
-#define PCM_PIO_ADC0_BITCLK 11
-#define PCM_PIO_ADC0_LRCLK  12
-// not connected / outputs debug info from PIO
-#define PCM_PIO_ADC0_DEBUG  13
+// This many out of sync words or right channel timeouts without a good frame in between restart the capture
+#define RESYNC_AFTER_ERRORS 4
+// No frame for this long is a lost clock (unplugged external clock, ADC in reset), the capture is restarted
+// once the LRCK is back. Tried again every RESYNC_RETRY_US while it isn't
+#define CLOCK_LOST_US   2000
+#define RESYNC_RETRY_US 1000
 
 static_assert((PCM_PIO_ADC0_DATA + pcm1802_index_data)   == PCM_PIO_ADC0_DATA,   "ADC0 DATA GPIO not where it should be");
 static_assert((PCM_PIO_ADC0_DATA + pcm1802_index_bitclk) == PCM_PIO_ADC0_BITCLK, "ADC0 BITCLK GPIO not where it should be");
@@ -34,6 +39,26 @@ static uint32_t pio_sm;
 uint32_t pcm1802_out_of_sync_drops;
 uint32_t pcm1802_rch_tmo_count;
 uint32_t pcm1802_rch_tmo_value;
+uint32_t pcm1802_rx_fifo_peak;
+uint32_t pcm1802_rx_fifo_level;
+uint32_t pcm1802_rx_stall_events;
+uint32_t pcm1802_rx_lost_frames;
+bool pcm1802_sync_level;
+uint32_t pcm1802_resync_attempts;
+uint32_t pcm1802_resyncs;
+uint32_t pcm1802_resync_lost_frames;
+uint32_t pcm1802_resync_last_us;
+uint32_t pcm1802_resync_max_us;
+static uint32_t lost_frames_pending;
+static uint32_t outage_frames_pending;
+static uint32_t outage_remainder;
+static uint32_t last_rx_time;
+// frames read and lost since the start, the sample index of the next frame as far as we know
+static uint64_t rx_index;
+static uint32_t errors_in_row;
+static bool     recovering;
+static uint32_t recovery_start;
+static uint32_t last_attempt_time;
 
 static uint32_t setup_pio(uint32_t pin)
 {
@@ -47,7 +72,12 @@ static uint32_t setup_pio(uint32_t pin)
 	// Set and initialize the input pins
 	sm_config_set_in_pins(&cfg, pin);
 	pio_sm_set_consecutive_pindirs(pio, sm, pin, (pcm1802_index_lrclk-pcm1802_index_data)+1, false);
-	sm_config_set_jmp_pin(&cfg, pin + pcm1802_index_data);
+	sm_config_set_jmp_pin(&cfg, PCM_PIO_ADC0_SYNC);
+	
+	// the sync input reads low when nothing is connected
+	gpio_init(PCM_PIO_ADC0_SYNC);
+	gpio_set_dir(PCM_PIO_ADC0_SYNC, GPIO_IN);
+	gpio_pull_down(PCM_PIO_ADC0_SYNC);
 	
 	// Set and initialize the output pins
 	sm_config_set_set_pins(&cfg, pin + pcm1802_index_dbg, 1);
@@ -79,7 +109,80 @@ void pcm_pio_init()
 	
 	pio_sm = setup_pio(PCM_PIO_ADC0_DATA);
 	
+	// The head switch stamps count frames from the same LRCK edge, both wait for the next rising one.
+	// Right after a rising edge there is half a frame to start both, without a clock they see the same first edge anyway
+	uint32_t start = time_us_32();
+	while( gpio_get(PCM_PIO_ADC0_LRCLK) && (time_us_32() - start) < LRCLK_WAIT_US ) { }
+	while( !gpio_get(PCM_PIO_ADC0_LRCLK) && (time_us_32() - start) < LRCLK_WAIT_US ) { }
 	pio_sm_set_enabled(pio, pio_sm, true);
+	head_switch_stamp_start(0);
+}
+
+// The ADC should have delivered this many frames since the last one read (plus extra), they become outage frames
+// and the next ones count from now. The remainder carries over so a long outage stays on the nominal rate
+static void count_outage(uint32_t now, uint32_t extra)
+{
+	uint64_t t = (uint64_t)(now - last_rx_time) * clock_gen_get_adc_sample_rate() + outage_remainder;
+	uint32_t frames = (uint32_t)(t / 1000000) + extra;
+	outage_remainder = (uint32_t)(t % 1000000);
+	last_rx_time = now;
+	
+	rx_index += frames;
+	outage_frames_pending += frames;
+	pcm1802_resync_lost_frames += frames;
+}
+
+// Starts the capture again from the beginning of a frame, false if there is no LRCK to do that with.
+// Everything from the last good frame up to the restart is an outage, estimated from the time
+static bool resync()
+{
+	uint32_t start = time_us_32();
+	last_attempt_time = start;
+	++pcm1802_resync_attempts;
+	
+	// the recovery time counts from the last good frame until the first one after a restart that worked
+	if( !recovering )
+		recovery_start = last_rx_time;
+	recovering = true;
+	
+	bool level = gpio_get(PCM_PIO_ADC0_LRCLK);
+	while( gpio_get(PCM_PIO_ADC0_LRCLK) == level )
+	{
+		if( (time_us_32() - start) > LRCLK_WAIT_US )
+		{
+			// no clock, the time so far is handed out now so the stream can be filled while it lasts
+			count_outage(time_us_32(), 0);
+			dbg_say("pcm1802 resync: no LRCK\n");
+			return false;
+		}
+	}
+	
+	pio_sm_set_enabled(pio, pio_sm, false);
+	pio_sm_clear_fifos(pio, pio_sm);
+	pio_sm_restart(pio, pio_sm);
+	pio_sm_exec(pio, pio_sm, pio_encode_jmp(pio_program_offset));
+	pio->fdebug = 1u << (PIO_FDEBUG_RXSTALL_LSB + pio_sm);
+	
+	// same as pcm_pio_init(), just after a rising edge
+	start = time_us_32();
+	while( gpio_get(PCM_PIO_ADC0_LRCLK) && (time_us_32() - start) < LRCLK_WAIT_US ) { }
+	while( !gpio_get(PCM_PIO_ADC0_LRCLK) && (time_us_32() - start) < LRCLK_WAIT_US ) { }
+	pio_sm_set_enabled(pio, pio_sm, true);
+	
+	// the frames since the last read, and the one that just started, the PIO begins with the next one
+	count_outage(time_us_32(), 1);
+	outage_remainder = 0;
+	head_switch_stamp_start(rx_index);
+	errors_in_row = 0;
+	dbg_say("pcm1802 resync\n");
+	return true;
+}
+
+static void HOT_PATH(count_error)()
+{
+	++errors_in_row;
+	if( errors_in_row >= RESYNC_AFTER_ERRORS )
+		resync();
 }
 
 void pcm1802_init()
@@ -90,6 +193,24 @@ void pcm1802_init()
 	pcm1802_out_of_sync_drops = 0;
 	pcm1802_rch_tmo_count = 0;
 	pcm1802_rch_tmo_value = 0;
+	pcm1802_rx_fifo_peak = 0;
+	pcm1802_rx_fifo_level = 0;
+	pcm1802_rx_stall_events = 0;
+	pcm1802_rx_lost_frames = 0;
+	pcm1802_sync_level = false;
+	pcm1802_resync_attempts = 0;
+	pcm1802_resyncs = 0;
+	pcm1802_resync_lost_frames = 0;
+	pcm1802_resync_last_us = 0;
+	pcm1802_resync_max_us = 0;
+	lost_frames_pending = 0;
+	outage_frames_pending = 0;
+	outage_remainder = 0;
+	last_rx_time = time_us_32();
+	rx_index = 0;
+	errors_in_row = 0;
+	recovering = false;
+	last_attempt_time = last_rx_time;
 	pcm_pio_init();
 }
 
@@ -111,10 +232,58 @@ void pcm1802_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte)
 	while(pcm1802_try_rx_24bit_uac_pcm_type1(l_3byte, r_3byte) == false) { }
 }
 
-bool pcm1802_try_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte)
+static void HOT_PATH(check_rx_stall)(uint32_t level)
+{
+	// the PIO sets this when a push noblock found the FIFO full and the word was dropped, write 1 to clear
+	const uint32_t mask = 1u << (PIO_FDEBUG_RXSTALL_LSB + pio_sm);
+	if( (pio->fdebug & mask) == 0 )
+		return;
+	pio->fdebug = mask;
+	
+	// everything the ADC produced since the last read, minus what is still in the FIFO
+	uint32_t elapsed = time_us_32() - last_rx_time;
+	uint32_t produced = (uint32_t)(((uint64_t)elapsed * clock_gen_get_adc_sample_rate()) / 1000000);
+	uint32_t queued = level / 2;
+	uint32_t lost = (produced > queued) ? (produced - queued) : 1;
+	
+	++pcm1802_rx_stall_events;
+	pcm1802_rx_lost_frames += lost;
+	lost_frames_pending += lost;
+	rx_index += lost;
+	dbg_say("pcm1802 rx overflow!\n");
+}
+
+uint32_t HOT_PATH(pcm1802_take_lost_frames)()
+{
+	uint32_t ret = lost_frames_pending;
+	lost_frames_pending = 0;
+	return ret;
+}
+
+uint32_t HOT_PATH(pcm1802_take_outage_frames)()
 {
-	if( pio_sm_is_rx_fifo_empty(pio, pio_sm) )
+	uint32_t ret = outage_frames_pending;
+	outage_frames_pending = 0;
+	return ret;
+}
+
+bool HOT_PATH(pcm1802_try_rx_24bit_uac_pcm_type1)(uint8_t* l_3byte, uint8_t* r_3byte)
+{
+	uint32_t level = pio_sm_get_rx_fifo_level(pio, pio_sm);
+	if( level == 0 )
+	{
+		uint32_t now = time_us_32();
+		if( (recovering || (now - last_rx_time) > CLOCK_LOST_US) && (now - last_attempt_time) > RESYNC_RETRY_US )
+			resync();
 		return false;
+	}
+	
+	check_rx_stall(level);
+	
+	// how close we got to losing samples, this is what the code layout influences the most
+	if( level > pcm1802_rx_fifo_peak )
+		pcm1802_rx_fifo_peak = level;
+	pcm1802_rx_fifo_level = level;
 	
 	uint32_t ch_l = pio_sm_get_blocking(pio, pio_sm);
 	if( ch_l & 0x01000000 )
@@ -122,6 +291,7 @@ bool pcm1802_try_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte)
 		// we got a sample for the right channel -> out of sync, drop sample wait for next one
 		++pcm1802_out_of_sync_drops;
 		dbg_say("pcm1802 out of sync, drop!\n");
+		count_error();
 		return false;
 	}
 
@@ -137,50 +307,26 @@ bool pcm1802_try_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte)
 		{
 			++pcm1802_rch_tmo_count;
 			dbg_say("pcm1802 tmo R!\n");
+			count_error();
 			return false;
 		}
 	}
 	
 	uint32_t ch_r = pio_sm_get_blocking(pio, pio_sm);
+	last_rx_time = time_us_32();
+	++rx_index;
+	errors_in_row = 0;
+	if( recovering )
+	{
+		recovering = false;
+		++pcm1802_resyncs;
+		pcm1802_resync_last_us = last_rx_time - recovery_start;
+		if( pcm1802_resync_last_us > pcm1802_resync_max_us )
+			pcm1802_resync_max_us = pcm1802_resync_last_us;
+	}
+	pcm1802_sync_level = (ch_r & 0x02000000) != 0;
 	usb_audio_pcm24_host_to_usb(r_3byte, ch_r);
 
 	pcm1802_rch_tmo_value = cnt;
 	return true;
 }
-
-static bool wait_for_pos_edge_on_pin(uint32_t pin)
-{
-	// this takes long enough to not timeout on 46kHz which is our slowest clock line (LR clock)
-	uint32_t tmo = 0xfff;
-	
-	while( gpio_get(pin) == true )
-	{
-		--tmo;
-		if( tmo == 0)
-			return false;
-	}
-	
-	while( gpio_get(pin) == false )
-	{
-		--tmo;
-		if( tmo == 0)
-			return false;
-	}
-	
-	return true;
-}
-
-bool pcm1802_activity_on_lrck()
-{
-	return wait_for_pos_edge_on_pin(PCM_PIO_ADC0_LRCLK);
-}
-
-bool pcm1802_activity_on_bck()
-{
-	return wait_for_pos_edge_on_pin(PCM_PIO_ADC0_BITCLK);
-}
-
-bool pcm1802_activity_on_data()
-{
-	return wait_for_pos_edge_on_pin(PCM_PIO_ADC0_DATA);
-}
@@ -11,9 +11,34 @@ extern "C" {
 #include <stdint.h>
 #include "pico/stdlib.h"
 
+// NOTE GPIOs must be consecutive for the PIO to work and in the order of DATA, BITCLK, LRCLK
+#define PCM_PIO_ADC0_DATA   10
+#define PCM_PIO_ADC0_BITCLK 11
+#define PCM_PIO_ADC0_LRCLK  12
+// not connected / outputs debug info from PIO
+#define PCM_PIO_ADC0_DEBUG  13
+// common sync pulse of several devices, latched by the PIO with each frame
+#define PCM_PIO_ADC0_SYNC   14
+
 extern uint32_t pcm1802_out_of_sync_drops;
 extern uint32_t pcm1802_rch_tmo_count;
 extern uint32_t pcm1802_rch_tmo_value;
+extern uint32_t pcm1802_rx_fifo_peak;
+// RX FIFO level before the last successful read
+extern uint32_t pcm1802_rx_fifo_level;
+// times the PIO found the RX FIFO full and dropped a word, and the frames lost that way (estimated from the time since the last read)
+extern uint32_t pcm1802_rx_stall_events;
+extern uint32_t pcm1802_rx_lost_frames;
+// level of the sync input in the last frame received
+extern bool pcm1802_sync_level;
+// Restarts of the capture at a frame boundary after it lost the word alignment or the clock, the ones that were
+// followed by a good frame, the outage frames, and how long the last / longest one took from the last good
+// frame to the first one after it
+extern uint32_t pcm1802_resync_attempts;
+extern uint32_t pcm1802_resyncs;
+extern uint32_t pcm1802_resync_lost_frames;
+extern uint32_t pcm1802_resync_last_us;
+extern uint32_t pcm1802_resync_max_us;
 
 void pcm1802_init();
 void pcm1802_power_up();
@@ -22,13 +47,11 @@ void pcm1802_power_down();
 void pcm1802_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte);
 // Non-blocking receive of one sample on L+R channels in USB UAC PCM Type I format, returns true if successful
 bool pcm1802_try_rx_24bit_uac_pcm_type1(uint8_t* l_3byte, uint8_t* r_3byte);
-
-// Checks for activity on pins, this can be used to debug problems.
-// Each function may also use some additional logic to filter out unwanted behavior, 
-// improving the detection quality. Callin one of these may take a couple ms to complete.
-bool pcm1802_activity_on_lrck();
-bool pcm1802_activity_on_bck();
-bool pcm1802_activity_on_data();
+// Frames lost to RX FIFO overflows since the last call
+uint32_t pcm1802_take_lost_frames();
+// Frames the ADC did not deliver since the last call (lost sync or clock, see pcm1802_resyncs). They come in while
+// the outage lasts, every millisecond or so, and always before the next frame that is read
+uint32_t pcm1802_take_outage_frames();
 
 #ifdef __cplusplus
 }
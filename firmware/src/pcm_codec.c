@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include <string.h>
+#include "pcm_codec.h"
+#include "hot_path.h"
+
+// unary part longer than this is an escape, the residual follows as 32 bits
+#define RICE_ESCAPE 31
+#define RICE_MAX_K  24
+
+typedef struct
+{
+	uint8_t* p;
+	uint32_t acc;
+	uint32_t bits;
+}
+bit_writer;
+
+typedef struct
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	uint32_t acc;
+	uint32_t bits;
+	bool     overrun;
+}
+bit_reader;
+
+static inline void HOT_PATH(bw_put)(bit_writer* w, uint32_t value, uint32_t n)
+{
+	// n <= 25 (k + 1 with RICE_MAX_K), so acc (less than 8 bits pending) never overflows
+	w->acc = (w->acc << n) | (value & ((1u << n) - 1));
+	w->bits += n;
+	while( w->bits >= 8 )
+	{
+		w->bits -= 8;
+		*(w->p++) = (uint8_t)(w->acc >> w->bits);
+	}
+}
+
+static inline void HOT_PATH(bw_put32)(bit_writer* w, uint32_t value)
+{
+	bw_put(w, value >> 16, 16);
+	bw_put(w, value, 16);
+}
+
+static inline void HOT_PATH(bw_ones)(bit_writer* w, uint32_t n)
+{
+	while( n >= 16 )
+	{
+		bw_put(w, 0xffff, 16);
+		n -= 16;
+	}
+	if( n )
+		bw_put(w, 0xffff, n);
+}
+
+static inline uint32_t HOT_PATH(bw_bits_since)(const bit_writer* w, const bit_writer* start)
+{
+	return (uint32_t)(w->p - start->p) * 8 + w->bits - start->bits;
+}
+
+static inline void HOT_PATH(bw_flush)(bit_writer* w)
+{
+	if( w->bits )
+		*(w->p++) = (uint8_t)(w->acc << (8 - w->bits));
+	w->bits = 0;
+	w->acc = 0;
+}
+
+static inline uint32_t br_get(bit_reader* r, uint32_t n)
+{
+	while( r->bits < n )
+	{
+		uint32_t b = 0;
+		if( r->p < r->end )
+			b = *(r->p++);
+		else
+			r->overrun = true;
+		r->acc = (r->acc << 8) | b;
+		r->bits += 8;
+	}
+	r->bits -= n;
+	return (r->acc >> r->bits) & ((n == 32) ? 0xffffffff : ((1u << n) - 1));
+}
+
+static inline int32_t HOT_PATH(load24)(const uint8_t* p)
+{
+	// sign extend
+	return ((int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24)) >> 8;
+}
+
+static inline void store24(uint8_t* p, int32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+}
+
+static inline uint32_t HOT_PATH(zigzag)(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static inline int32_t HOT_PATH(predict)(uint8_t order, int32_t x1, int32_t x2, int32_t x3)
+{
+	switch( order )
+	{
+	case 1:  return x1;
+	case 2:  return 2 * x1 - x2;
+	case 3:  return 3 * x1 - 3 * x2 + x3;
+	default: return 0;
+	}
+}
+
+uint32_t HOT_PATH(pcm_codec_checksum)(const uint8_t* data, size_t len)
+{
+	uint32_t h = 0x811c9dc5;
+	for(size_t i=0; i<len; ++i)
+	{
+		h ^= data[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static void HOT_PATH(encode_verbatim)(bit_writer* w, const uint8_t* frames, uint16_t n, uint32_t stride)
+{
+	bw_put(w, PCM_CODEC_MODE_VERBATIM, 8);
+	bw_put(w, 0, 8);
+	for(uint16_t i=0; i<n; ++i)
+		bw_put(w, (uint32_t)load24(frames + i * stride), 24);
+}
+
+static void HOT_PATH(encode_channel)(bit_writer* w, const uint8_t* frames, uint16_t n, uint32_t stride)
+{
+	// sum of the absolute residuals for every order in one pass, same as the FLAC fixed predictor search
+	uint64_t sum[4] = { 0, 0, 0, 0 };
+	int32_t x1 = 0, x2 = 0, x3 = 0;
+	for(uint16_t i=0; i<n; ++i)
+	{
+		int32_t x = load24(frames + i * stride);
+		if( i >= 3 )
+		{
+			int32_t e0 = x;
+			int32_t e1 = x - x1;
+			int32_t e2 = e1 - (x1 - x2);
+			int32_t e3 = e2 - (x1 - 2 * x2 + x3);
+			sum[0] += (e0 < 0) ? -e0 : e0;
+			sum[1] += (e1 < 0) ? -e1 : e1;
+			sum[2] += (e2 < 0) ? -e2 : e2;
+			sum[3] += (e3 < 0) ? -e3 : e3;
+		}
+		x3 = x2; x2 = x1; x1 = x;
+	}
+	
+	uint8_t order = 0;
+	for(uint8_t o=1; o<4; ++o)
+		if( sum[o] < sum[order] )
+			order = o;
+	
+	// Rice parameter from the mean of the zigzag residuals (twice the mean absolute value)
+	uint32_t n_res = (n > 3) ? (n - 3) : 1;
+	uint64_t mean2 = sum[order] * 2;
+	uint32_t k = 0;
+	while( k < RICE_MAX_K && ((uint64_t)n_res << (k + 1)) < mean2 )
+		++k;
+	
+	// a rough bit count to fall back to verbatim for noise, it leaves out the escapes and the warm up
+	uint64_t estimate = (uint64_t)n * (k + 1) + (mean2 >> k);
+	if( estimate >= (uint64_t)n * 24 )
+	{
+		encode_verbatim(w, frames, n, stride);
+		return;
+	}
+	
+	// so the real count decides: a code that would take the channel past verbatim rewinds it and stores it verbatim,
+	// that keeps every block within PCM_CODEC_MAX_BLOCK_BYTES()
+	bit_writer start = *w;
+	uint32_t limit = 16 + (uint32_t)n * 24;
+	
+	bw_put(w, order, 8);
+	bw_put(w, k, 8);
+	
+	x1 = x2 = x3 = 0;
+	for(uint16_t i=0; i<n; ++i)
+	{
+		int32_t x = load24(frames + i * stride);
+		uint32_t u = 0, q = 0, cost = 24;
+		if( i >= order )
+		{
+			u = zigzag(x - predict(order, x1, x2, x3));
+			q = u >> k;
+			cost = (q < RICE_ESCAPE) ? q + 1 + k : RICE_ESCAPE + 32;
+		}
+		if( bw_bits_since(w, &start) + cost > limit )
+		{
+			*w = start;
+			encode_verbatim(w, frames, n, stride);
+			return;
+		}
+		
+		if( i < order )
+		{
+			bw_put(w, (uint32_t)x, 24);
+		}
+		else if( q < RICE_ESCAPE )
+		{
+			bw_ones(w, q);
+			// terminating zero and the low bits in one go
+			bw_put(w, u & ((1u << k) - 1), k + 1);
+		}
+		else
+		{
+			bw_ones(w, RICE_ESCAPE);
+			bw_put32(w, u);
+		}
+		x3 = x2; x2 = x1; x1 = x;
+	}
+}
+
+size_t HOT_PATH(pcm_codec_encode)(const uint8_t* frames, uint16_t n_frames, uint8_t channels, uint8_t* out)
+{
+	if( channels == 0 || channels > PCM_CODEC_MAX_CHANNELS || n_frames == 0 || n_frames > PCM_CODEC_MAX_FRAMES )
+		return 0;
+	
+	uint32_t stride = channels * 3;
+	pcm_codec_header h;
+	h.magic = PCM_CODEC_MAGIC;
+	h.version = PCM_CODEC_VERSION;
+	h.channels = channels;
+	h.frames = n_frames;
+	h.checksum = pcm_codec_checksum(frames, (size_t)n_frames * stride);
+	
+	bit_writer w = { out + sizeof(h), 0, 0 };
+	for(uint8_t c=0; c<channels; ++c)
+		encode_channel(&w, frames + c * 3, n_frames, stride);
+	bw_flush(&w);
+	
+	h.payload_bytes = (uint16_t)(w.p - (out + sizeof(h)));
+	memcpy(out, &h, sizeof(h));
+	return sizeof(h) + h.payload_bytes;
+}
+
+size_t pcm_codec_decode(const uint8_t* in, size_t len, uint8_t* out, size_t out_len, uint16_t* n_frames, uint8_t* channels)
+{
+	pcm_codec_header h;
+	if( len < sizeof(h) )
+		return 0;
+	memcpy(&h, in, sizeof(h));
+	
+	if( h.magic != PCM_CODEC_MAGIC || h.version != PCM_CODEC_VERSION )
+		return 0;
+	if( h.channels == 0 || h.channels > PCM_CODEC_MAX_CHANNELS || h.frames == 0 || h.frames > PCM_CODEC_MAX_FRAMES )
+		return 0;
+	if( len < sizeof(h) + h.payload_bytes )
+		return 0;
+	
+	uint32_t stride = h.channels * 3;
+	if( out_len < (size_t)h.frames * stride )
+		return 0;
+	
+	bit_reader r = { in + sizeof(h), in + sizeof(h) + h.payload_bytes, 0, 0, false };
+	for(uint8_t c=0; c<h.channels; ++c)
+	{
+		uint8_t* dst = out + c * 3;
+		uint32_t mode = br_get(&r, 8);
+		uint32_t k = br_get(&r, 8);
+		
+		if( mode == PCM_CODEC_MODE_VERBATIM )
+		{
+			for(uint16_t i=0; i<h.frames; ++i)
+				store24(dst + i * stride, (int32_t)br_get(&r, 24));
+			continue;
+		}
+		
+		if( mode > 3 || k > RICE_MAX_K )
+			return 0;
+		
+		int32_t x1 = 0, x2 = 0, x3 = 0;
+		for(uint16_t i=0; i<h.frames; ++i)
+		{
+			int32_t x;
+			if( i < mode )
+			{
+				x = ((int32_t)(br_get(&r, 24) << 8)) >> 8;
+			}
+			else
+			{
+				uint32_t q = 0;
+				while( q < RICE_ESCAPE && br_get(&r, 1) )
+					++q;
+				uint32_t u;
+				if( q == RICE_ESCAPE )
+					u = br_get(&r, 32);
+				else
+					u = (q << k) | (k ? br_get(&r, k) : 0);
+				x = unzigzag(u) + predict(mode, x1, x2, x3);
+				// wraps like the encoder did, the stored samples are 24 bit
+				x = ((int32_t)((uint32_t)x << 8)) >> 8;
+			}
+			store24(dst + i * stride, x);
+			x3 = x2; x2 = x1; x1 = x;
+			if( r.overrun )
+				return 0;
+		}
+	}
+	
+	if( r.overrun || pcm_codec_checksum(out, (size_t)h.frames * stride) != h.checksum )
+		return 0;
+	
+	*n_frames = h.frames;
+	*channels = h.channels;
+	return sizeof(h) + h.payload_bytes;
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _PCM_CODEC_H
+#define _PCM_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lossless coder for the 24 bit little endian USB frames, a FLAC style fixed predictor (order 0-3) and Rice coded residuals.
+// Each block is self contained: header, then per channel one byte mode, one byte Rice parameter, the warm up samples and the residuals.
+// This has no dependency on the pico sdk, the host tools decode with the same file.
+
+#define PCM_CODEC_MAGIC        0x4350 // "PC"
+#define PCM_CODEC_VERSION      1
+#define PCM_CODEC_MAX_CHANNELS 4
+#define PCM_CODEC_MAX_FRAMES   1024
+
+// channel mode byte, the predictor order or stored as is
+#define PCM_CODEC_MODE_VERBATIM 0xff
+
+typedef struct __attribute__((packed))
+{
+	uint16_t magic;
+	uint8_t  version;
+	uint8_t  channels;
+	uint16_t frames;
+	// bytes following the header
+	uint16_t payload_bytes;
+	// FNV-1a over the decoded frames, so the host can tell a bad block or a false sync
+	uint32_t checksum;
+}
+pcm_codec_header;
+
+// worst case block size, every channel verbatim. The encoder never goes above it, a channel that would is stored verbatim
+#define PCM_CODEC_MAX_BLOCK_BYTES(frames, channels) (sizeof(pcm_codec_header) + (channels) * (2 + (frames) * 3) + 4)
+
+uint32_t pcm_codec_checksum(const uint8_t* data, size_t len);
+
+// frames are channels * 3 bytes each, returns the block size or 0 if the parameters are out of range. out must hold PCM_CODEC_MAX_BLOCK_BYTES()
+size_t pcm_codec_encode(const uint8_t* frames, uint16_t n_frames, uint8_t channels, uint8_t* out);
+
+// decodes one block from in (len bytes available), returns the bytes used or 0 if it is not a valid block.
+// out must hold frames * channels * 3 bytes, *n_frames and *channels are set on success.
+size_t pcm_codec_decode(const uint8_t* in, size_t len, uint8_t* out, size_t out_len, uint16_t* n_frames, uint8_t* channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "resample.h"
+#include "hot_path.h"
+
+#include <math.h>
+#include <string.h>
+#include "hardware/interp.h"
+
+#define STOPBAND_DB 80.0f
+// Kaiser's estimates come out 1-2 dB short of that at these lengths, the filter is designed for a bit more
+#define DESIGN_DB   (STOPBAND_DB + 3)
+// Q15 coefficients leave quantization noise right at the 80 dB, Q18 is as far as the MACs go, see finish()
+#define COEF_BITS   18
+#define SPLIT_BITS  12
+
+static uint32_t in_hz = 0;
+static uint32_t out_hz = 0;
+static uint32_t taps = 0;
+
+// one output every step_int + step_rem / out_hz ADC frames
+static uint32_t step_int;
+static uint32_t step_rem;
+// where the next output falls between two ADC frames, in 1/out_hz
+static uint32_t frac_num;
+// ADC frames still to push before the next output is due
+static uint32_t wait;
+static uint64_t next_index;
+
+// Each sample is written twice, taps apart, so the last taps ones are always in one piece at pos + 1.
+// High and low 12 bits separately, see finish()
+static uint32_t pos;
+static int16_t hist_hi[2][2 * RESAMPLE_MAX_TAPS];
+static uint16_t hist_lo[2][2 * RESAMPLE_MAX_TAPS];
+
+// Q18 coefficients, row p is phase p, the one after the last phase is phase 0 of the next frame
+static int32_t table[(RESAMPLE_PHASES + 1) * RESAMPLE_MAX_TAPS];
+
+uint32_t resample_taps_for(uint32_t adc_hz, uint32_t out_hz)
+{
+	if( out_hz == 0 || out_hz >= adc_hz )
+		return 0;
+
+	// Pass band up to 0.41 out_hz, anything above 0.59 out_hz folds back to above the pass band.
+	// Kaiser's estimate for the length, rounded up to a multiple of 4
+	float transition = 0.18f * out_hz / adc_hz;
+	uint32_t n = (uint32_t)ceilf((DESIGN_DB - 8) / (2.285f * 2 * (float)M_PI * transition));
+	n = (n + 3) & ~3u;
+	return (n <= RESAMPLE_MAX_TAPS) ? n : 0;
+}
+
+static float bessel_i0(float x)
+{
+	float sum = 1, term = 1;
+	for(int k=1; k<30; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// row p of the prototype, coefficient m goes with the m-th oldest sample of the history
+static void make_phase(uint32_t p, int32_t* row)
+{
+	float beta = 0.1102f * (DESIGN_DB - 8.7f);
+	float half = taps / 2.0f;
+	// cutoff at out_hz / 2, in cycles per ADC frame times 2
+	float fc2 = (float)out_hz / in_hz;
+
+	float h[RESAMPLE_MAX_TAPS];
+	float sum = 0;
+	for(uint32_t m=0; m<taps; ++m)
+	{
+		float t = (taps - 1 - m) + (float)p / RESAMPLE_PHASES - half;
+		float x = (float)M_PI * fc2 * t;
+		float sinc = (x == 0) ? 1 : sinf(x) / x;
+		float w = t / half;
+		w = (w >= 1 || w <= -1) ? 0 : bessel_i0(beta * sqrtf(1 - w * w));
+		h[m] = sinc * w;
+		sum += h[m];
+	}
+
+	// every phase on its own has a gain of 1
+	for(uint32_t m=0; m<taps; ++m)
+		row[m] = (int32_t)lroundf(h[m] / sum * (1 << COEF_BITS));
+}
+
+static void make_table()
+{
+	for(uint32_t p=0; p<=RESAMPLE_PHASES; ++p)
+		make_phase(p, table + p * taps);
+}
+
+static void clear_history()
+{
+	pos = 0;
+	memset(hist_hi, 0, sizeof(hist_hi));
+	memset(hist_lo, 0, sizeof(hist_lo));
+}
+
+bool resample_start(uint32_t adc_hz, uint32_t new_out_hz, uint64_t adc_index)
+{
+	uint32_t n = resample_taps_for(adc_hz, new_out_hz);
+	if( n == 0 )
+		return false;
+
+	// about 20 ms of float math, only when the rate changes
+	if( adc_hz != in_hz || new_out_hz != out_hz )
+	{
+		in_hz = adc_hz;
+		out_hz = new_out_hz;
+		taps = n;
+		make_table();
+	}
+
+	// lane 0 in blend mode: PEEK1 is BASE0 (phase p) blended into BASE1 (phase p + 1) by the 8 bit fraction in
+	// ACCUM1, signed as lane 1 is
+	interp_config cfg = interp_default_config();
+	interp_config_set_blend(&cfg, true);
+	interp_config_set_signed(&cfg, true);
+	interp_set_config(interp0, 0, &cfg);
+	cfg = interp_default_config();
+	interp_config_set_signed(&cfg, true);
+	interp_set_config(interp0, 1, &cfg);
+
+	step_int = in_hz / out_hz;
+	step_rem = in_hz % out_hz;
+
+	// first output at or after adc_index, due once the half of the filter after it is in as well
+	next_index = (adc_index * out_hz + in_hz - 1) / in_hz;
+	uint64_t at = next_index * in_hz;
+	wait = (uint32_t)(at / out_hz - adc_index) + taps / 2;
+	frac_num = (uint32_t)(at % out_hz);
+
+	clear_history();
+	return true;
+}
+
+uint32_t resample_get_out_hz()
+{
+	return out_hz;
+}
+
+uint32_t resample_get_taps()
+{
+	return taps;
+}
+
+uint32_t resample_get_delay()
+{
+	return taps / 2;
+}
+
+uint64_t HOT_PATH(resample_next_index)()
+{
+	return next_index;
+}
+
+static inline void advance()
+{
+	wait = step_int - 1;
+	frac_num += step_rem;
+	if( frac_num >= out_hz )
+	{
+		frac_num -= out_hz;
+		++wait;
+	}
+	++next_index;
+}
+
+void HOT_PATH(resample_skip)(uint32_t adc_frames)
+{
+	clear_history();
+	while( adc_frames > wait )
+	{
+		adc_frames -= wait + 1;
+		advance();
+	}
+	wait -= adc_frames;
+}
+
+// sample = hi * 2^12 + lo, so sum(sample * c) / 2^18 = (sum(hi * c) + sum(lo * c) / 2^12) / 2^6.
+// A phase has a gain of 1 and sum(|c|) stays below 1.4 * 2^18, so |hi| < 2^11 and lo < 2^12 keep both sums below 2^31
+static inline int32_t finish(int32_t acc_hi, int32_t acc_lo)
+{
+	int32_t v = (acc_hi + (acc_lo >> SPLIT_BITS) + (1 << (COEF_BITS - SPLIT_BITS - 1))) >> (COEF_BITS - SPLIT_BITS);
+	if( v > 0x7fffff )
+		return 0x7fffff;
+	if( v < -0x800000 )
+		return -0x800000;
+	return v;
+}
+
+bool HOT_PATH(resample_push)(int32_t l, int32_t r, int32_t* out_l, int32_t* out_r)
+{
+	pos = (pos + 1 == taps) ? 0 : pos + 1;
+	hist_hi[0][pos] = hist_hi[0][pos + taps] = (int16_t)(l >> SPLIT_BITS);
+	hist_lo[0][pos] = hist_lo[0][pos + taps] = (uint16_t)(l & ((1 << SPLIT_BITS) - 1));
+	hist_hi[1][pos] = hist_hi[1][pos + taps] = (int16_t)(r >> SPLIT_BITS);
+	hist_lo[1][pos] = hist_lo[1][pos + taps] = (uint16_t)(r & ((1 << SPLIT_BITS) - 1));
+
+	if( wait )
+	{
+		--wait;
+		return false;
+	}
+
+	// 15 bit fraction, the top 6 bits pick the phase, the next 8 blend it with the one after
+	uint32_t frac = (frac_num << 15) / out_hz;
+	const int32_t* c0 = table + (frac >> 9) * taps;
+	const int32_t* c1 = c0 + taps;
+	interp0->accum[1] = (frac >> 1) & 0xff;
+
+	const int16_t*  lh = hist_hi[0] + pos + 1;
+	const uint16_t* ll = hist_lo[0] + pos + 1;
+	const int16_t*  rh = hist_hi[1] + pos + 1;
+	const uint16_t* rl = hist_lo[1] + pos + 1;
+	int32_t acc_lh = 0, acc_ll = 0, acc_rh = 0, acc_rl = 0;
+	for(uint32_t m=0; m<taps; ++m)
+	{
+		interp0->base[0] = (uint32_t)c0[m];
+		interp0->base[1] = (uint32_t)c1[m];
+		int32_t k = (int32_t)interp0->peek[1];
+		acc_lh += lh[m] * k;
+		acc_ll += ll[m] * k;
+		acc_rh += rh[m] * k;
+		acc_rl += rl[m] * k;
+	}
+
+	*out_l = finish(acc_lh, acc_ll);
+	*out_r = finish(acc_rh, acc_rl);
+	advance();
+	return true;
+}
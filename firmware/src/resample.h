@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _RESAMPLE_H
+#define _RESAMPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Decimation of the two ADC channels to a standard rate below the ADC rate, runs on core1 between PIO reads.
+//
+// Polyphase FIR with RESAMPLE_PHASES phases of a Kaiser windowed sinc. The output phase falls between two of them,
+// the interpolator of core1 (interp0 in blend mode) mixes the Q18 coefficients of both, and the MACs are done on
+// the high and the low 12 bits of a sample separately so everything stays in 32 bit multiplies.
+// host/resample_bench runs this file against a model of the interpolator and measures the filter.
+//
+// Output frame n is at ADC frame n * adc_hz / out_hz, so the output index follows from the ADC index alone,
+// frames lost at the PIO move it by the same amount as if they had been there. The filter is centered on that
+// frame, so the output is only due resample_get_delay() ADC frames later, anything that is not filtered has to be
+// held back by as much to line up with it.
+
+// standard rates that are offered if they are below the ADC rate, highest first
+#define RESAMPLE_RATES      { 96000, 48000, 44100 }
+#define RESAMPLE_RATE_COUNT 3
+
+#define RESAMPLE_PHASES     64
+#define RESAMPLE_MAX_TAPS   64
+
+// taps needed for the 80 dB stopband, 0 if out_hz can't be made from adc_hz
+uint32_t resample_taps_for(uint32_t adc_hz, uint32_t out_hz);
+
+// Sets up the filter and clears the history. Has to run on core1, it owns the interpolator.
+// adc_index is the index of the next ADC frame that will be pushed
+bool resample_start(uint32_t adc_hz, uint32_t out_hz, uint64_t adc_index);
+uint32_t resample_get_out_hz();
+uint32_t resample_get_taps();
+// ADC frames an output is due after the frame it is at, half the filter
+uint32_t resample_get_delay();
+
+// index of the next output frame
+uint64_t resample_next_index();
+
+// frames lost at the PIO, the history is cleared and the output index moves on
+void resample_skip(uint32_t adc_frames);
+
+// one ADC frame in (24 bit, sign extended), true if an output frame was due and is in out_l, out_r
+bool resample_push(int32_t l, int32_t r, int32_t* out_l, int32_t* out_r);
+
+#endif
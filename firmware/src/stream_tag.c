@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include <stddef.h>
+#include <string.h>
+#include "stream_tag.h"
+#include "hot_path.h"
+
+uint32_t HOT_PATH(stream_tag_checksum)(const stream_tag* tag)
+{
+	const uint8_t* p = (const uint8_t*)tag;
+	uint32_t h = 0x811c9dc5;
+	for(size_t i=0; i<offsetof(stream_tag, checksum); ++i)
+	{
+		h ^= p[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+void HOT_PATH(stream_tag_embed)(uint8_t* frames, stream_tag* tag)
+{
+	tag->magic = STREAM_TAG_MAGIC;
+	tag->version = STREAM_TAG_VERSION;
+	tag->size = sizeof(stream_tag);
+	tag->checksum = stream_tag_checksum(tag);
+	
+	const uint8_t* p = (const uint8_t*)tag;
+	for(size_t i=0; i<sizeof(stream_tag); ++i)
+		frames[i * STREAM_TAG_FRAME_BYTES + STREAM_TAG_BYTE_OFFSET] = p[i];
+}
+
+bool stream_tag_extract(const uint8_t* frames, stream_tag* tag)
+{
+	uint8_t* p = (uint8_t*)tag;
+	for(size_t i=0; i<sizeof(stream_tag); ++i)
+		p[i] = frames[i * STREAM_TAG_FRAME_BYTES + STREAM_TAG_BYTE_OFFSET];
+	
+	if( tag->magic != STREAM_TAG_MAGIC || tag->size != sizeof(stream_tag) )
+		return false;
+	return tag->checksum == stream_tag_checksum(tag);
+}
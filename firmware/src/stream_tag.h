@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _STREAM_TAG_H
+#define _STREAM_TAG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Every audio buffer carries one of these in the lowest byte of its head switch channel (ch2), one byte per frame.
+// The head switch levels become 0x7fffXX and 0x8000XX, so anything that only looks at the sign keeps working.
+// The host finds the tags by the magic and the checksum, see host/ for a parser.
+// This has no dependency on the pico sdk so the host tools can use it as well.
+
+#define STREAM_TAG_MAGIC   0x47545843 // "CXTG"
+#define STREAM_TAG_VERSION 3
+
+// frames were lost at the PIO right before or inside this buffer, the sample index of the following buffers includes them
+#define STREAM_TAG_FLAG_GAP   0x01
+// first buffer of an armed start, frame 0 is the first one after a head switch edge
+#define STREAM_TAG_FLAG_START 0x02
+// a rising edge on the sync input, sync_offset is the first frame with it high
+#define STREAM_TAG_FLAG_SYNC  0x04
+// a head switch edge, head_switch_offset says where. HIGH is the level after it
+#define STREAM_TAG_FLAG_HEAD_SWITCH      0x08
+#define STREAM_TAG_FLAG_HEAD_SWITCH_HIGH 0x10
+// the ADC delivered nothing for fill_frames frames of this buffer (lost sync or clock), they are all zero but the tag byte.
+// Unlike a gap they are in the stream, so it stays at the nominal rate
+#define STREAM_TAG_FLAG_FILL             0x20
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint8_t  version;
+	uint8_t  flags;
+	uint16_t size;
+	// counts every tagged buffer since boot, gaps mean lost buffers
+	uint32_t sequence;
+	// index of the first frame in this buffer, counted in frames of the stream rate since boot (see resample.h)
+	uint64_t sample_index;
+	// device timer (1 MHz) and USB frame number (SOF) when the first frame of this buffer was read from the PIO,
+	// pio_level is how many words were still queued in the PIO RX FIFO at that point (2 per frame)
+	uint32_t capture_time_us;
+	uint16_t capture_usb_frame;
+	uint8_t  pio_level;
+	// filled buffers waiting for USB when this one was started
+	uint8_t  fifo_level;
+	// same when core0 handed this buffer to the ISO endpoint
+	uint32_t send_time_us;
+	uint16_t send_usb_frame;
+	// frame in this buffer with STREAM_TAG_FLAG_SYNC, sample_index + sync_offset is the same moment on every device
+	uint16_t sync_offset;
+	// Where the head switch edge was, in 1/64 frames from the first frame of this buffer: sample_index + offset / 64.
+	// Slightly negative for an edge at the very end of the buffer before, that one was already sent when it came in
+	int16_t  head_switch_offset;
+	// frames with STREAM_TAG_FLAG_FILL
+	uint8_t  fill_frames;
+	// FNV-1a over everything above
+	uint32_t checksum;
+}
+stream_tag;
+
+// frame layout of the USB stream, 3 channels of 24 bit little endian
+#define STREAM_TAG_FRAME_BYTES  9
+#define STREAM_TAG_BYTE_OFFSET  6
+
+uint32_t stream_tag_checksum(const stream_tag* tag);
+
+// writes the tag into the low bytes of ch2, the rest of the frames stay as they are. frames must hold at least sizeof(stream_tag) frames
+void stream_tag_embed(uint8_t* frames, stream_tag* tag);
+
+// reads a tag starting at the first frame, returns false if the magic, size or checksum does not match
+bool stream_tag_extract(const uint8_t* frames, stream_tag* tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
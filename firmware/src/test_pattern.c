@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "test_pattern.h"
+#include "hot_path.h"
+
+#define SINE_PERIOD    256
+#define SINE_AMPLITUDE 0x600000
+
+static uint32_t HOT_PATH(hash32)(uint32_t x)
+{
+	// lowbias32, the M0+ multiplier makes this a handful of cycles
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+static int32_t HOT_PATH(sine)(uint32_t phase)
+{
+	// Bhaskara I approximation on a half period, exact integers so host and device agree bit for bit
+	const int32_t half = SINE_PERIOD / 2;
+	int32_t x = phase % SINE_PERIOD;
+	int32_t sign = 1;
+	if( x >= half )
+	{
+		x -= half;
+		sign = -1;
+	}
+	int64_t p = (int64_t)x * (half - x);
+	int64_t v = ((int64_t)16 * p * SINE_AMPLITUDE) / ((int64_t)5 * half * half - 4 * p);
+	return sign * (int32_t)v;
+}
+
+void HOT_PATH(test_pattern_frame)(test_pattern_kind kind, uint64_t index, uint32_t out[3])
+{
+	uint32_t i = (uint32_t)index;
+	switch( kind )
+	{
+	case test_pattern_counter:
+		out[0] = i;
+		out[1] = ~i;
+		break;
+	case test_pattern_noise:
+		out[0] = hash32(i * 2);
+		out[1] = hash32(i * 2 + 1);
+		break;
+	case test_pattern_sine:
+	default:
+		out[0] = (uint32_t)sine(i);
+		out[1] = (uint32_t)sine(i * 3);
+		break;
+	}
+	
+	out[0] &= 0xffffff;
+	out[1] &= 0xffffff;
+	out[2] = ((index / TEST_PATTERN_FIELD_FRAMES) & 1) ? 0x7fff00 : 0x800000;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _TEST_PATTERN_H
+#define _TEST_PATTERN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Synthetic frames for soak testing without a PCM1802, in place of the ADC when selected as the source.
+// Every value only depends on the frame index, so the host (host/pattern_verify) can check any frame
+// against the sample index in its stream tag. Integer math only, the host computes the exact same values.
+// This has no dependency on the pico sdk.
+
+typedef enum
+{
+	// ch0 counts up, ch1 counts down
+	test_pattern_counter,
+	// ch0 and ch1 are a hash of the index, full scale white noise
+	test_pattern_noise,
+	// ch0 a sine with a period of 256 frames, ch1 one with 256/3
+	test_pattern_sine,
+	test_pattern_count,
+}
+test_pattern_kind;
+
+// a fake head switch on ch2, 60 fields per second at 78125 Hz. The low byte is 0, it carries the stream tag
+#define TEST_PATTERN_FIELD_FRAMES 1302
+
+// 24 bit values, in the low bits
+void test_pattern_frame(test_pattern_kind kind, uint64_t index, uint32_t out[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -67,7 +67,7 @@ extern "C" {
 #define CFG_TUD_HID               0
 #define CFG_TUD_MIDI              0
 #define CFG_TUD_AUDIO             1
-#define CFG_TUD_VENDOR            0
+#define CFG_TUD_VENDOR            1
 
 //--------------------------------------------------------------------
 // AUDIO CLASS DRIVER CONFIGURATION
@@ -88,6 +88,15 @@ extern "C" {
 #define CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ                          CFG_TUD_AUDIO_EP_SZ_IN
 #define CFG_TUD_AUDIO_ENABLE_TYPE_I_ENCODING                          1
 
+//--------------------------------------------------------------------
+// VENDOR CLASS DRIVER CONFIGURATION
+//--------------------------------------------------------------------
+
+// Compressed PCM stream, see usb_vendor.h. The TX buffer holds a few worst case blocks
+#define CFG_TUD_VENDOR_EPSIZE                                         64
+#define CFG_TUD_VENDOR_RX_BUFSIZE                                     64
+#define CFG_TUD_VENDOR_TX_BUFSIZE                                     4096
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,16 +5,90 @@
 
 #include "usb_audio_format.h"
 #include "usb_audio.h"
+#include "usb_vendor.h"
 #include "usb_descriptors.h"
 #include "tusb.h"
 #include "fifo.h"
 #include "clock_gen.h"
 #include "dbg.h"
+#include "global_status.h"
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hot_path.h"
+#include "hardware/structs/usb.h"
+
+// time of the first USB IRQ since the last tud_task() started, that one runs the callbacks for it
+static volatile uint32_t usb_irq_time = 0;
+static volatile bool     usb_irq_pending = false;
+// the one the running tud_task() is handling
+static uint32_t service_irq_time = 0;
+static bool     service_irq_pending = false;
+
+static void HOT_PATH(usb_irq_timestamp)()
+{
+	if( !usb_irq_pending )
+	{
+		usb_irq_time = time_us_32();
+		usb_irq_pending = true;
+	}
+}
+
+void usb_audio_init()
+{
+	// tinyusb registers its own handler as a shared one too, with the highest order we run before it
+	irq_add_shared_handler(USBCTRL_IRQ, usb_irq_timestamp, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+}
+
+void HOT_PATH(usb_audio_service_begin)()
+{
+	uint32_t irq = save_and_disable_interrupts();
+	service_irq_time = usb_irq_time;
+	service_irq_pending = usb_irq_pending;
+	usb_irq_pending = false;
+	restore_interrupts(irq);
+}
+
+static void HOT_PATH(measure_iso_latency)()
+{
+	// an event tud_task() picked up from an IRQ that came in while it was running is measured from that one
+	uint32_t since;
+	if( service_irq_pending )
+		since = service_irq_time;
+	else if( usb_irq_pending )
+		since = usb_irq_time;
+	else
+		return;
+	
+	uint32_t latency = time_us_32() - since;
+	global_status_access(
+	{
+		global_status.main0_iso_latency_us = latency;
+		if( latency > global_status.main0_iso_latency_max_us )
+			global_status.main0_iso_latency_max_us = latency;
+	});
+}
 
 //--------------------------------------------------------------------+
 // Application Callback API Implementations
 //--------------------------------------------------------------------+
 
+// Mute (debug) and the source selector both end up in the fifo mode, debug wins
+static bool    debug_enabled = false;
+// 0 is the ADC, then the test patterns in the order of test_pattern_kind
+static uint8_t source = 0;
+
+static void apply_mode()
+{
+	if( source != 0 )
+		fifo_set_test_pattern((test_pattern_kind)(source - 1));
+	
+	if( debug_enabled )
+		fifo_set_mode(fifo_mode_debug);
+	else
+		fifo_set_mode((source != 0) ? fifo_mode_pattern : fifo_mode_normal);
+}
+
 // Invoked when audio class specific set request received for an EP
 bool tud_audio_set_req_ep_cb(uint8_t rhport, tusb_control_request_t const * p_request, uint8_t *pBuff)
 {
@@ -84,8 +158,8 @@ bool tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *
 			TU_VERIFY(p_request->wLength == sizeof(audio_control_cur_4_t));
 
 			uint32_t sample_rate = (uint32_t) ((audio_control_cur_4_t*) pBuff)->bCur;
-			clock_gen_set_adc_sample_rate(sample_rate);
-			return true;
+			// anything not in the RANGE list is stalled
+			return clock_gen_set_adc_sample_rate(sample_rate);
 		}
 	}
 	
@@ -94,11 +168,47 @@ bool tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *
 		if( ctrlSel == AUDIO_FU_CTRL_MUTE )
 		{
 			uint8_t value = (uint8_t) ((audio_control_cur_1_t*) pBuff)->bCur;
-			fifo_set_mode((value == 1) ? fifo_mode_debug : fifo_mode_normal);
+			debug_enabled = (value == 1);
+			apply_mode();
+			return true;
+		}
+	}
+
+	if ( entityID == USB_DESCRIPTORS_ID_SELECT_SOURCE )
+	{
+		if( ctrlSel == AUDIO_SU_CTRL_SELECTOR )
+		{
+			// selector inputs are 1 based, the first one is the ADC
+			uint8_t value = (uint8_t) ((audio_control_cur_1_t*) pBuff)->bCur;
+			TU_VERIFY(value >= 1 && value <= 1 + test_pattern_count);
+			source = value - 1;
+			apply_mode();
+			return true;
+		}
+	}
+
+	if ( entityID == USB_DESCRIPTORS_ID_FEATURE_START )
+	{
+		if( ctrlSel == AUDIO_FU_CTRL_MUTE )
+		{
+			// ALSA shows mute inverted as a switch, so "on" (not muted) arms the start
+			uint8_t value = (uint8_t) ((audio_control_cur_1_t*) pBuff)->bCur;
+			fifo_set_armed_start(value == 0);
 			return true;
 		}
 	}
 
+	if ( entityID == USB_DESCRIPTORS_ID_SELECT_CLK0 || entityID == USB_DESCRIPTORS_ID_SELECT_CLK1 )
+	{
+		if( ctrlSel == AUDIO_SU_CTRL_SELECTOR )
+		{
+			// selector inputs are 1 based
+			uint8_t value = (uint8_t) ((audio_control_cur_1_t*) pBuff)->bCur;
+			TU_VERIFY(value >= 1 && value <= CLOCK_GEN_CXADC_CLOCK_COUNT);
+			return clock_gen_set_output(entityID - USB_DESCRIPTORS_ID_SELECT_CLK0, value - 1);
+		}
+	}
+
 	// Unknown/Unsupported control
 	TU_BREAKPOINT();
 	return false; // Not implemented
@@ -163,7 +273,7 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *
 			if( p_request->bRequest == AUDIO_CS_REQ_CUR )
 			{
 				dbg_say("freq\n");
-				uint32_t sampFreq = clock_gen_get_adc_sample_rate();
+				uint32_t sampFreq = clock_gen_get_stream_sample_rate();
 				return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &sampFreq, sizeof(sampFreq));
 			}
 			if( p_request->bRequest == AUDIO_CS_REQ_RANGE )
@@ -205,6 +315,42 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *
 		}
 	}
 
+	if ( entityID == USB_DESCRIPTORS_ID_FEATURE_START )
+	{
+		if( ctrlSel == AUDIO_FU_CTRL_MUTE )
+		{
+			uint8_t current = fifo_get_armed_start() ? 0 : 1;
+			dbg_say("armed start ");
+			dbg_u8(current);
+			dbg_say("\n");
+			return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &current, sizeof(current));
+		}
+	}
+
+	if ( entityID == USB_DESCRIPTORS_ID_SELECT_SOURCE )
+	{
+		if( ctrlSel == AUDIO_SU_CTRL_SELECTOR )
+		{
+			uint8_t current = source + 1;
+			dbg_say("source ");
+			dbg_u8(current);
+			dbg_say("\n");
+			return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &current, sizeof(current));
+		}
+	}
+
+	if ( entityID == USB_DESCRIPTORS_ID_SELECT_CLK0 || entityID == USB_DESCRIPTORS_ID_SELECT_CLK1 )
+	{
+		if( ctrlSel == AUDIO_SU_CTRL_SELECTOR )
+		{
+			uint8_t current = clock_gen_get_output(entityID - USB_DESCRIPTORS_ID_SELECT_CLK0) + 1;
+			dbg_say("clock select ");
+			dbg_u8(current);
+			dbg_say("\n");
+			return tud_audio_buffer_and_schedule_control_xfer(rhport, p_request, &current, sizeof(current));
+		}
+	}
+
 	dbg_say("???\n");
 	TU_BREAKPOINT();
 	return false; // Not implemented
@@ -213,7 +359,27 @@ bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *
 static uint16_t off = 0;
 static usb_audio_buffer* audio_buffer = NULL;
 
-static void next_buffer()
+usb_audio_buffer* HOT_PATH(usb_audio_take_for_send)()
+{
+	usb_audio_buffer* ret = fifo_try_take_filled();
+	// anything captured before the armed start edge, or at a rate the host no longer asks for
+	while( ret != NULL && (ret->generation != fifo_get_stream_generation() || ret->rate != clock_gen_get_stream_sample_rate()) )
+	{
+		fifo_put_empty(ret);
+		ret = fifo_try_take_filled();
+	}
+	
+	if( ret != NULL && ret->tagged )
+	{
+		// the rest of the tag was filled in by core1 while capturing
+		ret->tag.send_time_us = time_us_32();
+		ret->tag.send_usb_frame = usb_hw->sof_rd & USB_SOF_RD_BITS;
+		stream_tag_embed(ret->data, &(ret->tag));
+	}
+	return ret;
+}
+
+static void HOT_PATH(next_buffer)()
 {
 	if( audio_buffer != NULL)
 	{
@@ -225,11 +391,13 @@ static void next_buffer()
 	
 	off = 0;
 	
-	audio_buffer = fifo_try_take_filled();
+	// the compressed stream on the vendor interface takes the buffers instead
+	audio_buffer = usb_vendor_streaming() ? NULL : usb_audio_take_for_send();
 }
 
-bool tud_audio_tx_done_pre_load_cb(uint8_t rhport, uint8_t func_id, uint8_t ep_in, uint8_t cur_alt_setting)
+bool HOT_PATH(tud_audio_tx_done_pre_load_cb)(uint8_t rhport, uint8_t func_id, uint8_t ep_in, uint8_t cur_alt_setting)
 {
+	measure_iso_latency();
 	next_buffer();
 	
 	if(audio_buffer == NULL)
@@ -243,18 +411,42 @@ bool tud_audio_tx_done_pre_load_cb(uint8_t rhport, uint8_t func_id, uint8_t ep_i
 	return true;
 }
 
-bool tud_audio_tx_done_post_load_cb(uint8_t rhport, uint16_t n_bytes_copied, uint8_t func_id, uint8_t ep_in, uint8_t cur_alt_setting)
+bool HOT_PATH(tud_audio_tx_done_post_load_cb)(uint8_t rhport, uint16_t n_bytes_copied, uint8_t func_id, uint8_t ep_in, uint8_t cur_alt_setting)
 {
 	off += n_bytes_copied;
 	next_buffer();
 	return true;
 }
 
+bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const * p_request)
+{
+	(void) rhport;
+	
+	uint8_t alt = TU_U16_LOW(p_request->wValue);
+	dbg_say("set_itf ");
+	dbg_u8(alt);
+	dbg_say("\n");
+	
+	// alternate 1 is the one with the endpoint, the stream starts with the pre-roll
+	if( alt != 0 )
+		fifo_set_streaming(true, clock_gen_get_stream_sample_rate());
+	return true;
+}
+
 bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const * p_request)
 {
 	(void) rhport;
 	(void) p_request;
 
 	dbg_say("close_EP\n");
+	
+	// whatever was left of the last stream is stale by the time the next one opens
+	fifo_set_streaming(false, 0);
+	if( audio_buffer != NULL )
+	{
+		fifo_put_empty(audio_buffer);
+		audio_buffer = NULL;
+	}
+	off = 0;
 	return true;
 }
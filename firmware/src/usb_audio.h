@@ -5,4 +5,15 @@
 #ifndef _USB_AUDIO_H
 #define _USB_AUDIO_H
 
+#include "usb_audio_format.h"
+
+// Hooks the USB IRQ to measure the latency until the ISO callbacks run, call after tusb_init()
+void usb_audio_init();
+// Call right before each tud_task(), it handles the events of the IRQs up to here. One that comes in while it runs
+// is timestamped for the next one
+void usb_audio_service_begin();
+
+// Next filled buffer to send, with its stream tag finished and embedded. NULL if there is none, give it back with fifo_put_empty()
+usb_audio_buffer* usb_audio_take_for_send();
+
 #endif
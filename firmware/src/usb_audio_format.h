@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include "stream_tag.h"
 
 // NOTE this buffer size is slightly larger than 1 ms (46 or 48 samples), but less than 2 ms
 //   This MUST be aligned with the isochornous polling rate in the USB desccriptor, which should be set to 1 ms.
@@ -19,8 +20,17 @@
 typedef struct
 {
 	uint8_t data[USB_AUDIO_PAYLOAD_SIZE];
+	// filled in by core1, finished and written into data by core0 right before sending
+	stream_tag tag;
+	bool       tagged;
+	// see fifo_get_stream_generation()
+	uint32_t   generation;
+	// sample rate the buffer was filled at, see clock_gen_get_stream_sample_rate()
+	uint32_t   rate;
 } usb_audio_buffer;
 
+static_assert(sizeof(stream_tag) <= USB_AUDIO_SAMPLES_PER_BUFFER, "stream tag does not fit into one buffer");
+
 #define USB_AUDIO_PCM24_MAX  0x007fffff
 #define USB_AUDIO_PCM24_MIN  0x00800000
 #define USB_AUDIO_PCM24_MASK 0x00ffffff
@@ -68,9 +68,29 @@ char const* string_desc_arr [] =
 	"CXADC-Clock 0 Out",
 	#define STRD_IDX_OUT_1          14
 	"CXADC-Clock 1 Out",
+	
+	#define STRD_IDX_FEATURE_START  15
+	"Head Switch Start",
+	
+	#define STRD_IDX_VENDOR         16
+	"Compressed PCM",
+	
+	#define STRD_IDX_INPUT_COUNTER  17
+	"Test Counter",
+	#define STRD_IDX_INPUT_NOISE    18
+	"Test Noise",
+	#define STRD_IDX_INPUT_SINE     19
+	"Test Sine",
+	#define STRD_IDX_SELECT_SOURCE  20
+	"Source",
+
+	// on the streaming interface, so the host can read the build from sysfs (<dev>:1.1/interface)
+	#define STRD_IDX_GIT_SHA        21
+	NFO_GIT_SHA,
 };
 
-#define STRING_DESCRIPTOR_BUFFER 32
+// the git sha is 40 characters
+#define STRING_DESCRIPTOR_BUFFER 48
 static uint16_t _desc_str[STRING_DESCRIPTOR_BUFFER];
 
 // Invoked when received GET STRING DESCRIPTOR request
@@ -171,10 +191,13 @@ uint8_t const * tud_descriptor_device_cb(void)
 	#define EPNUM_AUDIO   0x01
 #endif
 
+#define EPNUM_VENDOR  0x02
+
 enum
 {
 	ITF_NUM_AUDIO_CONTROL = 0,
 	ITF_NUM_AUDIO_STREAMING,
+	ITF_NUM_VENDOR,
 	ITF_NUM_TOTAL
 };
 
@@ -185,7 +208,7 @@ enum
 uint8_t const desc_configuration[] =
 {
 	// Interface count, string index, total length, attribute, power in mA
-	TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, (TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_DESC_TOTAL_LEN), 0x00, 100),
+	TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, (TUD_CONFIG_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_DESC_TOTAL_LEN + CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN), 0x00, 100),
 	
 	/* Standard Interface Association Descriptor (IAD) */\
 	TUD_AUDIO_DESC_IAD(/*_firstitfs*/ ITF_NUM_AUDIO_CONTROL, /*_nitfs*/ 0x02, /*_stridx*/ STRD_IDX_VERSION),\
@@ -198,20 +221,33 @@ uint8_t const desc_configuration[] =
 			TUD_AUDIO_DESC_CLK_SRC(/*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_attr*/ AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK, /*_ctrl*/ (AUDIO_CTRL_RW << AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS | AUDIO_CTRL_R << AUDIO_CLOCK_SOURCE_CTRL_CLK_VAL_POS), /*_assocTerm*/ 0,  /*_stridx*/ 0x00),\
 			/* Input Terminal Descriptor(4.7.2.4) */\
 			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_PCM1802, /*_termtype*/ AUDIO_TERM_TYPE_IN_EXTERNAL_LINE, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_PCM1802),\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_COUNTER, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_COUNTER),\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_NOISE, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_NOISE),\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_SINE, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_SINE),\
+			TUD_AUDIO_DESC_SELECTOR_UNIT_4(/*_bUnitID*/ USB_DESCRIPTORS_ID_SELECT_SOURCE, /*_baSourceID1*/ USB_DESCRIPTORS_ID_INPUT_PCM1802, /*_baSourceID2*/ USB_DESCRIPTORS_ID_INPUT_COUNTER, /*_baSourceID3*/ USB_DESCRIPTORS_ID_INPUT_NOISE, /*_baSourceID4*/ USB_DESCRIPTORS_ID_INPUT_SINE, /*_bmControls*/ AUDIO_CTRL_RW, /*_iSelector*/ STRD_IDX_SELECT_SOURCE),\
 			/* Feature Unit Descriptor (4.7.2.8)*/ \
-			TUD_AUDIO_DESC_FEATURE_UNIT_THREE_CHANNEL(/*_unitid*/ USB_DESCRIPTORS_ID_FEATURE_AUDIO, /*_srcid*/ USB_DESCRIPTORS_ID_INPUT_PCM1802, /*_ctrlch0master*/ (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS), /*_ctrlch1*/ 0, /*_ctrlch2*/ 0, /*_ctrlch3*/ 0, /*_stridx*/ STRD_IDX_FEATURE_ADUIO), \
+			TUD_AUDIO_DESC_FEATURE_UNIT_THREE_CHANNEL(/*_unitid*/ USB_DESCRIPTORS_ID_FEATURE_AUDIO, /*_srcid*/ USB_DESCRIPTORS_ID_SELECT_SOURCE, /*_ctrlch0master*/ (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS), /*_ctrlch1*/ 0, /*_ctrlch2*/ 0, /*_ctrlch3*/ 0, /*_stridx*/ STRD_IDX_FEATURE_ADUIO), \
+			TUD_AUDIO_DESC_FEATURE_UNIT_THREE_CHANNEL(/*_unitid*/ USB_DESCRIPTORS_ID_FEATURE_START, /*_srcid*/ USB_DESCRIPTORS_ID_FEATURE_AUDIO, /*_ctrlch0master*/ (AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS), /*_ctrlch1*/ 0, /*_ctrlch2*/ 0, /*_ctrlch3*/ 0, /*_stridx*/ STRD_IDX_FEATURE_START), \
 			/* Output Terminal Descriptor(4.7.2.5) */\
-			TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_OUTPUT, /*_termtype*/ AUDIO_TERM_TYPE_USB_STREAMING, /*_assocTerm*/ 0, /*_srcid*/ USB_DESCRIPTORS_ID_FEATURE_AUDIO, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_ctrl*/ 0x0000, /*_stridx*/ 0x00),\
+			TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_OUTPUT, /*_termtype*/ AUDIO_TERM_TYPE_USB_STREAMING, /*_assocTerm*/ 0, /*_srcid*/ USB_DESCRIPTORS_ID_FEATURE_START, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_ctrl*/ 0x0000, /*_stridx*/ 0x00),\
 			\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_20, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ 1, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_20),\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_28, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ 1, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_28),\
 			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_40, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ 1, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_40),\
+			TUD_AUDIO_DESC_INPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_INPUT_50, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_nchannelslogical*/ 1, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_idxchannelnames*/ 0x00, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_INPUT_50),\
+			/* Selector Unit Descriptor(4.7.2.7), the CXADC clock outputs */\
+			TUD_AUDIO_DESC_SELECTOR_UNIT_4(/*_bUnitID*/ USB_DESCRIPTORS_ID_SELECT_CLK0, /*_baSourceID1*/ USB_DESCRIPTORS_ID_INPUT_20, /*_baSourceID2*/ USB_DESCRIPTORS_ID_INPUT_28, /*_baSourceID3*/ USB_DESCRIPTORS_ID_INPUT_40, /*_baSourceID4*/ USB_DESCRIPTORS_ID_INPUT_50, /*_bmControls*/ AUDIO_CTRL_RW, /*_iSelector*/ STRD_IDX_SELECT_0),\
+			TUD_AUDIO_DESC_SELECTOR_UNIT_4(/*_bUnitID*/ USB_DESCRIPTORS_ID_SELECT_CLK1, /*_baSourceID1*/ USB_DESCRIPTORS_ID_INPUT_20, /*_baSourceID2*/ USB_DESCRIPTORS_ID_INPUT_28, /*_baSourceID3*/ USB_DESCRIPTORS_ID_INPUT_40, /*_baSourceID4*/ USB_DESCRIPTORS_ID_INPUT_50, /*_bmControls*/ AUDIO_CTRL_RW, /*_iSelector*/ STRD_IDX_SELECT_1),\
+			TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_OUTPUT_CLK0, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_srcid*/ USB_DESCRIPTORS_ID_SELECT_CLK0, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_OUT_0),\
+			TUD_AUDIO_DESC_OUTPUT_TERM(/*_termid*/ USB_DESCRIPTORS_ID_OUTPUT_CLK1, /*_termtype*/ AUDIO_TERM_TYPE_IO_EMBEDDED_UNDEFINED, /*_assocTerm*/ 0, /*_srcid*/ USB_DESCRIPTORS_ID_SELECT_CLK1, /*_clkid*/ USB_DESCRIPTORS_ID_CLOCK, /*_ctrl*/ 0x0000, /*_stridx*/ STRD_IDX_OUT_1),\
 			
 	
 		/* Standard AS Interface Descriptor(4.9.1) */\
 		/* Interface 1, Alternate 0 - default alternate setting with 0 bandwidth */\
-		TUD_AUDIO_DESC_STD_AS_INT(/*_itfnum*/ ITF_NUM_AUDIO_STREAMING, /*_altset*/ 0x00, /*_nEPs*/ 0x00, /*_stridx*/ 0x00),\
+		TUD_AUDIO_DESC_STD_AS_INT(/*_itfnum*/ ITF_NUM_AUDIO_STREAMING, /*_altset*/ 0x00, /*_nEPs*/ 0x00, /*_stridx*/ STRD_IDX_GIT_SHA),\
 		/* Standard AS Interface Descriptor(4.9.1) */\
 		/* Interface 1, Alternate 1 - alternate interface for data streaming */\
-		TUD_AUDIO_DESC_STD_AS_INT(/*_itfnum*/ ITF_NUM_AUDIO_STREAMING, /*_altset*/ 0x01, /*_nEPs*/ 0x01, /*_stridx*/ 0x00),\
+		TUD_AUDIO_DESC_STD_AS_INT(/*_itfnum*/ ITF_NUM_AUDIO_STREAMING, /*_altset*/ 0x01, /*_nEPs*/ 0x01, /*_stridx*/ STRD_IDX_GIT_SHA),\
 	
 			/* Class-Specific AS Interface Descriptor(4.9.2) */\
 			TUD_AUDIO_DESC_CS_AS_INT(/*_termid*/ USB_DESCRIPTORS_ID_OUTPUT, /*_ctrl*/ AUDIO_CTRL_NONE, /*_formattype*/ AUDIO_FORMAT_TYPE_I, /*_formats*/ AUDIO_DATA_FORMAT_TYPE_I_PCM, /*_nchannelsphysical*/ CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX, /*_channelcfg*/ AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, /*_stridx*/ 0x00),\
@@ -222,7 +258,10 @@ uint8_t const desc_configuration[] =
 			/* Standard AS Isochronous Audio Data Endpoint Descriptor(4.10.1.1) */\
 			TUD_AUDIO_DESC_STD_AS_ISO_EP(/*_ep*/ (0x80 | EPNUM_AUDIO), /*_attr*/ (TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA), /*_maxEPsize*/ CFG_TUD_AUDIO_EP_SZ_IN, /*_interval*/ (CFG_TUSB_RHPORT0_MODE & OPT_MODE_HIGH_SPEED) ? 0x08 : 0x01),\
 				/* Class-Specific AS Isochronous Audio Data Endpoint Descriptor(4.10.1.2) */\
-				TUD_AUDIO_DESC_CS_AS_ISO_EP(/*_attr*/ AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, /*_ctrl*/ AUDIO_CTRL_NONE, /*_lockdelayunit*/ AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, /*_lockdelay*/ 0x0000)
+				TUD_AUDIO_DESC_CS_AS_ISO_EP(/*_attr*/ AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, /*_ctrl*/ AUDIO_CTRL_NONE, /*_lockdelayunit*/ AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, /*_lockdelay*/ 0x0000),
+	
+	/* Compressed PCM stream, bulk in, see usb_vendor.h */
+	TUD_VENDOR_DESCRIPTOR(/*_itfnum*/ ITF_NUM_VENDOR, /*_stridx*/ STRD_IDX_VENDOR, /*_epout*/ EPNUM_VENDOR, /*_epin*/ (0x80 | EPNUM_VENDOR), /*_epsize*/ CFG_TUD_VENDOR_EPSIZE)
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -14,9 +14,25 @@
 #define USB_DESCRIPTORS_ID_OUTPUT        0x04
 // Clock Source units
 #define USB_DESCRIPTORS_ID_CLOCK         0x05
+// The switch to start the stream on a head switch edge, sits between the audio feature unit and the output terminal
+#define USB_DESCRIPTORS_ID_FEATURE_START 0x06
+// Picks the ADC or one of the test patterns, sits between the inputs and the audio feature unit
+#define USB_DESCRIPTORS_ID_SELECT_SOURCE 0x07
 
-// Fake signal path units
+// Fake signal path units, one input per CXADC clock option, in the order of CLOCK_GEN_CXADC_CLOCK_*
+#define USB_DESCRIPTORS_ID_INPUT_20      0x10
+#define USB_DESCRIPTORS_ID_INPUT_28      0x11
 #define USB_DESCRIPTORS_ID_INPUT_40      0x12
+#define USB_DESCRIPTORS_ID_INPUT_50      0x13
+
+// Test pattern sources, in the order of test_pattern_kind
+#define USB_DESCRIPTORS_ID_INPUT_COUNTER 0x14
+#define USB_DESCRIPTORS_ID_INPUT_NOISE   0x15
+#define USB_DESCRIPTORS_ID_INPUT_SINE    0x16
+
+// ALSA shows these as enum controls, the selected input is the clock on that output
+#define USB_DESCRIPTORS_ID_SELECT_CLK0   0x20
+#define USB_DESCRIPTORS_ID_SELECT_CLK1   0x21
 
 #define USB_DESCRIPTORS_ID_OUTPUT_CLK0   0x30
 #define USB_DESCRIPTORS_ID_OUTPUT_CLK1   0x31
@@ -53,10 +69,15 @@ void usb_descriptor_set_serial(const char* serial);
 #define TUD_AUDIO_DESC_CS_AC_LEN_TOTAL ( \
 	TUD_AUDIO_DESC_CLK_SRC_LEN \
 	+ TUD_AUDIO_DESC_INPUT_TERM_LEN \
+	+ 3 * TUD_AUDIO_DESC_INPUT_TERM_LEN \
+	+ TUD_AUDIO_DESC_SELECTOR_UNIT_4_LEN \
+	+ TUD_AUDIO_DESC_FEATURE_UNIT_THREE_CHANNEL_LEN \
 	+ TUD_AUDIO_DESC_FEATURE_UNIT_THREE_CHANNEL_LEN \
 	+ TUD_AUDIO_DESC_OUTPUT_TERM_LEN \
 	\
-	+ TUD_AUDIO_DESC_INPUT_TERM_LEN \
+	+ 4 * TUD_AUDIO_DESC_INPUT_TERM_LEN \
+	+ 2 * TUD_AUDIO_DESC_SELECTOR_UNIT_4_LEN \
+	+ 2 * TUD_AUDIO_DESC_OUTPUT_TERM_LEN \
 	)
 
 #define TUD_AUDIO_DESC_TOTAL_LEN ( \
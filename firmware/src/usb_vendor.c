@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "usb_vendor.h"
+#include "usb_audio.h"
+#include "usb_descriptors.h"
+#include "tusb.h"
+#include "fifo.h"
+#include "clock_gen.h"
+#include "pcm_codec.h"
+#include "global_status.h"
+#include "dbg.h"
+#include "pico/stdlib.h"
+#include "hot_path.h"
+
+#define BLOCK_MAX PCM_CODEC_MAX_BLOCK_BYTES(USB_AUDIO_SAMPLES_PER_BUFFER, USB_AUDIO_CHANNELS)
+
+static volatile bool streaming = false;
+static uint8_t block[BLOCK_MAX];
+
+bool HOT_PATH(usb_vendor_streaming)()
+{
+	return streaming;
+}
+
+static void set_streaming(bool on)
+{
+	dbg_say("vendor stream ");
+	dbg_u8(on);
+	dbg_say("\n");
+	
+	if( on == streaming )
+		return;
+	
+	streaming = on;
+	fifo_set_streaming(on, clock_gen_get_stream_sample_rate());
+}
+
+void HOT_PATH(usb_vendor_service)()
+{
+	if( !streaming )
+		return;
+	
+	// bytes in and out for the ratio, and the slowest block, published together below
+	uint32_t bytes_in = 0, bytes_out = 0, encode_max = 0;
+	
+	// only take a buffer if the worst case fits, otherwise it stays in the fifo and the overload policy applies
+	while( tud_vendor_mounted() && tud_vendor_write_available() >= BLOCK_MAX )
+	{
+		usb_audio_buffer* buffer = usb_audio_take_for_send();
+		if( buffer == NULL )
+			break;
+		
+		uint32_t t = time_us_32();
+		size_t n = pcm_codec_encode(buffer->data, USB_AUDIO_SAMPLES_PER_BUFFER, USB_AUDIO_CHANNELS, block);
+		t = time_us_32() - t;
+		fifo_put_empty(buffer);
+		
+		tud_vendor_write(block, n);
+		bytes_in += USB_AUDIO_PAYLOAD_SIZE;
+		bytes_out += n;
+		if( t > encode_max )
+			encode_max = t;
+	}
+	
+	if( bytes_in == 0 )
+		return;
+	
+	tud_vendor_write_flush();
+	global_status_access(
+	{
+		global_status.vendor_bytes_in += bytes_in;
+		global_status.vendor_bytes_out += bytes_out;
+		if( encode_max > global_status.vendor_encode_max_us )
+			global_status.vendor_encode_max_us = encode_max;
+	});
+}
+
+// Invoked for vendor type control requests
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request)
+{
+	if( stage != CONTROL_STAGE_SETUP )
+		return true;
+	
+	if( request->bRequest == USB_VENDOR_REQ_STREAM )
+	{
+		set_streaming(request->wValue != 0);
+		return tud_control_status(rhport, request);
+	}
+	
+	return false;
+}
+
+// Invoked when the configuration goes away, the host can't stop the stream anymore
+void usb_vendor_reset()
+{
+	set_streaming(false);
+}
@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _USB_VENDOR_H
+#define _USB_VENDOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compressed stream on the vendor interface, see pcm_codec.h and host/pcm_stream.
+// The host starts and stops it with a vendor control request to the interface, while it runs the ISO endpoint only sends empty packets.
+#define USB_VENDOR_REQ_STREAM 0x01 // wValue 1 starts, 0 stops
+
+bool usb_vendor_streaming();
+// Compresses and queues whatever core1 filled, call from the core0 main loop
+void usb_vendor_service();
+// Stops the stream, for unmount
+void usb_vendor_reset();
+
+#endif
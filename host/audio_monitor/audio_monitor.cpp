@@ -0,0 +1,365 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "audio_monitor.h"
+#include "resampler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+// about 5 ms of input per round, small enough to not add latency
+#define CHUNK_MS 5
+
+bool audio_monitor::parse(const std::string& spec, config& cfg, std::string& err)
+{
+	size_t comma = spec.find(',');
+	cfg.sink = spec.substr(0, comma);
+	while( comma != std::string::npos )
+	{
+		size_t next = spec.find(',', comma + 1);
+		std::string opt = spec.substr(comma + 1, next == std::string::npos ? std::string::npos : next - comma - 1);
+		if( opt.rfind("ch=", 0) == 0 )
+		{
+			cfg.channels.clear();
+			std::string list = opt.substr(3);
+			size_t pos = 0;
+			while( pos < list.size() )
+			{
+				size_t plus = list.find('+', pos);
+				cfg.channels.push_back(atoi(list.substr(pos, plus - pos).c_str()));
+				if( plus == std::string::npos )
+					break;
+				pos = plus + 1;
+			}
+		}
+		else if( opt.rfind("rate=", 0) == 0 )
+			cfg.out_rate = atoi(opt.c_str() + 5);
+		else if( opt.rfind("in=", 0) == 0 )
+			cfg.in_rate = atoi(opt.c_str() + 3);
+		else if( opt.rfind("latency=", 0) == 0 )
+			cfg.latency_ms = atoi(opt.c_str() + 8);
+		else
+		{
+			err = "unknown monitor option '" + opt + "'";
+			return false;
+		}
+		comma = next;
+	}
+
+	if( cfg.sink.empty() )
+		err = "monitor needs a sink";
+	else if( cfg.channels.empty() || cfg.channels.size() > 8 )
+		err = "monitor needs 1 to 8 channels";
+	else if( *std::max_element(cfg.channels.begin(), cfg.channels.end()) >= cfg.in_channels )
+		err = "monitor channel out of range";
+	else if( cfg.in_rate == 0 || cfg.out_rate == 0 || cfg.latency_ms == 0 )
+		err = "monitor rates and latency must not be 0";
+#ifndef HAVE_ALSA
+	else if( cfg.sink.rfind("alsa:", 0) == 0 )
+		err = "built without ALSA, play a FIFO with aplay or pacat instead";
+#endif
+	return err.empty();
+}
+
+const char* audio_monitor::help()
+{
+	return
+		"  monitor SINK is alsa:DEVICE or a file or FIFO for raw S16_LE (- for stdout), options:\n"
+		"    ,ch=A+B+...   channels to play (default 0+1)\n"
+		"    ,rate=N       output rate (default 48000)\n"
+		"    ,in=N         capture rate (default 78125)\n"
+		"    ,latency=MS   audio waiting longer than this is skipped (default 100)\n";
+}
+
+audio_monitor::audio_monitor(const config& cfg) : cfg(cfg), frame_bytes(cfg.in_channels * 3)
+{
+	// a second of audio, only ever used this much when the sink stalls
+	size_t size = 1;
+	while( size < (size_t)cfg.in_rate * frame_bytes )
+		size <<= 1;
+	ring.resize(size);
+	ring_mask = size - 1;
+	thread = std::thread(&audio_monitor::run, this);
+}
+
+audio_monitor::~audio_monitor()
+{
+	if( thread.joinable() )
+		stop();
+}
+
+void audio_monitor::push(const uint8_t* data, size_t len)
+{
+	size_t frames = (partial_len + len) / frame_bytes;
+	size_t rest = (partial_len + len) % frame_bytes;
+	if( frames == 0 )
+	{
+		memcpy(partial + partial_len, data, len);
+		partial_len += len;
+		return;
+	}
+
+	uint64_t h = head.load(std::memory_order_relaxed);
+	uint64_t t = tail.load(std::memory_order_acquire);
+	if( ring.size() - (h - t) >= frames * frame_bytes )
+	{
+		auto put = [&](const uint8_t* p, size_t n)
+		{
+			size_t pos = h & ring_mask;
+			size_t first = std::min(n, ring.size() - pos);
+			memcpy(ring.data() + pos, p, first);
+			memcpy(ring.data(), p + first, n - first);
+			h += n;
+		};
+		put(partial, partial_len);
+		put(data, len - rest);
+		head.store(h, std::memory_order_release);
+		wake.fetch_add(1, std::memory_order_release);
+		wake.notify_one();
+	}
+	else
+		dropped_frames.fetch_add(frames, std::memory_order_relaxed);
+
+	memcpy(partial, data + len - rest, rest);
+	partial_len = rest;
+}
+
+void audio_monitor::stop()
+{
+	quit = true;
+	wake.fetch_add(1, std::memory_order_release);
+	wake.notify_one();
+	thread.join();
+
+	fprintf(stderr, "monitor: %llu frames played, %llu dropped with the ring full, %llu skipped to catch up, %llu underruns\n",
+		(unsigned long long)played_frames, (unsigned long long)dropped_frames.load(), (unsigned long long)skipped_frames,
+		(unsigned long long)underruns);
+}
+
+// Where the S16_LE frames go, reopens a FIFO when the player goes away
+class monitor_sink
+{
+public:
+	explicit monitor_sink(const audio_monitor::config& cfg) : cfg(cfg) {}
+
+	~monitor_sink()
+	{
+#ifdef HAVE_ALSA
+		if( pcm )
+		{
+			snd_pcm_drain(pcm);
+			snd_pcm_close(pcm);
+		}
+#endif
+		if( fd > 1 )
+			close(fd);
+	}
+
+	// false if it can never work, true with ready() false while a FIFO has no reader
+	bool open()
+	{
+#ifdef HAVE_ALSA
+		if( cfg.sink.rfind("alsa:", 0) == 0 )
+		{
+			std::string dev = cfg.sink.substr(5);
+			int err = snd_pcm_open(&pcm, dev.c_str(), SND_PCM_STREAM_PLAYBACK, 0);
+			if( err >= 0 )
+				err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, cfg.channels.size(),
+					cfg.out_rate, 1, cfg.latency_ms * 1000);
+			if( err < 0 )
+			{
+				fprintf(stderr, "monitor: %s: %s\n", dev.c_str(), snd_strerror(err));
+				return false;
+			}
+			return true;
+		}
+#endif
+		if( cfg.sink == "-" )
+		{
+			fd = 1;
+			return true;
+		}
+		// without a reader a FIFO fails with ENXIO instead of blocking, the capture goes on meanwhile
+		fd = ::open(cfg.sink.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+		if( fd < 0 && errno != ENXIO )
+		{
+			perror(cfg.sink.c_str());
+			return false;
+		}
+		if( fd >= 0 )
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		return true;
+	}
+
+	bool ready() const
+	{
+#ifdef HAVE_ALSA
+		if( pcm )
+			return true;
+#endif
+		return fd >= 0;
+	}
+
+	// false when the reader of a FIFO went away
+	bool write(const int16_t* data, size_t frames)
+	{
+#ifdef HAVE_ALSA
+		if( pcm )
+		{
+			while( frames )
+			{
+				snd_pcm_sframes_t n = snd_pcm_writei(pcm, data, frames);
+				if( n < 0 )
+				{
+					if( n == -EPIPE )
+						++underruns;
+					if( snd_pcm_recover(pcm, (int)n, 1) < 0 )
+						return true; // play on, the capture matters more
+					continue;
+				}
+				data += n * cfg.channels.size();
+				frames -= n;
+			}
+			return true;
+		}
+#endif
+		const uint8_t* p = (const uint8_t*)data;
+		size_t len = frames * cfg.channels.size() * 2;
+		while( len )
+		{
+			ssize_t n = ::write(fd, p, len);
+			if( n < 0 && errno == EINTR )
+				continue;
+			if( n <= 0 )
+			{
+				if( fd > 1 )
+					close(fd);
+				fd = -1;
+				return false;
+			}
+			p += n;
+			len -= n;
+		}
+		return true;
+	}
+
+	// ALSA only, a FIFO reader falling behind just blocks the write
+	uint64_t underruns = 0;
+
+private:
+	const audio_monitor::config& cfg;
+	int fd = -1;
+#ifdef HAVE_ALSA
+	snd_pcm_t* pcm = nullptr;
+#endif
+};
+
+void audio_monitor::run()
+{
+	// a player closing the FIFO gives EPIPE here instead of killing the capture
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+	monitor_sink sink(cfg);
+	if( !sink.open() )
+		return; // push() drops everything from now on
+
+	polyphase_resampler rs(cfg.in_rate, cfg.out_rate, cfg.channels.size());
+	std::string chs;
+	for(unsigned ch : cfg.channels)
+	{
+		if( !chs.empty() )
+			chs += '+';
+		chs += std::to_string(ch);
+	}
+	fprintf(stderr, "monitor: channels %s, %u -> %u Hz, %u taps x %u phases, %.1f ms filter delay, to %s\n", chs.c_str(),
+		cfg.in_rate, cfg.out_rate, rs.taps(), rs.phases(), rs.delay_ms(), cfg.sink.c_str());
+
+	size_t n_ch = cfg.channels.size();
+	size_t chunk = std::max<size_t>(1, (size_t)cfg.in_rate * CHUNK_MS / 1000);
+	size_t max_waiting = std::max<size_t>(chunk, (size_t)cfg.in_rate * cfg.latency_ms / 1000);
+	std::vector<std::vector<float>> planar(n_ch, std::vector<float>(chunk));
+	std::vector<const float*> planes(n_ch);
+	for(size_t c=0; c<n_ch; ++c)
+		planes[c] = planar[c].data();
+	std::vector<float> resampled;
+	std::vector<int16_t> pcm;
+
+	while( true )
+	{
+		uint32_t w = wake.load(std::memory_order_acquire);
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		size_t avail = (head.load(std::memory_order_acquire) - t) / frame_bytes;
+		if( avail == 0 )
+		{
+			if( quit )
+				break;
+			wake.wait(w, std::memory_order_acquire);
+			continue;
+		}
+
+		if( !sink.ready() )
+		{
+			// waiting for a player, what arrives meanwhile is thrown away
+			skipped_frames += avail;
+			tail.store(t + avail * frame_bytes, std::memory_order_release);
+			if( quit )
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if( !sink.open() )
+				return;
+			continue;
+		}
+
+		if( avail > max_waiting && !quit )
+		{
+			// the sink is slower than the capture clock or stalled, jump back to the present
+			size_t skip = avail - max_waiting / 2;
+			skipped_frames += skip;
+			t += skip * frame_bytes;
+			avail -= skip;
+		}
+
+		size_t n = std::min(avail, chunk);
+		for(size_t i=0; i<n; ++i)
+		{
+			for(size_t c=0; c<n_ch; ++c)
+			{
+				size_t pos = t + i * frame_bytes + cfg.channels[c] * 3;
+				uint32_t b0 = ring[pos & ring_mask], b1 = ring[(pos + 1) & ring_mask], b2 = ring[(pos + 2) & ring_mask];
+				int32_t v = (int32_t)(b0 << 8 | b1 << 16 | b2 << 24) >> 8;
+				planar[c][i] = v * (1.0f / 8388608);
+			}
+		}
+		tail.store(t + n * frame_bytes, std::memory_order_release);
+
+		resampled.clear();
+		rs.process(planes.data(), n, resampled);
+		pcm.resize(resampled.size());
+		for(size_t i=0; i<resampled.size(); ++i)
+			pcm[i] = (int16_t)lrintf(std::clamp(resampled[i], -1.0f, 1.0f) * 32767);
+
+		size_t frames = pcm.size() / n_ch;
+		if( sink.write(pcm.data(), frames) )
+			played_frames += frames;
+		else
+			fprintf(stderr, "monitor: %s went away, waiting for a new reader\n", cfg.sink.c_str());
+		underruns = sink.underruns;
+	}
+}
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Listening branch of a capture: the capture thread copies the S24_3LE frames it already has into a ring and never waits,
+// a thread of its own picks channels, resamples them to a rate any sound card takes and plays them as S16_LE.
+// If the monitor falls behind, it skips ahead and the capture does not notice.
+class audio_monitor
+{
+public:
+	struct config
+	{
+		// alsa:DEVICE, or a file or FIFO that gets raw S16_LE, - for stdout
+		std::string sink;
+		std::vector<unsigned> channels = {0, 1};
+		unsigned in_rate = 78125;
+		unsigned in_channels = 3;
+		unsigned out_rate = 48000;
+		// more than this much waiting is skipped
+		unsigned latency_ms = 100;
+	};
+
+	// SINK[,ch=A+B...][,rate=N][,in=N][,latency=MS]
+	static bool parse(const std::string& spec, config& cfg, std::string& err);
+	static const char* help();
+
+	explicit audio_monitor(const config& cfg);
+	~audio_monitor();
+
+	// from the capture thread only, any number of bytes
+	void push(const uint8_t* data, size_t len);
+	// plays what is left and prints a summary
+	void stop();
+
+private:
+	void run();
+
+	config cfg;
+	size_t frame_bytes;
+
+	// single producer (push), single consumer (run)
+	std::vector<uint8_t> ring;
+	size_t ring_mask;
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> tail{0};
+	std::atomic<uint32_t> wake{0};
+	std::atomic<bool> quit{false};
+
+	// the end of a frame split between two pushes
+	uint8_t partial[16];
+	size_t partial_len = 0;
+
+	std::thread thread;
+	std::atomic<uint64_t> dropped_frames{0};
+	uint64_t skipped_frames = 0;
+	uint64_t underruns = 0;
+	uint64_t played_frames = 0;
+};
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+// unaligned loads from the history
+typedef float v8sf_u __attribute__((vector_size(32), aligned(4)));
+
+#define STOPBAND_DB 80.0
+
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	for(int k=1; k<50 && term > sum * 1e-12; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+polyphase_resampler::polyphase_resampler(unsigned in_rate, unsigned out_rate, unsigned channels)
+	: in_rate(in_rate), channels(channels), history(channels)
+{
+	unsigned g = std::gcd(in_rate, out_rate);
+	up = out_rate / g;
+	down = in_rate / g;
+
+	// in cycles per input sample, the transition band is the top 16% below the lower nyquist
+	double nyquist = 0.5 * std::min(in_rate, out_rate) / in_rate;
+	double cutoff = nyquist * 0.92;
+	double transition = nyquist * 0.16;
+
+	// Kaiser's estimates for the length and the window shape
+	double beta = 0.1102 * (STOPBAND_DB - 8.7);
+	unsigned len = (unsigned)std::ceil((STOPBAND_DB - 8) / (2.285 * 2 * M_PI * transition));
+	n_taps = (len + 7) / 8 * 8;
+
+	// the prototype runs at in_rate * up
+	size_t total = (size_t)up * n_taps;
+	std::vector<double> h(total);
+	double center = (total - 1) / 2.0, sum = 0;
+	for(size_t k=0; k<total; ++k)
+	{
+		double t = (k - center) / up;
+		double sinc = (t == 0) ? 1 : std::sin(2 * M_PI * cutoff * t) / (2 * M_PI * cutoff * t);
+		double w = (k - center) / (center + 1);
+		h[k] = sinc * bessel_i0(beta * std::sqrt(1 - w * w));
+		sum += h[k];
+	}
+
+	// each phase then has a gain of about 1
+	coefs.resize(total / 8);
+	float* c = (float*)coefs.data();
+	for(unsigned p=0; p<up; ++p)
+		for(unsigned m=0; m<n_taps; ++m)
+			c[p * n_taps + m] = (float)(h[p + (size_t)up * (n_taps - 1 - m)] * up / sum);
+}
+
+static inline float dot(const v8sf* c, const float* x, unsigned blocks)
+{
+	v8sf a = {}, b = {};
+	unsigned i = 0;
+	for(; i + 1 < blocks; i += 2)
+	{
+		a += c[i] * *(const v8sf_u*)(x + i * 8);
+		b += c[i + 1] * *(const v8sf_u*)(x + i * 8 + 8);
+	}
+	if( i < blocks )
+		a += c[i] * *(const v8sf_u*)(x + i * 8);
+	a += b;
+	return (a[0] + a[1]) + (a[2] + a[3]) + (a[4] + a[5]) + (a[6] + a[7]);
+}
+
+void polyphase_resampler::process(const float* const* in, size_t frames, std::vector<float>& out)
+{
+	for(unsigned ch=0; ch<channels; ++ch)
+		history[ch].insert(history[ch].end(), in[ch], in[ch] + frames);
+
+	size_t have = history[0].size();
+	unsigned blocks = n_taps / 8;
+	while( acc / up + n_taps <= have )
+	{
+		size_t start = acc / up;
+		const v8sf* c = coefs.data() + (acc % up) * blocks;
+		for(unsigned ch=0; ch<channels; ++ch)
+			out.push_back(dot(c, history[ch].data() + start, blocks));
+		acc += down;
+	}
+
+	size_t used = acc / up;
+	for(unsigned ch=0; ch<channels; ++ch)
+		history[ch].erase(history[ch].begin(), history[ch].begin() + used);
+	acc -= (uint64_t)used * up;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 8 floats, split into two SSE / NEON operations unless built with -mavx
+typedef float v8sf __attribute__((vector_size(32)));
+
+// Rational polyphase resampler, 78125 -> 48000 is 384 / 625. A Kaiser windowed sinc with about 80 dB of stopband,
+// the passband goes to 42% of the lower rate. Every output sample is one dot product over the taps of its phase,
+// done 8 at a time with GCC vector extensions.
+class polyphase_resampler
+{
+public:
+	polyphase_resampler(unsigned in_rate, unsigned out_rate, unsigned channels);
+
+	// in is one pointer per channel, the output is appended interleaved
+	void process(const float* const* in, size_t frames, std::vector<float>& out);
+
+	unsigned taps() const { return n_taps; }
+	unsigned phases() const { return up; }
+	double delay_ms() const { return n_taps * 500.0 / in_rate; }
+
+private:
+	unsigned in_rate;
+	unsigned up;
+	unsigned down;
+	unsigned channels;
+	unsigned n_taps;
+	// phase p at [p * n_taps / 8], reversed so it runs forward over the history
+	std::vector<v8sf> coefs;
+	// per channel, the samples still needed for the next output
+	std::vector<std::vector<float>> history;
+	// position of the next output in input samples * up, relative to history[0]
+	uint64_t acc = 0;
+};
@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "capture_file.h"
+#include "rf_codec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t cap_frame_time(const cap_file_header& file, const cap_stream_header& s, uint64_t frame)
+{
+	return s.start_time + (uint64_t)((unsigned __int128)frame * file.tick_hz * s.rate_den / s.rate_num);
+}
+
+uint64_t cap_time_frame(const cap_file_header& file, const cap_stream_header& s, uint64_t time)
+{
+	if( time <= s.start_time )
+		return 0;
+	unsigned __int128 ticks = (unsigned __int128)(time - s.start_time) * s.rate_num;
+	unsigned __int128 per = (unsigned __int128)file.tick_hz * s.rate_den;
+	return (uint64_t)((ticks + per - 1) / per);
+}
+
+static size_t padding(size_t len)
+{
+	return (CAP_ALIGN - len % CAP_ALIGN) % CAP_ALIGN;
+}
+
+cap_writer::cap_writer(sink out, uint64_t tick_hz, uint32_t chunk_ticks) : out(std::move(out))
+{
+	file.magic = CAP_FILE_MAGIC;
+	file.version = CAP_FILE_VERSION;
+	file.tick_hz = tick_hz;
+	file.chunk_ticks = chunk_ticks;
+}
+
+uint16_t cap_writer::add_stream(const std::string& name, cap_stream_kind kind, uint32_t frame_bytes, uint64_t rate_num,
+	uint64_t rate_den, uint64_t start_time)
+{
+	cap_stream_header s{};
+	s.id = (uint16_t)list.size();
+	s.kind = kind;
+	s.frame_bytes = frame_bytes;
+	s.rate_num = rate_num;
+	s.rate_den = rate_den;
+	s.start_time = start_time;
+	strncpy(s.name, name.c_str(), sizeof(s.name) - 1);
+	list.push_back(s);
+	return s.id;
+}
+
+bool cap_writer::put(const void* data, size_t len)
+{
+	if( !ok || !out((const uint8_t*)data, len) )
+		return ok = false;
+	offset += len;
+	return true;
+}
+
+bool cap_writer::begin()
+{
+	if( started )
+		return ok;
+	started = true;
+	file.stream_count = (uint16_t)list.size();
+	put(&file, sizeof(file));
+	return put(list.data(), list.size() * sizeof(cap_stream_header));
+}
+
+bool cap_writer::chunk(uint16_t stream, uint64_t first_frame, uint64_t time, const uint8_t* data, size_t len)
+{
+	if( !begin() )
+		return false;
+	if( stream != CAP_STREAM_INDEX )
+		index.push_back({ offset, first_frame, time, (uint32_t)len, stream, 0 });
+
+	cap_chunk_header h{};
+	h.magic = CAP_CHUNK_MAGIC;
+	h.stream = stream;
+	h.bytes = (uint32_t)len;
+	h.crc32 = rf_crc32(data, len);
+	h.first_frame = first_frame;
+	h.time = time;
+	static const uint8_t zeros[CAP_ALIGN] = {};
+	put(&h, sizeof(h));
+	put(data, len);
+	return put(zeros, padding(len));
+}
+
+bool cap_writer::write_meta(const cap_metadata& meta)
+{
+	std::string text;
+	for(const auto& [key, value] : meta)
+		text += key + "=" + value + "\n";
+	// at the time of the last chunk written, that is where it was taken
+	uint64_t time = index.empty() ? 0 : index.back().time;
+	return chunk(CAP_STREAM_META, 0, time, (const uint8_t*)text.data(), text.size());
+}
+
+bool cap_writer::write_chunk(uint16_t stream, uint64_t first_frame, const uint8_t* data, size_t len)
+{
+	const cap_stream_header& s = list.at(stream);
+	return chunk(stream, first_frame, cap_frame_time(file, s, first_frame), data, len);
+}
+
+bool cap_writer::finish()
+{
+	cap_file_footer f{};
+	f.chunk_count = index.size();
+	if( !begin() )
+		return false;
+	f.index_offset = offset;
+	chunk(CAP_STREAM_INDEX, 0, 0, (const uint8_t*)index.data(), index.size() * sizeof(cap_index_entry));
+	f.magic = CAP_FOOTER_MAGIC;
+	return put(&f, sizeof(f));
+}
+
+cap_reader::~cap_reader()
+{
+	if( map )
+		munmap((void*)map, size);
+}
+
+bool cap_reader::open(const std::string& path, std::string& err)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if( fd < 0 || fstat(fd, &st) < 0 )
+	{
+		err = path + ": " + strerror(errno);
+		if( fd >= 0 )
+			close(fd);
+		return false;
+	}
+	size = (size_t)st.st_size;
+	void* p = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	int mmap_errno = errno;
+	close(fd);
+	if( p == MAP_FAILED )
+	{
+		err = path + ": " + (size ? strerror(mmap_errno) : "empty file");
+		size = 0;
+		return false;
+	}
+	map = (const uint8_t*)p;
+
+	if( size < sizeof(file) )
+	{
+		err = path + ": too short";
+		return false;
+	}
+	memcpy(&file, map, sizeof(file));
+	if( file.magic != CAP_FILE_MAGIC || file.version != CAP_FILE_VERSION || file.tick_hz == 0 )
+	{
+		err = path + ": not a capture file, or a newer version";
+		return false;
+	}
+	size_t streams_end = sizeof(file) + file.stream_count * sizeof(cap_stream_header);
+	if( size < streams_end )
+	{
+		err = path + ": too short";
+		return false;
+	}
+	list.resize(file.stream_count);
+	memcpy(list.data(), map + sizeof(file), file.stream_count * sizeof(cap_stream_header));
+	for(cap_stream_header& s : list)
+	{
+		s.name[sizeof(s.name) - 1] = 0;
+		if( s.rate_num == 0 || s.rate_den == 0 || s.frame_bytes == 0 )
+		{
+			err = path + ": bad stream header";
+			return false;
+		}
+	}
+
+	if( load_index(err) )
+		return true;
+	if( !err.empty() )
+		return false;
+	no_footer = true;
+	return walk_chunks(err);
+}
+
+// false with err empty if there is no footer
+bool cap_reader::load_index(std::string& err)
+{
+	cap_file_footer f;
+	if( size < sizeof(file) + sizeof(f) )
+		return false;
+	memcpy(&f, map + size - sizeof(f), sizeof(f));
+	if( f.magic != CAP_FOOTER_MAGIC )
+		return false;
+
+	cap_chunk_header h;
+	if( f.index_offset + sizeof(h) > size - sizeof(f) )
+	{
+		err = "bad index offset";
+		return false;
+	}
+	memcpy(&h, map + f.index_offset, sizeof(h));
+	if( h.magic != CAP_CHUNK_MAGIC || h.stream != CAP_STREAM_INDEX || h.bytes != f.chunk_count * sizeof(cap_index_entry)
+		|| f.index_offset + sizeof(h) + h.bytes > size - sizeof(f) )
+	{
+		err = "bad index";
+		return false;
+	}
+	const uint8_t* p = map + f.index_offset + sizeof(h);
+	if( rf_crc32(p, h.bytes) != h.crc32 )
+	{
+		err = "bad index checksum";
+		return false;
+	}
+	index.resize(f.chunk_count);
+	memcpy(index.data(), p, h.bytes);
+	for(const cap_index_entry& e : index)
+	{
+		if( e.offset + sizeof(h) + e.bytes > f.index_offset )
+		{
+			err = "bad index entry";
+			return false;
+		}
+	}
+	return true;
+}
+
+// up to the index, or the first chunk that is not whole
+bool cap_reader::walk_chunks(std::string&)
+{
+	uint64_t pos = sizeof(file) + file.stream_count * sizeof(cap_stream_header);
+	cap_chunk_header h;
+	while( pos + sizeof(h) <= size )
+	{
+		memcpy(&h, map + pos, sizeof(h));
+		if( h.magic != CAP_CHUNK_MAGIC || h.stream == CAP_STREAM_INDEX || pos + sizeof(h) + h.bytes > size )
+			break;
+		index.push_back({ pos, h.first_frame, h.time, h.bytes, h.stream, 0 });
+		pos += sizeof(h) + h.bytes + padding(h.bytes);
+	}
+	return true;
+}
+
+int cap_reader::find_stream(const std::string& name) const
+{
+	for(const cap_stream_header& s : list)
+		if( name == s.name )
+			return s.id;
+	return -1;
+}
+
+std::span<const uint8_t> cap_reader::payload(const cap_index_entry& chunk) const
+{
+	return { map + chunk.offset + sizeof(cap_chunk_header), chunk.bytes };
+}
+
+bool cap_reader::check(const cap_index_entry& chunk) const
+{
+	cap_chunk_header h;
+	memcpy(&h, map + chunk.offset, sizeof(h));
+	std::span<const uint8_t> p = payload(chunk);
+	return h.magic == CAP_CHUNK_MAGIC && h.stream == chunk.stream && h.bytes == chunk.bytes
+		&& rf_crc32(p.data(), p.size()) == h.crc32;
+}
+
+uint64_t cap_reader::end_time(const cap_index_entry& chunk) const
+{
+	if( chunk.stream >= list.size() )
+		return chunk.time;
+	const cap_stream_header& s = list[chunk.stream];
+	return cap_frame_time(file, s, chunk.first_frame + chunk.bytes / s.frame_bytes);
+}
+
+std::vector<const cap_index_entry*> cap_reader::range(uint16_t stream, uint64_t from, uint64_t to) const
+{
+	std::vector<const cap_index_entry*> chunks;
+	for(const cap_index_entry& e : index)
+		if( e.stream == stream && e.time < to && end_time(e) > from )
+			chunks.push_back(&e);
+	return chunks;
+}
+
+cap_metadata cap_reader::metadata() const
+{
+	cap_metadata meta;
+	for(const cap_index_entry& e : index)
+	{
+		if( e.stream != CAP_STREAM_META )
+			continue;
+		std::span<const uint8_t> p = payload(e);
+		std::string text(p.begin(), p.end());
+		size_t pos = 0;
+		while( pos < text.size() )
+		{
+			size_t end = text.find('\n', pos);
+			if( end == std::string::npos )
+				end = text.size();
+			std::string line = text.substr(pos, end - pos);
+			size_t eq = line.find('=');
+			if( eq != std::string::npos )
+				meta.emplace_back(line.substr(0, eq), line.substr(eq + 1));
+			pos = end + 1;
+		}
+	}
+	return meta;
+}
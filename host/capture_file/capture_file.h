@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One file for all streams of a capture (.cxcap): the RF of every card and the tagged linear audio, cut into chunks
+// on a shared timeline and interleaved in time order, with the capture metadata in between. Every chunk has a CRC32
+// and the index at the end lists all of them, so the file can be mapped and any time range of any stream read on
+// its own, on as many threads as there are.
+//
+// The timeline counts ticks of tick_hz (the 40 MHz of clock 0 by default), a stream starts at start_time and its
+// frames are rate_den * tick_hz / rate_num ticks apart, so a chunk at first_frame is at a known tick.
+//
+// File layout, all little endian, every chunk starts 32 byte aligned so the payloads can be used in place:
+//  cap_file_header
+//  cap_stream_header, stream_count times
+//  cap_chunk_header + payload + padding, repeated. Stream CAP_STREAM_META holds "key=value" lines
+//  a chunk of stream CAP_STREAM_INDEX with a cap_index_entry for every other chunk
+//  cap_file_footer, fixed size at the very end so a reader can find the index
+// Without the footer (the writer did not finish) a reader walks the chunks instead.
+
+#define CAP_FILE_MAGIC   0x50435843 // "CXCP"
+#define CAP_CHUNK_MAGIC  0x4b435843 // "CXCK"
+#define CAP_FOOTER_MAGIC 0x45435843 // "CXCE"
+#define CAP_FILE_VERSION 1
+
+#define CAP_STREAM_META  0xfffe
+#define CAP_STREAM_INDEX 0xffff
+
+#define CAP_ALIGN 32
+
+#define CAP_DEFAULT_TICK_HZ 40000000
+// 1 Mi ticks, about 26 ms at 40 MHz, the same as an rf_compress block
+#define CAP_DEFAULT_CHUNK_TICKS (1u << 20)
+
+enum cap_stream_kind : uint8_t
+{
+	// anything, frame_bytes per frame
+	cap_kind_raw,
+	// cxadc samples, u8 or u16 (tenbit)
+	cap_kind_rf,
+	// what the clock generator sends, 3 channel S24_3LE with stream tags (see firmware/src/stream_tag.h)
+	cap_kind_audio,
+};
+
+struct __attribute__((packed)) cap_file_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t stream_count;
+	uint64_t tick_hz;
+	uint32_t chunk_ticks;
+	uint32_t reserved[3];
+};
+
+struct __attribute__((packed)) cap_stream_header
+{
+	uint16_t id;
+	cap_stream_kind kind;
+	uint8_t reserved;
+	uint32_t frame_bytes;
+	// frames per second, as a fraction so 315 / 11 MHz is exact
+	uint64_t rate_num;
+	uint64_t rate_den;
+	uint64_t start_time;
+	char name[32];
+};
+
+struct __attribute__((packed)) cap_chunk_header
+{
+	uint32_t magic;
+	uint16_t stream;
+	uint16_t reserved;
+	uint32_t bytes;
+	// of the payload
+	uint32_t crc32;
+	uint64_t first_frame;
+	uint64_t time;
+};
+
+struct __attribute__((packed)) cap_index_entry
+{
+	// of the chunk header
+	uint64_t offset;
+	uint64_t first_frame;
+	uint64_t time;
+	uint32_t bytes;
+	uint16_t stream;
+	uint16_t reserved;
+};
+
+struct __attribute__((packed)) cap_file_footer
+{
+	uint64_t index_offset;
+	uint64_t chunk_count;
+	uint64_t reserved;
+	uint32_t magic;
+	uint32_t reserved2;
+};
+
+static_assert(sizeof(cap_file_header) % CAP_ALIGN == 0 && sizeof(cap_stream_header) % CAP_ALIGN == 0);
+static_assert(sizeof(cap_chunk_header) % CAP_ALIGN == 0 && sizeof(cap_file_footer) % CAP_ALIGN == 0);
+
+using cap_metadata = std::vector<std::pair<std::string, std::string>>;
+
+// the tick of a frame
+uint64_t cap_frame_time(const cap_file_header& file, const cap_stream_header& s, uint64_t frame);
+// the first frame at or after a tick
+uint64_t cap_time_frame(const cap_file_header& file, const cap_stream_header& s, uint64_t time);
+
+// Writes a .cxcap through a sink, so it works on pipes as well. The chunks go out in the order they are written,
+// the caller interleaves them by time
+class cap_writer
+{
+public:
+	using sink = std::function<bool(const uint8_t*, size_t)>;
+
+	explicit cap_writer(sink out, uint64_t tick_hz = CAP_DEFAULT_TICK_HZ, uint32_t chunk_ticks = CAP_DEFAULT_CHUNK_TICKS);
+
+	// all of them before anything else, the id is the place in the list
+	uint16_t add_stream(const std::string& name, cap_stream_kind kind, uint32_t frame_bytes, uint64_t rate_num,
+		uint64_t rate_den, uint64_t start_time);
+
+	// returns false once the sink failed
+	bool write_meta(const cap_metadata& meta);
+	bool write_chunk(uint16_t stream, uint64_t first_frame, const uint8_t* data, size_t len);
+	// index and footer
+	bool finish();
+
+	const cap_file_header& header() const { return file; }
+	const std::vector<cap_stream_header>& streams() const { return list; }
+	uint64_t file_bytes() const { return offset; }
+
+private:
+	bool put(const void* data, size_t len);
+	bool begin();
+	bool chunk(uint16_t stream, uint64_t first_frame, uint64_t time, const uint8_t* data, size_t len);
+
+	sink out;
+	cap_file_header file{};
+	std::vector<cap_stream_header> list;
+	std::vector<cap_index_entry> index;
+	uint64_t offset = 0;
+	bool started = false;
+	bool ok = true;
+};
+
+// A .cxcap mapped into memory. Nothing is copied, the payloads are read straight from the mapping, so any number of
+// threads can work on the chunks at once
+class cap_reader
+{
+public:
+	~cap_reader();
+
+	bool open(const std::string& path, std::string& err);
+
+	const cap_file_header& header() const { return file; }
+	const std::vector<cap_stream_header>& streams() const { return list; }
+	// every chunk but the index, in file order
+	const std::vector<cap_index_entry>& chunks() const { return index; }
+	// no footer, the index was rebuilt from the chunks (the capture was cut short)
+	bool rebuilt() const { return no_footer; }
+
+	int find_stream(const std::string& name) const;
+	std::span<const uint8_t> payload(const cap_index_entry& chunk) const;
+	bool check(const cap_index_entry& chunk) const;
+	// the tick after the last frame of the chunk
+	uint64_t end_time(const cap_index_entry& chunk) const;
+	// the chunks of a stream with frames in [from, to), in time order
+	std::vector<const cap_index_entry*> range(uint16_t stream, uint64_t from, uint64_t to) const;
+	// all metadata chunks in file order, a key can be there more than once (before and after the capture)
+	cap_metadata metadata() const;
+
+private:
+	bool load_index(std::string& err);
+	bool walk_chunks(std::string& err);
+
+	const uint8_t* map = nullptr;
+	size_t size = 0;
+	cap_file_header file{};
+	std::vector<cap_stream_header> list;
+	std::vector<cap_index_entry> index;
+	bool no_footer = false;
+};
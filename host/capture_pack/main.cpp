@@ -0,0 +1,511 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Packs the streams of a capture and its metadata into one .cxcap file and reads them back, see README.md
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_file.h"
+#include "device.h"
+#include "status.h"
+
+struct input
+{
+	std::string name;
+	std::string path;
+	cap_stream_kind kind = cap_kind_rf;
+	uint32_t frame_bytes = 1;
+	uint64_t rate_num = CAP_DEFAULT_TICK_HZ;
+	uint64_t rate_den = 1;
+	uint64_t offset = 0;
+
+	FILE* f = nullptr;
+	uint16_t id = 0;
+	uint64_t frames = 0;
+	bool done = false;
+};
+
+static const char* kind_names[] = { "raw", "rf", "audio" };
+
+static bool parse_rate(const std::string& s, uint64_t& num, uint64_t& den)
+{
+	char* end;
+	num = strtoull(s.c_str(), &end, 0);
+	den = 1;
+	if( *end == '/' )
+		den = strtoull(end + 1, &end, 0);
+	return !*end && num && den;
+}
+
+// NAME=FILE[,kind=K][,rate=N[/D]][,bytes=N][,offset=TICKS]
+static bool parse_input(const std::string& spec, input& in)
+{
+	size_t eq = spec.find('=');
+	if( eq == std::string::npos || eq == 0 || eq >= 32 )
+	{
+		fprintf(stderr, "'%s': NAME=FILE, with a name up to 31 characters\n", spec.c_str());
+		return false;
+	}
+	in.name = spec.substr(0, eq);
+	std::string rest = spec.substr(eq + 1);
+	size_t comma = rest.find(',');
+	in.path = rest.substr(0, comma);
+
+	bool rate_set = false, bytes_set = false;
+	while( comma != std::string::npos )
+	{
+		size_t start = comma + 1;
+		comma = rest.find(',', start);
+		std::string opt = rest.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+		size_t oeq = opt.find('=');
+		std::string key = opt.substr(0, oeq);
+		std::string value = (oeq == std::string::npos) ? "" : opt.substr(oeq + 1);
+		if( key == "kind" )
+		{
+			auto it = std::find_if(std::begin(kind_names), std::end(kind_names), [&](const char* k) { return value == k; });
+			if( it == std::end(kind_names) )
+			{
+				fprintf(stderr, "'%s': kind is raw, rf or audio\n", spec.c_str());
+				return false;
+			}
+			in.kind = (cap_stream_kind)(it - std::begin(kind_names));
+		}
+		else if( key == "rate" )
+		{
+			if( !parse_rate(value, in.rate_num, in.rate_den) )
+			{
+				fprintf(stderr, "'%s': bad rate\n", spec.c_str());
+				return false;
+			}
+			rate_set = true;
+		}
+		else if( key == "bytes" )
+		{
+			in.frame_bytes = atoi(value.c_str());
+			bytes_set = true;
+		}
+		else if( key == "offset" )
+			in.offset = strtoull(value.c_str(), nullptr, 0);
+		else
+		{
+			fprintf(stderr, "'%s': unknown option '%s'\n", spec.c_str(), key.c_str());
+			return false;
+		}
+	}
+
+	// 3 channels of S24_3LE at clock 0 / 512
+	if( in.kind == cap_kind_audio && !rate_set )
+		in.rate_num = CAP_DEFAULT_TICK_HZ / 512;
+	if( in.kind == cap_kind_audio && !bytes_set )
+		in.frame_bytes = 9;
+	if( in.frame_bytes == 0 )
+	{
+		fprintf(stderr, "'%s': bytes must not be 0\n", spec.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string read_line(const std::string& path)
+{
+	std::ifstream f(path);
+	std::string s;
+	std::getline(f, s);
+	return s;
+}
+
+// everything the driver has in sysfs: level, sixdb, vmux, tenbit, ...
+static bool collect_cxadc(int card, cap_metadata& meta)
+{
+	std::string dir = "/sys/class/cxadc/cxadc" + std::to_string(card) + "/device/parameters";
+	DIR* d = opendir(dir.c_str());
+	if( !d )
+	{
+		perror(dir.c_str());
+		return false;
+	}
+	std::vector<std::string> names;
+	while( dirent* e = readdir(d) )
+		if( e->d_name[0] != '.' )
+			names.push_back(e->d_name);
+	closedir(d);
+	std::sort(names.begin(), names.end());
+	for(const std::string& name : names)
+		meta.emplace_back("cxadc" + std::to_string(card) + "." + name, read_line(dir + "/" + name));
+	return true;
+}
+
+static bool collect_device(const std::string& serial, bool status_only, cap_metadata& meta)
+{
+	std::string err;
+	device_info dev;
+	global_status_fields status;
+	if( !find_device(serial, dev, err) || !fetch_status(dev, status, err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return false;
+	}
+	if( !status_only )
+	{
+		meta.emplace_back("device.serial", dev.serial);
+		meta.emplace_back("device.git_sha", dev.git_sha);
+	}
+	for(const auto& [name, value] : status_values(status))
+		meta.emplace_back("status." + name, value);
+	return true;
+}
+
+// key=value lines, # for comments
+static bool read_meta_file(const std::string& path, cap_metadata& meta)
+{
+	std::ifstream f(path);
+	if( !f )
+	{
+		perror(path.c_str());
+		return false;
+	}
+	std::string line;
+	while( std::getline(f, line) )
+	{
+		size_t eq = line.find('=');
+		if( line.empty() || line[0] == '#' || eq == std::string::npos )
+			continue;
+		meta.emplace_back(line.substr(0, eq), line.substr(eq + 1));
+	}
+	return true;
+}
+
+static int run_pack(std::vector<input>& inputs, const cap_metadata& meta, bool device, const std::string& serial,
+	uint32_t chunk_ticks)
+{
+	for(input& in : inputs)
+	{
+		in.f = (in.path == "-") ? stdin : fopen(in.path.c_str(), "rb");
+		if( !in.f )
+		{
+			perror(in.path.c_str());
+			return 1;
+		}
+	}
+
+	cap_writer w([](const uint8_t* data, size_t len) { return fwrite(data, 1, len, stdout) == len; },
+		CAP_DEFAULT_TICK_HZ, chunk_ticks);
+	for(input& in : inputs)
+		in.id = w.add_stream(in.name, in.kind, in.frame_bytes, in.rate_num, in.rate_den, in.offset);
+	w.write_meta(meta);
+
+	// every stream up to the same tick, one chunk period at a time
+	std::vector<uint8_t> buf;
+	bool any = true;
+	for(uint64_t end = chunk_ticks; any; end += chunk_ticks)
+	{
+		any = false;
+		for(input& in : inputs)
+		{
+			if( in.done )
+				continue;
+			any = true;
+			uint64_t target = cap_time_frame(w.header(), w.streams()[in.id], end);
+			if( target <= in.frames )
+				continue;
+			size_t want = (target - in.frames) * in.frame_bytes;
+			buf.resize(want);
+			size_t n = fread(buf.data(), 1, want, in.f);
+			if( n < want )
+				in.done = true;
+			// a partial frame at the very end is dropped
+			n -= n % in.frame_bytes;
+			if( n && !w.write_chunk(in.id, in.frames, buf.data(), n) )
+				break;
+			in.frames += n / in.frame_bytes;
+		}
+	}
+
+	// the counters after the capture, when the inputs are the FIFOs of a running one
+	cap_metadata after;
+	if( device && collect_device(serial, true, after) )
+		w.write_meta(after);
+
+	bool ok = w.finish() && fflush(stdout) == 0;
+	for(const input& in : inputs)
+	{
+		const cap_stream_header& s = w.streams()[in.id];
+		fprintf(stderr, "%s: %llu frames, %.3f s\n", in.name.c_str(), (unsigned long long)in.frames,
+			(double)in.frames * s.rate_den / s.rate_num);
+		if( in.f != stdin )
+			fclose(in.f);
+	}
+	if( !ok )
+	{
+		fprintf(stderr, "write failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+static bool open_reader(cap_reader& r, const std::string& path)
+{
+	std::string err;
+	if( !r.open(path, err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return false;
+	}
+	if( r.rebuilt() )
+		fprintf(stderr, "%s: no index, the capture was cut short, using the chunks up to there\n", path.c_str());
+	return true;
+}
+
+static int run_info(const std::string& path)
+{
+	cap_reader r;
+	if( !open_reader(r, path) )
+		return 1;
+
+	const cap_file_header& h = r.header();
+	printf("%llu Hz ticks, %u ticks per chunk, %zu chunks\n", (unsigned long long)h.tick_hz, h.chunk_ticks, r.chunks().size());
+	for(const cap_stream_header& s : r.streams())
+	{
+		uint64_t frames = 0, chunks = 0;
+		for(const cap_index_entry& e : r.chunks())
+		{
+			if( e.stream != s.id )
+				continue;
+			frames = e.first_frame + e.bytes / s.frame_bytes;
+			++chunks;
+		}
+		printf("stream %u '%s': %s, %u bytes per frame, %llu/%llu Hz, starts at tick %llu, %llu frames in %llu chunks, %.3f s\n",
+			s.id, s.name, s.kind < std::size(kind_names) ? kind_names[s.kind] : "?", s.frame_bytes,
+			(unsigned long long)s.rate_num, (unsigned long long)s.rate_den, (unsigned long long)s.start_time,
+			(unsigned long long)frames, (unsigned long long)chunks, (double)frames * s.rate_den / s.rate_num);
+	}
+	for(const auto& [key, value] : r.metadata())
+		printf("%s=%s\n", key.c_str(), value.c_str());
+	return 0;
+}
+
+// the checksums of all chunks, every thread takes the next one
+static int run_verify(const std::string& path, unsigned threads)
+{
+	cap_reader r;
+	if( !open_reader(r, path) )
+		return 1;
+
+	const std::vector<cap_index_entry>& chunks = r.chunks();
+	std::vector<uint8_t> bad(chunks.size());
+	std::atomic<size_t> next_chunk{0};
+	auto work = [&]()
+	{
+		for(size_t i; (i = next_chunk++) < chunks.size(); )
+			bad[i] = !r.check(chunks[i]);
+	};
+	std::vector<std::thread> pool;
+	for(unsigned i=1; i<threads; ++i)
+		pool.emplace_back(work);
+	work();
+	for(std::thread& t : pool)
+		t.join();
+
+	uint64_t bad_count = 0;
+	for(size_t i=0; i<chunks.size(); ++i)
+	{
+		if( !bad[i] )
+			continue;
+		++bad_count;
+		fprintf(stderr, "bad chunk at offset %llu, stream %u, tick %llu\n", (unsigned long long)chunks[i].offset,
+			chunks[i].stream, (unsigned long long)chunks[i].time);
+	}
+	printf("%zu chunks, %llu bad\n", chunks.size(), (unsigned long long)bad_count);
+	return (bad_count || r.rebuilt()) ? 2 : 0;
+}
+
+// the frames of one stream in [from, to) seconds of the timeline, damaged chunks as zeros so the timing stays intact
+static int run_extract(const std::string& path, const std::string& name, double from, double to)
+{
+	cap_reader r;
+	if( !open_reader(r, path) )
+		return 1;
+	int id = r.find_stream(name);
+	if( id < 0 )
+	{
+		fprintf(stderr, "no stream '%s' in %s\n", name.c_str(), path.c_str());
+		return 1;
+	}
+
+	const cap_file_header& h = r.header();
+	const cap_stream_header& s = r.streams()[id];
+	uint64_t from_tick = (uint64_t)(from * h.tick_hz);
+	uint64_t to_tick = (to < 0) ? UINT64_MAX : (uint64_t)(to * h.tick_hz);
+	uint64_t first = cap_time_frame(h, s, from_tick);
+	uint64_t last = (to < 0) ? UINT64_MAX : cap_time_frame(h, s, to_tick);
+
+	uint64_t bad = 0;
+	std::vector<uint8_t> zeros;
+	for(const cap_index_entry* e : r.range((uint16_t)id, from_tick, to_tick))
+	{
+		std::span<const uint8_t> p = r.payload(*e);
+		if( !r.check(*e) )
+		{
+			++bad;
+			zeros.assign(p.size(), 0);
+			p = zeros;
+		}
+		uint64_t frames = p.size() / s.frame_bytes;
+		uint64_t begin = std::max(first, e->first_frame) - e->first_frame;
+		uint64_t end = std::min(last, e->first_frame + frames) - e->first_frame;
+		if( begin >= end )
+			continue;
+		size_t n = (end - begin) * s.frame_bytes;
+		if( fwrite(p.data() + begin * s.frame_bytes, 1, n, stdout) != n )
+		{
+			fprintf(stderr, "write failed\n");
+			return 1;
+		}
+	}
+	if( bad )
+		fprintf(stderr, "%llu damaged chunks replaced by zeros\n", (unsigned long long)bad);
+	return bad ? 2 : 0;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] NAME=FILE[,opts]... > capture.cxcap\n", me);
+	printf("       %s --info | --verify | --extract NAME [options] capture.cxcap\n", me);
+	printf("  (default)        pack the streams into one file on stdout, interleaved by time\n");
+	printf("  --meta KEY=VALUE add to the metadata\n");
+	printf("  --meta-file F    add the KEY=VALUE lines of F, e.g. from --snapshot\n");
+	printf("  --cxadc N        add the sysfs parameters of cxadcN (level, sixdb, ...)\n");
+	printf("  --device         add serial, firmware git sha and status counters of the clock generator, again at the end\n");
+	printf("  --serial S       the one with this serial\n");
+	printf("  --chunk-ticks N  chunk length on the timeline (default %u)\n", CAP_DEFAULT_CHUNK_TICKS);
+	printf("  --snapshot       only print what --cxadc and --device collect, as KEY=VALUE lines\n");
+	printf("  --info           streams, lengths and metadata\n");
+	printf("  --verify         check every chunk, on --threads N (default all cpus)\n");
+	printf("  --extract NAME   write the frames of stream NAME to stdout\n");
+	printf("  --from S, --to S with --extract, the range on the timeline in seconds\n");
+	printf("Stream options, comma separated after the file (- for stdin):\n");
+	printf("  kind=rf|audio|raw  rf (default) is cxadc samples, audio the tagged 3 channel S24_3LE of the clock generator\n");
+	printf("  rate=N[/D]       frames per second (default %u, %u for audio)\n", CAP_DEFAULT_TICK_HZ, CAP_DEFAULT_TICK_HZ / 512);
+	printf("  bytes=N          bytes per frame (default 1, 9 for audio, 2 for tenbit)\n");
+	printf("  offset=TICKS     start of the stream on the timeline, in %u Hz ticks\n", CAP_DEFAULT_TICK_HZ);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<input> inputs;
+	cap_metadata meta;
+	std::vector<int> cards;
+	bool device = false, snapshot = false;
+	bool info = false, verify = false;
+	std::string serial, extract, file;
+	double from = 0, to = -1;
+	unsigned threads = std::thread::hardware_concurrency();
+	uint32_t chunk_ticks = CAP_DEFAULT_CHUNK_TICKS;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--meta" )
+		{
+			std::string kv = next();
+			size_t eq = kv.find('=');
+			if( eq == std::string::npos )
+			{
+				fprintf(stderr, "--meta takes KEY=VALUE\n");
+				return 1;
+			}
+			meta.emplace_back(kv.substr(0, eq), kv.substr(eq + 1));
+		}
+		else if( a == "--meta-file" )    { if( !read_meta_file(next(), meta) ) return 1; }
+		else if( a == "--cxadc" )        cards.push_back(atoi(next()));
+		else if( a == "--device" )       device = true;
+		else if( a == "--serial" )       { serial = next(); device = true; }
+		else if( a == "--chunk-ticks" )  chunk_ticks = strtoul(next(), nullptr, 0);
+		else if( a == "--snapshot" )     snapshot = true;
+		else if( a == "--info" )         info = true;
+		else if( a == "--verify" )       verify = true;
+		else if( a == "--extract" )      extract = next();
+		else if( a == "--from" )         from = atof(next());
+		else if( a == "--to" )           to = atof(next());
+		else if( a == "--threads" )      threads = std::max(1, atoi(next()));
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a[0] != '-' && a.find('=') == std::string::npos && file.empty() ) file = a;
+		else if( a[0] != '-' )
+		{
+			input in;
+			if( !parse_input(a, in) )
+				return 1;
+			inputs.push_back(in);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( (info || verify || !extract.empty()) && file.empty() )
+	{
+		fprintf(stderr, "--info, --verify and --extract need a capture file\n");
+		return 1;
+	}
+	if( info )
+		return run_info(file);
+	if( verify )
+		return run_verify(file, threads);
+	if( !extract.empty() )
+		return run_extract(file, extract, from, to);
+	if( !file.empty() )
+	{
+		fprintf(stderr, "'%s': streams are NAME=FILE, see --help\n", file.c_str());
+		return 1;
+	}
+
+	for(int card : cards)
+		if( !collect_cxadc(card, meta) )
+			return 1;
+	if( device && !collect_device(serial, false, meta) )
+		return 1;
+
+	if( snapshot )
+	{
+		for(const auto& [key, value] : meta)
+			printf("%s=%s\n", key.c_str(), value.c_str());
+		return 0;
+	}
+
+	if( inputs.empty() )
+	{
+		fprintf(stderr, "nothing to pack, see --help\n");
+		return 1;
+	}
+	if( chunk_ticks == 0 )
+	{
+		fprintf(stderr, "--chunk-ticks must not be 0\n");
+		return 1;
+	}
+	return run_pack(inputs, meta, device, serial, chunk_ticks);
+}
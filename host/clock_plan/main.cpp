@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Prints the clock plans the firmware would pick, see README.md
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "clock_plan.h"
+
+// same values as CLOCK_GEN_CXADC_CLOCK_Fx_HZ in clock_gen.h, that header pulls in the sdk so it can't be included here
+static const uint32_t cxadc_clocks[] = { 20000000, 28636364, 40000000, 50000000 };
+
+// PCM1802 system clock multipliers
+static const uint32_t adc_mults[] = { 256, 384, 512 };
+
+static void print_plan(const clock_plan& p)
+{
+	printf("sys %.6f MHz = 12 MHz * %u / %u / %u (VCO %.0f MHz)\n",
+		p.sys_hz / 1e6, p.fbdiv, p.postdiv1, p.postdiv2, p.vco_hz / 1e6);
+	for(uint8_t i=0; i<p.n_outputs; ++i)
+	{
+		const clock_plan_output& o = p.outputs[i];
+		if( o.div_int == 0 )
+		{
+			printf("  %11.6f MHz  not reachable\n", o.target_hz / 1e6);
+			continue;
+		}
+		printf("  %11.6f MHz  div %u", o.target_hz / 1e6, o.div_int);
+		if( o.div_frac )
+			printf(" + %u/256", o.div_frac);
+		printf(" -> %.6f MHz, %+d ppb%s\n", o.actual_hz / 1e6, o.error_ppb, (p.exact_mask & (1u << i)) ? ", exact" : "");
+		printf("               ADC fs");
+		for(uint32_t m : adc_mults)
+			printf("  %u fs: %.2f Hz", m, (double)o.actual_hz / m);
+		printf("\n");
+	}
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options]\n", me);
+	printf("  --sys-max-mhz F       highest allowed system clock (default 133)\n");
+	printf("  --sys-min-mhz F       lowest allowed system clock (default 48)\n");
+	printf("  --fractional          allow fractional GPOUT dividers (the firmware doesn't)\n");
+	printf("  --target HZ           solve for this output clock, may be given up to %d times\n", CLOCK_PLAN_MAX_TARGETS);
+	printf("  --fs RATE:MULT        solve for an ADC sample rate at the given system clock multiplier\n");
+	printf("Without targets every CXADC clock from clock_gen.h is solved on its own.\n");
+}
+
+int main(int argc, char** argv)
+{
+	clock_plan_limits limits;
+	clock_plan_default_limits(&limits);
+	limits.allow_fractional = false;
+
+	std::vector<uint32_t> targets;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--sys-max-mhz" )      limits.sys_max_hz = (uint32_t)(atof(next()) * 1e6);
+		else if( a == "--sys-min-mhz" ) limits.sys_min_hz = (uint32_t)(atof(next()) * 1e6);
+		else if( a == "--fractional" )  limits.allow_fractional = true;
+		else if( a == "--target" )      targets.push_back((uint32_t)strtoul(next(), nullptr, 0));
+		else if( a == "--fs" )
+		{
+			unsigned rate = 0, mult = 0;
+			if( sscanf(next(), "%u:%u", &rate, &mult) != 2 || rate == 0 || mult == 0 )
+			{
+				fprintf(stderr, "bad fs, expected RATE:MULT\n");
+				return 1;
+			}
+			targets.push_back(rate * mult);
+		}
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( targets.size() > CLOCK_PLAN_MAX_TARGETS )
+	{
+		fprintf(stderr, "at most %d targets\n", CLOCK_PLAN_MAX_TARGETS);
+		return 1;
+	}
+
+	std::vector<std::vector<uint32_t>> jobs;
+	if( targets.empty() )
+		for(uint32_t c : cxadc_clocks)
+			jobs.push_back({ c });
+	else
+		jobs.push_back(targets);
+
+	int ret = 0;
+	for(const auto& job : jobs)
+	{
+		clock_plan p;
+		if( !clock_plan_solve(&limits, job.data(), (uint8_t)job.size(), &p) )
+		{
+			fprintf(stderr, "no PLL setting in the given system clock range\n");
+			return 1;
+		}
+		print_plan(p);
+		if( p.exact_mask != (1u << job.size()) - 1 )
+			ret = 2;
+	}
+	return ret;
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "capture.h"
+#include "device.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+// same as the firmware
+#define CHANNELS     3
+#define FRAME_BYTES  (CHANNELS * 3)
+#define DEFAULT_RATE 78125
+
+class file_source : public capture_source
+{
+public:
+	file_source(int fd, const std::string& path, unsigned frame_rate) : fd(fd), path(path), frame_rate(frame_rate) {}
+	~file_source() override
+	{
+		if( fd > 0 )
+			close(fd);
+	}
+
+	// read() and not fread(), that would wait for the whole buffer on a FIFO
+	size_t read(std::span<uint8_t> buf) override
+	{
+		while( true )
+		{
+			ssize_t n = ::read(fd, buf.data(), buf.size());
+			if( n < 0 && errno == EINTR )
+				continue;
+			return (n > 0) ? (size_t)n : 0;
+		}
+	}
+
+	unsigned rate() const override { return frame_rate; }
+	const std::string& name() const override { return path; }
+
+private:
+	int fd;
+	std::string path;
+	unsigned frame_rate;
+};
+
+#ifdef HAVE_ALSA
+class alsa_source : public capture_source
+{
+public:
+	~alsa_source() override
+	{
+		if( pcm )
+		{
+			snd_pcm_drop(pcm);
+			snd_pcm_close(pcm);
+		}
+	}
+
+	bool open(const std::string& device, unsigned rate, std::string& err)
+	{
+		dev = device;
+		frame_rate = rate ? rate : DEFAULT_RATE;
+		int r = snd_pcm_open(&pcm, dev.c_str(), SND_PCM_STREAM_CAPTURE, 0);
+		if( r >= 0 )
+			r = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S24_3LE, SND_PCM_ACCESS_RW_INTERLEAVED, CHANNELS,
+				frame_rate, 0, 500000);
+		if( r < 0 )
+		{
+			err = dev + ": " + snd_strerror(r);
+			return false;
+		}
+		return true;
+	}
+
+	size_t read(std::span<uint8_t> buf) override
+	{
+		while( true )
+		{
+			snd_pcm_sframes_t n = snd_pcm_readi(pcm, buf.data(), buf.size() / FRAME_BYTES);
+			if( n == -EPIPE )
+			{
+				++xruns;
+				if( snd_pcm_prepare(pcm) < 0 )
+					return 0;
+				continue;
+			}
+			if( n == -EINTR || n == -EAGAIN )
+				continue;
+			return (n > 0) ? (size_t)n * FRAME_BYTES : 0;
+		}
+	}
+
+	uint64_t overruns() const override { return xruns; }
+	unsigned rate() const override { return frame_rate; }
+	const std::string& name() const override { return dev; }
+
+private:
+	snd_pcm_t* pcm = nullptr;
+	std::string dev;
+	unsigned frame_rate = 0;
+	uint64_t xruns = 0;
+};
+#endif
+
+std::unique_ptr<capture_source> capture_source::open(const std::string& spec, unsigned rate, std::string& err)
+{
+	std::string alsa_dev;
+	if( spec == "device" || spec.rfind("device:", 0) == 0 )
+	{
+		device_info info;
+		if( !find_device(spec.size() > 7 ? spec.substr(7) : "", info, err) )
+			return nullptr;
+		if( info.alsa_card < 0 )
+		{
+			err = info.serial + ": no ALSA card, is snd-usb-audio loaded?";
+			return nullptr;
+		}
+		alsa_dev = info.alsa_device();
+	}
+	else if( spec.rfind("alsa:", 0) == 0 )
+		alsa_dev = spec.substr(5);
+
+	if( !alsa_dev.empty() )
+	{
+#ifdef HAVE_ALSA
+		auto s = std::make_unique<alsa_source>();
+		if( !s->open(alsa_dev, rate, err) )
+			return nullptr;
+		return s;
+#else
+		err = "built without ALSA, pipe arecord in instead";
+		return nullptr;
+#endif
+	}
+
+	int fd = (spec == "-") ? 0 : ::open(spec.c_str(), O_RDONLY);
+	if( fd < 0 )
+	{
+		err = spec + ": " + strerror(errno);
+		return nullptr;
+	}
+	return std::make_unique<file_source>(fd, spec, rate);
+}
+
+const char* capture_source::help()
+{
+	return
+		"  SRC is a file or FIFO with what arecord -c 3 -f S24_3LE -t raw gives (- for stdin), or the device itself:\n"
+		"    device[:SERIAL]   the clock generator (the first one, or the one with this serial) through ALSA\n"
+		"    alsa:DEVICE       any ALSA capture device\n";
+}
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+// Where the 3 channel S24_3LE stream comes from: the device itself through ALSA, or a recording, a FIFO or stdin,
+// so the tools work the same on a capture made earlier
+class capture_source
+{
+public:
+	virtual ~capture_source() = default;
+
+	// whatever is there, at least one byte, 0 at the end or after an error
+	virtual size_t read(std::span<uint8_t> buf) = 0;
+	// ALSA overruns so far, the frames are gone (the tags show how many)
+	virtual uint64_t overruns() const { return 0; }
+	// frames per second, for a recording whatever open() was told, 0 if nobody knows
+	virtual unsigned rate() const { return 0; }
+	virtual const std::string& name() const = 0;
+
+	// device[:SERIAL] (rate 0 keeps the one the device has), alsa:DEVICE, or a path, - for stdin (rate is taken as is)
+	static std::unique_ptr<capture_source> open(const std::string& spec, unsigned rate, std::string& err);
+	static const char* help();
+};
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "controls.h"
+
+#include <cstdlib>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+
+#define CTL ((snd_ctl_t*)ctl)
+
+device_controls::~device_controls()
+{
+	if( ctl )
+		snd_ctl_close(CTL);
+}
+
+bool device_controls::open(const device_info& dev, std::string& err)
+{
+	if( dev.alsa_card < 0 )
+	{
+		err = dev.serial + ": no ALSA card, is snd-usb-audio loaded?";
+		return false;
+	}
+	snd_ctl_t* c;
+	int r = snd_ctl_open(&c, dev.alsa_device().c_str(), 0);
+	if( r < 0 )
+	{
+		err = dev.alsa_device() + ": " + snd_strerror(r);
+		return false;
+	}
+	ctl = c;
+	return true;
+}
+
+std::vector<std::string> device_controls::names()
+{
+	std::vector<std::string> list;
+	snd_ctl_elem_list_t* l;
+	snd_ctl_elem_list_alloca(&l);
+	if( snd_ctl_elem_list(CTL, l) < 0 )
+		return list;
+	unsigned n = snd_ctl_elem_list_get_count(l);
+	if( snd_ctl_elem_list_alloc_space(l, n) < 0 )
+		return list;
+	if( snd_ctl_elem_list(CTL, l) >= 0 )
+		for(unsigned i=0; i<snd_ctl_elem_list_get_used(l); ++i)
+			list.push_back(snd_ctl_elem_list_get_name(l, i));
+	snd_ctl_elem_list_free_space(l);
+	return list;
+}
+
+// mixer controls by name, the index is always 0 on this device
+static bool find(snd_ctl_t* c, const std::string& name, snd_ctl_elem_id_t* id, snd_ctl_elem_info_t* info, std::string& err)
+{
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, name.c_str());
+	snd_ctl_elem_info_set_id(info, id);
+	int r = snd_ctl_elem_info(c, info);
+	if( r < 0 )
+	{
+		err = name + ": " + snd_strerror(r);
+		return false;
+	}
+	return true;
+}
+
+bool device_controls::set(const std::string& name, const std::string& value, std::string& err)
+{
+	snd_ctl_elem_id_t* id;
+	snd_ctl_elem_info_t* info;
+	snd_ctl_elem_value_t* v;
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&v);
+	if( !find(CTL, name, id, info, err) )
+		return false;
+	snd_ctl_elem_value_set_id(v, id);
+
+	long n;
+	switch( snd_ctl_elem_info_get_type(info) )
+	{
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		if( value != "on" && value != "off" )
+		{
+			err = name + ": on or off";
+			return false;
+		}
+		n = (value == "on") ? 1 : 0;
+		break;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+	{
+		unsigned items = snd_ctl_elem_info_get_items(info);
+		n = -1;
+		for(unsigned i=0; i<items && n<0; ++i)
+		{
+			snd_ctl_elem_info_set_item(info, i);
+			if( snd_ctl_elem_info(CTL, info) >= 0 && value == snd_ctl_elem_info_get_item_name(info) )
+				n = i;
+		}
+		if( n < 0 )
+		{
+			char* end;
+			n = strtol(value.c_str(), &end, 0);
+			if( *end || n < 0 || n >= (long)items )
+			{
+				err = name + ": no item '" + value + "'";
+				return false;
+			}
+		}
+		break;
+	}
+	default:
+		n = strtol(value.c_str(), nullptr, 0);
+		break;
+	}
+
+	// all channels of it, like amixer
+	for(unsigned ch=0; ch<snd_ctl_elem_info_get_count(info); ++ch)
+	{
+		if( snd_ctl_elem_info_get_type(info) == SND_CTL_ELEM_TYPE_BOOLEAN )
+			snd_ctl_elem_value_set_boolean(v, ch, n);
+		else if( snd_ctl_elem_info_get_type(info) == SND_CTL_ELEM_TYPE_ENUMERATED )
+			snd_ctl_elem_value_set_enumerated(v, ch, n);
+		else
+			snd_ctl_elem_value_set_integer(v, ch, n);
+	}
+	int r = snd_ctl_elem_write(CTL, v);
+	if( r < 0 )
+	{
+		err = name + ": " + snd_strerror(r);
+		return false;
+	}
+	return true;
+}
+
+bool device_controls::get(const std::string& name, std::string& value, std::string& err)
+{
+	snd_ctl_elem_id_t* id;
+	snd_ctl_elem_info_t* info;
+	snd_ctl_elem_value_t* v;
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&v);
+	if( !find(CTL, name, id, info, err) )
+		return false;
+	snd_ctl_elem_value_set_id(v, id);
+	int r = snd_ctl_elem_read(CTL, v);
+	if( r < 0 )
+	{
+		err = name + ": " + snd_strerror(r);
+		return false;
+	}
+
+	switch( snd_ctl_elem_info_get_type(info) )
+	{
+	case SND_CTL_ELEM_TYPE_BOOLEAN:
+		value = snd_ctl_elem_value_get_boolean(v, 0) ? "on" : "off";
+		break;
+	case SND_CTL_ELEM_TYPE_ENUMERATED:
+		snd_ctl_elem_info_set_item(info, snd_ctl_elem_value_get_enumerated(v, 0));
+		snd_ctl_elem_info(CTL, info);
+		value = snd_ctl_elem_info_get_item_name(info);
+		break;
+	default:
+		value = std::to_string(snd_ctl_elem_value_get_integer(v, 0));
+		break;
+	}
+	return true;
+}
+
+#else
+
+device_controls::~device_controls() {}
+
+bool device_controls::open(const device_info&, std::string& err)
+{
+	err = "built without ALSA, use amixer -c instead";
+	return false;
+}
+
+std::vector<std::string> device_controls::names() { return {}; }
+
+bool device_controls::set(const std::string&, const std::string&, std::string& err)
+{
+	err = "built without ALSA";
+	return false;
+}
+
+bool device_controls::get(const std::string&, std::string&, std::string& err)
+{
+	err = "built without ALSA";
+	return false;
+}
+
+#endif
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "device.h"
+
+// ALSA names of the controls, see firmware/src/usb_descriptors.c. Switches are on / off, selectors take the item name
+// off (muted) sends the debug status block instead of audio
+#define CLOCKGEN_CTL_AUDIO             "Audio Control Capture Switch"
+#define CLOCKGEN_CTL_SOURCE            "Source"
+#define CLOCKGEN_CTL_HEAD_SWITCH_START "Head Switch Start Capture Switch"
+#define CLOCKGEN_CTL_CLOCK0            "CXADC-Clock 0 Select"
+#define CLOCKGEN_CTL_CLOCK1            "CXADC-Clock 1 Select"
+
+// The mixer controls of the audio interface, what amixer -c does. Needs ALSA at build time
+class device_controls
+{
+public:
+	~device_controls();
+
+	bool open(const device_info& dev, std::string& err);
+	std::vector<std::string> names();
+
+	// on / off for a switch, the item name (or its number) for a selector, a number for anything else
+	bool set(const std::string& name, const std::string& value, std::string& err);
+	bool get(const std::string& name, std::string& value, std::string& err);
+
+	// the status block instead of the audio, see decode_status()
+	bool set_debug(bool debug, std::string& err) { return set(CLOCKGEN_CTL_AUDIO, debug ? "off" : "on", err); }
+
+private:
+	void* ctl = nullptr;
+};
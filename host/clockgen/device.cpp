@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "device.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+
+// see firmware/src/usb_descriptors.c
+static const char* const clockgen_vid = "1209";
+static const char* const clockgen_pid = "0001";
+
+static std::string read_attr(const std::string& dir, const char* name)
+{
+	std::ifstream f(dir + "/" + name);
+	std::string s;
+	std::getline(f, s);
+	return s;
+}
+
+// snd-usb-audio puts sound/cardN under the audio control interface, <dev>:1.0
+static int find_alsa_card(const std::string& dev_dir, const std::string& dev_name)
+{
+	std::string dir = dev_dir + "/" + dev_name + ":1.0/sound";
+	DIR* d = opendir(dir.c_str());
+	if( !d )
+		return -1;
+	int card = -1;
+	while( dirent* e = readdir(d) )
+	{
+		if( sscanf(e->d_name, "card%d", &card) == 1 )
+			break;
+	}
+	closedir(d);
+	return card;
+}
+
+std::string device_info::alsa_device() const
+{
+	return "hw:" + std::to_string(alsa_card);
+}
+
+std::vector<device_info> find_devices()
+{
+	std::vector<device_info> list;
+	DIR* d = opendir("/sys/bus/usb/devices");
+	if( !d )
+		return list;
+
+	while( dirent* e = readdir(d) )
+	{
+		std::string dir = std::string("/sys/bus/usb/devices/") + e->d_name;
+		if( read_attr(dir, "idVendor") != clockgen_vid || read_attr(dir, "idProduct") != clockgen_pid )
+			continue;
+
+		device_info info;
+		info.serial = read_attr(dir, "serial");
+		int bus = atoi(read_attr(dir, "busnum").c_str());
+		int dev = atoi(read_attr(dir, "devnum").c_str());
+		char path[64];
+		snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d", bus, dev);
+		info.usb_path = path;
+		info.alsa_card = find_alsa_card(dir, e->d_name);
+		info.git_sha = read_attr(dir + "/" + e->d_name + ":1.1", "interface");
+		list.push_back(info);
+	}
+	closedir(d);
+	return list;
+}
+
+bool find_device(const std::string& serial, device_info& info, std::string& err)
+{
+	for(const device_info& d : find_devices())
+	{
+		if( serial.empty() || d.serial == serial )
+		{
+			info = d;
+			return true;
+		}
+	}
+	err = serial.empty() ? "no clock generator found" : "no clock generator with serial " + serial;
+	return false;
+}
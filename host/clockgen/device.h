@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A connected clock generator as sysfs sees it, nothing is opened for this
+struct device_info
+{
+	std::string serial;
+	// usbdevfs node, see usb_device
+	std::string usb_path;
+	// ALSA card number of the audio interface, -1 if ALSA has none (snd-usb-audio not loaded)
+	int alsa_card = -1;
+	// the firmware build, the string of the streaming interface. Empty on older firmware
+	std::string git_sha;
+
+	// hw:N, what arecord -D and amixer -D take
+	std::string alsa_device() const;
+};
+
+// all clock generators, in sysfs order
+std::vector<device_info> find_devices();
+// the first one, or the one with this serial
+bool find_device(const std::string& serial, device_info& info, std::string& err);
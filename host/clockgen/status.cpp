@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "status.h"
+#include "controls.h"
+#include "stream_scanner.h"
+
+#include <type_traits>
+
+// a status block comes every buffer, give up if there is none in about a second
+#define STATUS_MAX_BYTES (78125 * STREAM_TAG_FRAME_BYTES)
+
+// every field of global_status_fields in order, a new one has to go here as well
+#define STATUS_FIELDS(X) \
+	X(si5351_init_success) \
+	X(pcm1802_activity_lrck) \
+	X(pcm1802_activity_bck) \
+	X(pcm1802_activity_data) \
+	X(pcm1802_out_of_sync_drops) \
+	X(pcm1802_rch_tmo_count) \
+	X(pcm1802_rch_tmo_value) \
+	X(main1_rxsample_tmo) \
+	X(main0_iso_latency_us) \
+	X(main0_iso_latency_max_us) \
+	X(main0_idle_permille) \
+	X(xip_code_layout) \
+	X(xip_ctr_hit) \
+	X(xip_ctr_acc) \
+	X(pcm1802_rx_fifo_peak) \
+	X(clock_sys_hz) \
+	X(clock_out0_hz) \
+	X(clock_out1_hz) \
+	X(pcm1802_rx_stall_events) \
+	X(pcm1802_rx_lost_frames) \
+	X(fifo_overload_events) \
+	X(fifo_dropped_buffers) \
+	X(fifo_overload_policy) \
+	X(head_switch_start_index) \
+	X(head_switch_start_timeouts) \
+	X(vendor_bytes_in) \
+	X(vendor_bytes_out) \
+	X(vendor_encode_max_us) \
+	X(pcm1802_lrck_hz) \
+	X(pcm1802_bck_hz) \
+	X(pcm1802_data_edges) \
+	X(pcm1802_sck_hz) \
+	X(pcm1802_activity_sck) \
+	X(sync_count) \
+	X(sync_index) \
+	X(stream_sample_rate) \
+	X(resample_taps) \
+	X(meter_ch0_peak) \
+	X(meter_ch1_peak) \
+	X(meter_ch0_rms) \
+	X(meter_ch1_rms) \
+	X(meter_ch0_dc) \
+	X(meter_ch1_dc) \
+	X(meter_ch0_clips) \
+	X(meter_ch1_clips) \
+	X(meter_head_switch_edges) \
+	X(meter_head_switch_period_min) \
+	X(meter_head_switch_period_max) \
+	X(meter_head_switch_period_avg) \
+	X(meter_windows) \
+	X(head_switch_stamps) \
+	X(head_switch_stamps_dropped) \
+	X(pcm1802_resync_attempts) \
+	X(pcm1802_resyncs) \
+	X(pcm1802_resync_lost_frames) \
+	X(pcm1802_resync_last_us) \
+	X(pcm1802_resync_max_us) \
+	X(fill_events) \
+	X(fill_frames) \
+
+// the struct is packed, so a missing one shows up in the size
+#define X(name) + sizeof(global_status_fields::name)
+static_assert(0 STATUS_FIELDS(X) == sizeof(global_status_fields), "a field of global_status_fields is missing in STATUS_FIELDS");
+#undef X
+
+template<typename T>
+static std::string field_value(T value)
+{
+	if constexpr( std::is_signed_v<T> )
+		return std::to_string((long long)value);
+	else
+		return std::to_string((unsigned long long)value);
+}
+
+std::vector<std::pair<std::string, std::string>> status_values(const global_status_fields& status)
+{
+	std::vector<std::pair<std::string, std::string>> list;
+#define X(name) list.emplace_back(#name, field_value(status.name));
+	STATUS_FIELDS(X)
+#undef X
+	return list;
+}
+
+void print_status(FILE* out, const global_status_fields& status)
+{
+	for(const auto& [name, value] : status_values(status))
+		fprintf(out, "%-32s %s\n", name.c_str(), value.c_str());
+}
+
+bool read_status(capture_source& src, global_status_fields& status)
+{
+	bool found = false;
+	stream_scanner scanner;
+	scanner.on_status = [&](const global_status_fields& s, uint64_t)
+	{
+		if( !found )
+			status = s;
+		found = true;
+	};
+	std::vector<uint8_t> buf(CLOCKGEN_BUFFER_BYTES * 16);
+	size_t n;
+	while( !found && scanner.bytes() < STATUS_MAX_BYTES && (n = src.read(buf)) > 0 )
+		scanner.feed({ buf.data(), n });
+	scanner.finish();
+	return found;
+}
+
+bool fetch_status(const device_info& dev, global_status_fields& status, std::string& err)
+{
+	device_controls ctl;
+	std::string audio;
+	// put it back the way it was, even if the status never came
+	if( !ctl.open(dev, err) || !ctl.get(CLOCKGEN_CTL_AUDIO, audio, err) || !ctl.set_debug(true, err) )
+		return false;
+
+	bool found = false;
+	std::unique_ptr<capture_source> src = capture_source::open("alsa:" + dev.alsa_device(), 0, err);
+	if( src && !(found = read_status(*src, status)) )
+		err = "no status block found";
+	src.reset();
+
+	std::string restore_err;
+	if( !ctl.set(CLOCKGEN_CTL_AUDIO, audio, restore_err) && found )
+	{
+		err = restore_err;
+		return false;
+	}
+	return found;
+}
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "capture.h"
+#include "device.h"
+#include "global_status.h"
+
+// every field with its value, same names as global_status.h and the ImHex pattern
+std::vector<std::pair<std::string, std::string>> status_values(const global_status_fields& status);
+// one "name value" line per field
+void print_status(FILE* out, const global_status_fields& status);
+
+// the first status block in what src gives, false if there was none in about a second of stream
+bool read_status(capture_source& src, global_status_fields& status);
+// switches the device to the debug stream for a moment, reads one status block and switches back
+bool fetch_status(const device_info& dev, global_status_fields& status, std::string& err);
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "stream_scanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(uint32_t) + sizeof(global_status_fields) <= CLOCKGEN_BUFFER_BYTES, "status block does not fit a buffer");
+
+static int32_t s24_le(const uint8_t* p)
+{
+	return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+}
+
+audio_frame decode_frame(const uint8_t* p)
+{
+	audio_frame f;
+	f.ch0 = s24_le(p);
+	f.ch1 = s24_le(p + 3);
+	f.tag_byte = p[STREAM_TAG_BYTE_OFFSET];
+	if( p[7] == 0 && p[8] == 0 )
+		f.head_switch = audio_frame::fill;
+	else
+		f.head_switch = (p[8] & 0x80) ? audio_frame::head_switch_low : audio_frame::head_switch_high;
+	return f;
+}
+
+bool decode_status(std::span<const uint8_t> buffer, global_status_fields& status)
+{
+	uint32_t magic;
+	if( buffer.size() < sizeof(magic) + sizeof(status) )
+		return false;
+	memcpy(&magic, buffer.data(), sizeof(magic));
+	if( magic != GLOBAL_STATUS_MAGIC_NUMBER )
+		return false;
+	memcpy(&status, buffer.data() + sizeof(magic), sizeof(status));
+	return true;
+}
+
+void stream_scanner::end_skip(uint64_t offset)
+{
+	if( !skipping )
+		return;
+	skipping = false;
+	if( on_skip )
+		on_skip(skip_start, offset - skip_start);
+}
+
+size_t stream_scanner::scan(const uint8_t* p, uint64_t offset)
+{
+	std::span<const uint8_t> buffer(p, CLOCKGEN_BUFFER_BYTES);
+
+	// cheap check on the first magic byte before the whole tag
+	stream_tag tag;
+	if( p[STREAM_TAG_BYTE_OFFSET] == (STREAM_TAG_MAGIC & 0xff) && stream_tag_extract(p, &tag) )
+	{
+		end_skip(offset);
+		++buffers;
+		if( on_buffer )
+			on_buffer(tag, buffer, offset);
+		return CLOCKGEN_BUFFER_BYTES;
+	}
+
+	global_status_fields status;
+	if( p[0] == (GLOBAL_STATUS_MAGIC_NUMBER & 0xff) && decode_status(buffer, status) )
+	{
+		end_skip(offset);
+		++status_buffers;
+		if( on_status )
+			on_status(status, offset);
+		return CLOCKGEN_BUFFER_BYTES;
+	}
+
+	if( !skipping )
+	{
+		skipping = true;
+		skip_start = offset;
+	}
+	++skipped_bytes;
+	return 1;
+}
+
+void stream_scanner::feed(std::span<const uint8_t> data)
+{
+	size_t pos = 0;
+	if( !pending.empty() )
+	{
+		// a buffer that starts in pending ends within the next CLOCKGEN_BUFFER_BYTES
+		size_t old = pending.size();
+		size_t take = std::min(data.size(), (size_t)CLOCKGEN_BUFFER_BYTES);
+		pending.insert(pending.end(), data.begin(), data.begin() + take);
+		size_t p = 0;
+		while( p < old && pending.size() - p >= CLOCKGEN_BUFFER_BYTES )
+			p += scan(pending.data() + p, base + p);
+
+		if( p < old )
+		{
+			// not enough yet, all of data is in pending
+			pending.erase(pending.begin(), pending.begin() + p);
+			base += p;
+			return;
+		}
+		pos = p - old;
+		base += old;
+		pending.clear();
+	}
+
+	while( data.size() - pos >= CLOCKGEN_BUFFER_BYTES )
+		pos += scan(data.data() + pos, base + pos);
+	pending.assign(data.begin() + pos, data.end());
+	base += pos;
+}
+
+void stream_scanner::finish()
+{
+	if( pending.empty() )
+	{
+		end_skip(base);
+		return;
+	}
+	if( !skipping )
+	{
+		skipping = true;
+		skip_start = base;
+	}
+	skipped_bytes += pending.size();
+	base += pending.size();
+	pending.clear();
+	end_skip(base);
+}
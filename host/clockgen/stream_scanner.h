@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "global_status.h"
+#include "stream_tag.h"
+
+// same as the firmware, one tag or status block per buffer
+#define CLOCKGEN_FRAMES_PER_BUFFER 96
+#define CLOCKGEN_BUFFER_BYTES      (CLOCKGEN_FRAMES_PER_BUFFER * STREAM_TAG_FRAME_BYTES)
+
+// One S24_3LE frame of the audio interface
+struct audio_frame
+{
+	int32_t ch0;
+	int32_t ch1;
+	// ch2 without the tag byte, 0x7fff / 0x8000 for the head switch, 0x0000 for a fill frame (see STREAM_TAG_FLAG_FILL)
+	enum : uint8_t { head_switch_low, head_switch_high, fill } head_switch;
+	uint8_t tag_byte;
+};
+
+audio_frame decode_frame(const uint8_t* p);
+
+// A buffer of the debug stream (Audio Control Capture Switch off): the magic and global_status_fields
+bool decode_status(std::span<const uint8_t> buffer, global_status_fields& status);
+
+// Finds the tagged buffers and the status buffers in a S24_3LE byte stream. Whatever went missing need not be whole
+// frames, so anything else is skipped byte by byte. The callbacks get the buffer in place as long as it is in one
+// piece in what was fed, only the ones across two feed() calls are copied.
+class stream_scanner
+{
+public:
+	// offset is the byte offset of the buffer in everything fed so far
+	std::function<void(const stream_tag& tag, std::span<const uint8_t> frames, uint64_t offset)> on_buffer;
+	std::function<void(const global_status_fields& status, uint64_t offset)> on_status;
+	// bytes skipped before a buffer at offset + bytes was found, or before the end
+	std::function<void(uint64_t offset, uint64_t bytes)> on_skip;
+
+	void feed(std::span<const uint8_t> data);
+	// whatever is left could not be a whole buffer anymore
+	void finish();
+
+	// everything fed so far
+	uint64_t bytes() const { return base + pending.size(); }
+
+	uint64_t buffers = 0;
+	uint64_t status_buffers = 0;
+	uint64_t skipped_bytes = 0;
+
+private:
+	// CLOCKGEN_BUFFER_BYTES if there was a buffer at p, 1 if not
+	size_t scan(const uint8_t* p, uint64_t offset);
+	void end_skip(uint64_t offset);
+
+	// bytes fed that are not scanned yet, they start at offset base
+	std::vector<uint8_t> pending;
+	uint64_t base = 0;
+	bool skipping = false;
+	uint64_t skip_start = 0;
+};
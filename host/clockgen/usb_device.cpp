@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "usb_device.h"
+#include "device.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/usbdevice_fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+usb_device::~usb_device()
+{
+	if( fd < 0 )
+		return;
+	if( claimed >= 0 )
+	{
+		unsigned itf = claimed;
+		ioctl(fd, USBDEVFS_RELEASEINTERFACE, &itf);
+	}
+	close(fd);
+}
+
+bool usb_device::open(const std::string& serial, std::string& err)
+{
+	device_info info;
+	if( !find_device(serial, info, err) )
+		return false;
+
+	fd = ::open(info.usb_path.c_str(), O_RDWR);
+	if( fd < 0 )
+	{
+		err = info.usb_path + ": " + strerror(errno);
+		return false;
+	}
+	dev_path = info.usb_path;
+	return true;
+}
+
+bool usb_device::claim_interface(unsigned itf, std::string& err)
+{
+	if( ioctl(fd, USBDEVFS_CLAIMINTERFACE, &itf) < 0 )
+	{
+		err = std::string("claim interface: ") + strerror(errno);
+		return false;
+	}
+	claimed = itf;
+	return true;
+}
+
+bool usb_device::control_out(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, std::string& err)
+{
+	usbdevfs_ctrltransfer c = {};
+	c.bRequestType = request_type;
+	c.bRequest = request;
+	c.wValue = value;
+	c.wIndex = index;
+	c.wLength = 0;
+	c.timeout = 1000;
+	c.data = nullptr;
+	if( ioctl(fd, USBDEVFS_CONTROL, &c) < 0 )
+	{
+		err = std::string("control request: ") + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+int usb_device::bulk_in(uint8_t ep, void* data, unsigned len, unsigned timeout_ms)
+{
+	usbdevfs_bulktransfer b = {};
+	b.ep = ep;
+	b.len = len;
+	b.timeout = timeout_ms;
+	b.data = data;
+	int r = ioctl(fd, USBDEVFS_BULK, &b);
+	if( r < 0 )
+		return (errno == ETIMEDOUT) ? 0 : -1;
+	return r;
+}
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Minimal access to the clock generator through usbdevfs, so there is no dependency on libusb.
+// The user needs write access to the device node, the same udev rule as for any libusb tool does it.
+class usb_device
+{
+public:
+	~usb_device();
+
+	// first device with the clock generator VID:PID, or the one with the given serial
+	bool open(const std::string& serial, std::string& err);
+	bool claim_interface(unsigned itf, std::string& err);
+	bool control_out(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, std::string& err);
+	// returns the bytes read, 0 on timeout, -1 on error
+	int bulk_in(uint8_t ep, void* data, unsigned len, unsigned timeout_ms);
+
+	const std::string& path() const { return dev_path; }
+
+private:
+	int fd = -1;
+	int claimed = -1;
+	std::string dev_path;
+};
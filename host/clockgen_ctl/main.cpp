@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Lists the clock generators, sets their controls and prints the debug status, see README.md
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+#include "controls.h"
+#include "device.h"
+#include "status.h"
+
+static int run_list()
+{
+	std::vector<device_info> devs = find_devices();
+	for(const device_info& d : devs)
+	{
+		printf("%s\t%s\t%s\t%s\n", d.serial.c_str(), d.usb_path.c_str(),
+			d.alsa_card < 0 ? "-" : d.alsa_device().c_str(), d.git_sha.empty() ? "-" : d.git_sha.c_str());
+	}
+	if( devs.empty() )
+	{
+		fprintf(stderr, "no devices found\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int run_status(const std::string& in)
+{
+	std::string err;
+	global_status_fields status;
+	std::unique_ptr<capture_source> src = capture_source::open(in, 0, err);
+	if( !src )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+	if( !read_status(*src, status) )
+	{
+		fprintf(stderr, "no status block found\n");
+		return 1;
+	}
+	print_status(stdout, status);
+	return 0;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] COMMAND\n", me);
+	printf("  --serial S       the device with this serial (default the first one)\n");
+	printf("  --in SRC         status: read the status from SRC, e.g. a capture made with the audio switched off\n");
+	printf("Commands:\n");
+	printf("  list             serial, usbdevfs node, ALSA device and firmware git sha of each device\n");
+	printf("  controls         names of the controls\n");
+	printf("  get NAME         value of a control\n");
+	printf("  set NAME VALUE   on / off for a switch, the item name for a selector\n");
+	printf("  status           switch to the debug stream for a moment and print the status block\n");
+	printf("Controls: '%s' '%s' '%s' '%s' '%s'\n", CLOCKGEN_CTL_AUDIO, CLOCKGEN_CTL_SOURCE,
+		CLOCKGEN_CTL_HEAD_SWITCH_START, CLOCKGEN_CTL_CLOCK0, CLOCKGEN_CTL_CLOCK1);
+	printf("%s", capture_source::help());
+}
+
+int main(int argc, char** argv)
+{
+	std::string serial;
+	std::string in;
+	std::vector<std::string> args;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "%s needs a value\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+		if( a == "--serial" )
+			serial = next();
+		else if( a == "--in" )
+			in = next();
+		else if( a == "-h" || a == "--help" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a.rfind("--", 0) == 0 )
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+		else
+			args.push_back(a);
+	}
+
+	if( args.empty() )
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	const std::string& cmd = args[0];
+	size_t want = (cmd == "get") ? 2 : (cmd == "set") ? 3 : 1;
+	if( cmd != "list" && cmd != "controls" && cmd != "get" && cmd != "set" && cmd != "status" )
+	{
+		fprintf(stderr, "unknown command '%s', see --help\n", cmd.c_str());
+		return 1;
+	}
+	if( args.size() != want )
+	{
+		fprintf(stderr, "%s takes %zu arguments, see --help\n", cmd.c_str(), want - 1);
+		return 1;
+	}
+
+	if( cmd == "list" )
+		return run_list();
+	// a recording needs no device
+	if( cmd == "status" && !in.empty() )
+		return run_status(in);
+
+	std::string err;
+	device_info dev;
+	device_controls ctl;
+	if( !find_device(serial, dev, err) || !ctl.open(dev, err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+
+	if( cmd == "status" )
+	{
+		global_status_fields status;
+		if( !fetch_status(dev, status, err) )
+		{
+			fprintf(stderr, "%s\n", err.c_str());
+			return 1;
+		}
+		print_status(stdout, status);
+		return 0;
+	}
+	if( cmd == "controls" )
+	{
+		for(const std::string& name : ctl.names())
+			printf("%s\n", name.c_str());
+		return 0;
+	}
+	if( cmd == "get" )
+	{
+		std::string value;
+		if( !ctl.get(args[1], value, err) )
+		{
+			fprintf(stderr, "%s\n", err.c_str());
+			return 1;
+		}
+		printf("%s\n", value.c_str());
+		return 0;
+	}
+	if( !ctl.set(args[1], args[2], err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Checks a capture of the test pattern source bit for bit, see README.md
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+#include "stream_scanner.h"
+#include "test_pattern.h"
+
+#define FRAMES_PER_BUFFER CLOCKGEN_FRAMES_PER_BUFFER
+#define CHANNELS          3
+#define BUFFER_BYTES      CLOCKGEN_BUFFER_BYTES
+
+// only the first few mismatches are printed
+#define MAX_REPORTS 10
+
+static const char* pattern_names[test_pattern_count] = { "counter", "noise", "sine" };
+
+struct verify_stats
+{
+	uint64_t buffers = 0;
+	uint64_t bad_buffers = 0;
+	uint64_t bad_frames = 0;
+	// buffers the device dropped (sequence), frames it lost (sample index, GAP flag set)
+	uint64_t dropped_buffers = 0;
+	uint64_t gap_frames = 0;
+	// sample index jumps without the GAP flag, these should never happen
+	uint64_t unmarked_gaps = 0;
+	// no tag where the next one was expected, bytes went missing between the device and here
+	uint64_t resyncs = 0;
+	uint64_t lost_buffers = 0;
+	uint64_t skipped_bytes = 0;
+	uint64_t reports = 0;
+};
+
+static void u24_le(uint8_t* p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+}
+
+static uint32_t get_u24_le(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+// number of frames in the buffer that do not match, the tag byte of ch2 is not part of the pattern
+static uint32_t check_buffer(test_pattern_kind kind, const uint8_t* frames, uint64_t index, uint32_t* first_bad)
+{
+	uint32_t bad = 0;
+	for(uint32_t i=0; i<FRAMES_PER_BUFFER; ++i)
+	{
+		const uint8_t* f = frames + i * STREAM_TAG_FRAME_BYTES;
+		uint32_t expected[CHANNELS];
+		test_pattern_frame(kind, index + i, expected);
+		bool ok = get_u24_le(f) == expected[0]
+			&& get_u24_le(f + 3) == expected[1]
+			&& (get_u24_le(f + 6) & ~0xffu) == (expected[2] & ~0xffu);
+		if( !ok && bad++ == 0 )
+			*first_bad = i;
+	}
+	return bad;
+}
+
+class verifier
+{
+public:
+	explicit verifier(int kind) : kind(kind)
+	{
+		scanner.on_buffer = [this](const stream_tag& tag, std::span<const uint8_t> frames, uint64_t)
+		{
+			buffer(tag, frames.data());
+		};
+		scanner.on_skip = [this](uint64_t, uint64_t bytes)
+		{
+			if( synced )
+			{
+				++stats.resyncs;
+				synced = false;
+			}
+			stats.skipped_bytes += bytes;
+		};
+	}
+
+	void feed(const uint8_t* data, size_t len)
+	{
+		scanner.feed({ data, len });
+	}
+
+	verify_stats stats;
+
+private:
+	void buffer(const stream_tag& tag, const uint8_t* frames)
+	{
+		if( kind < 0 )
+			detect(frames, tag.sample_index);
+
+		if( have_last )
+		{
+			uint32_t seq_delta = tag.sequence - last_sequence;
+			uint64_t expected_index = last_index + FRAMES_PER_BUFFER;
+			// after a resync the missing buffers were lost on the way, not by the device
+			if( seq_delta > 1 )
+				(synced ? stats.dropped_buffers : stats.lost_buffers) += seq_delta - 1;
+			if( tag.sample_index != expected_index )
+			{
+				// dropped buffers are not a gap, the frames in them were captured
+				uint64_t dropped_frames = (uint64_t)(seq_delta > 1 ? seq_delta - 1 : 0) * FRAMES_PER_BUFFER;
+				uint64_t jump = tag.sample_index - expected_index - dropped_frames;
+				if( tag.sample_index > expected_index + dropped_frames && (tag.flags & (STREAM_TAG_FLAG_GAP | STREAM_TAG_FLAG_START)) )
+					stats.gap_frames += jump;
+				else if( tag.sample_index != expected_index + dropped_frames )
+				{
+					++stats.unmarked_gaps;
+					report("sample index %llu after %llu without the gap flag\n", (unsigned long long)tag.sample_index, (unsigned long long)last_index);
+				}
+			}
+		}
+
+		uint32_t first_bad = 0;
+		uint32_t bad = (kind < 0) ? FRAMES_PER_BUFFER : check_buffer((test_pattern_kind)kind, frames, tag.sample_index, &first_bad);
+		++stats.buffers;
+		if( bad )
+		{
+			++stats.bad_buffers;
+			stats.bad_frames += bad;
+			report("buffer %u (sample index %llu): %u bad frames, first at %u\n",
+				tag.sequence, (unsigned long long)(tag.sample_index), bad, first_bad);
+		}
+
+		have_last = true;
+		synced = true;
+		last_sequence = tag.sequence;
+		last_index = tag.sample_index;
+	}
+
+	void detect(const uint8_t* frames, uint64_t index)
+	{
+		uint32_t unused;
+		for(int k=0; k<test_pattern_count; ++k)
+		{
+			if( check_buffer((test_pattern_kind)k, frames, index, &unused) == 0 )
+			{
+				kind = k;
+				fprintf(stderr, "detected pattern %s\n", pattern_names[k]);
+				return;
+			}
+		}
+	}
+
+	template<typename... Args>
+	void report(const char* fmt, Args... args)
+	{
+		if( stats.reports++ < MAX_REPORTS )
+			fprintf(stderr, fmt, args...);
+	}
+
+	int kind;
+	stream_scanner scanner;
+	bool synced = false;
+	bool have_last = false;
+	uint32_t last_sequence = 0;
+	uint64_t last_index = 0;
+};
+
+// writes what the device would send, for testing the verifier and the capture chain without a device
+static int run_generate(int kind, uint64_t frames)
+{
+	std::vector<uint8_t> buf(BUFFER_BYTES);
+	uint32_t sequence = 0;
+	for(uint64_t index=0; index<frames; index+=FRAMES_PER_BUFFER)
+	{
+		for(uint32_t i=0; i<FRAMES_PER_BUFFER; ++i)
+		{
+			uint32_t v[CHANNELS];
+			test_pattern_frame((test_pattern_kind)kind, index + i, v);
+			for(int ch=0; ch<CHANNELS; ++ch)
+				u24_le(buf.data() + i * STREAM_TAG_FRAME_BYTES + ch * 3, v[ch]);
+		}
+		stream_tag tag;
+		memset(&tag, 0, sizeof(tag));
+		tag.sequence = sequence++;
+		tag.sample_index = index;
+		stream_tag_embed(buf.data(), &tag);
+		if( fwrite(buf.data(), 1, buf.size(), stdout) != buf.size() )
+			return 1;
+	}
+	return 0;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] < capture.s24\n", me);
+	printf("  --in SRC         read from SRC instead of stdin\n");
+	printf("  --pattern P      counter, noise or sine (default detect from the first buffer)\n");
+	printf("  --generate N     write N frames of the pattern with tags to stdout instead\n");
+	printf("The input is 3 channel S24_3LE, as from arecord -c 3 -f S24_3LE -t raw or pcm_stream.\n");
+	printf("%s", capture_source::help());
+}
+
+int main(int argc, char** argv)
+{
+	int kind = -1;
+	long long generate = -1;
+	std::string in = "-";
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--pattern" )
+		{
+			std::string p = next();
+			for(int k=0; k<test_pattern_count; ++k)
+				if( p == pattern_names[k] )
+					kind = k;
+			if( kind < 0 )
+			{
+				fprintf(stderr, "unknown pattern '%s'\n", p.c_str());
+				return 1;
+			}
+		}
+		else if( a == "--generate" ) generate = atoll(next());
+		else if( a == "--in" )       in = next();
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( generate >= 0 )
+		return run_generate(kind < 0 ? test_pattern_counter : kind, (uint64_t)generate);
+
+	std::string err;
+	std::unique_ptr<capture_source> src = capture_source::open(in, 0, err);
+	if( !src )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+
+	verifier v(kind);
+	std::vector<uint8_t> buf(1 << 16);
+	size_t n;
+	while( (n = src->read(buf)) > 0 )
+		v.feed(buf.data(), n);
+
+	const verify_stats& s = v.stats;
+	fprintf(stderr, "%llu buffers, %llu bad (%llu frames), %llu dropped by the device, %llu gap frames, %llu unmarked gaps, %llu resyncs (%llu bytes skipped, %llu buffers lost)\n",
+		(unsigned long long)s.buffers, (unsigned long long)s.bad_buffers, (unsigned long long)s.bad_frames,
+		(unsigned long long)s.dropped_buffers, (unsigned long long)s.gap_frames, (unsigned long long)s.unmarked_gaps,
+		(unsigned long long)s.resyncs, (unsigned long long)s.skipped_bytes, (unsigned long long)s.lost_buffers);
+
+	if( s.buffers == 0 )
+	{
+		fprintf(stderr, "no tagged buffers found\n");
+		return 1;
+	}
+	return (s.bad_buffers || s.unmarked_gaps || s.resyncs) ? 2 : 0;
+}
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Round trip of the firmware PCM codec (pcm_codec.c) on inputs that are hard on it, see README.md
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "pcm_codec.h"
+
+// the USB layout, see usb_audio.h
+#define FRAMES   96
+#define CHANNELS 3
+// written after the block, an encoder that goes past PCM_CODEC_MAX_BLOCK_BYTES() changes them
+#define GUARD_BYTES 64
+#define GUARD_VALUE 0xa5
+
+#define PCM24_MIN (-0x800000)
+#define PCM24_MAX 0x7fffff
+
+// sample i of channel c
+using generator = std::function<int32_t(uint32_t i, uint32_t c)>;
+
+struct test_case
+{
+	const char* name;
+	uint16_t frames;
+	uint8_t channels;
+	generator sample;
+};
+
+// Order 1 with k = 20 from the residuals it counts, but two escapes at i < 3 it doesn't count and five counted ones
+// that the estimate leaves out, and 20 residuals with a unary part of 1 to use up the rest of the mean for k = 20.
+// The Rice coded channel comes out longer than verbatim plus the 4 bytes of slack in the bound
+static int32_t escapes_past_verbatim(uint32_t i, uint32_t)
+{
+	static const uint32_t toggles[] = { 10, 20, 30, 40, 50 };
+	bool high = (i == 1);
+	if( i >= 3 )
+		for(uint32_t t : toggles)
+			high = (i >= t) ? !high : high;
+	int32_t x = high ? PCM24_MAX : PCM24_MIN;
+	if( i >= 60 && i < 80 && (i & 1) )
+		x += high ? -600000 : 600000;
+	return x;
+}
+
+static std::vector<test_case> make_cases()
+{
+	static std::mt19937 rng(1);
+	std::vector<test_case> cases;
+	cases.push_back({ "silence", FRAMES, CHANNELS, [](uint32_t, uint32_t) { return 0; } });
+	cases.push_back({ "sine", FRAMES, CHANNELS, [](uint32_t i, uint32_t c)
+		{ return (int32_t)lround(0x600000 * sin(2 * M_PI * 1000 * i / 78125.0 + c)); } });
+	cases.push_back({ "full scale square", FRAMES, CHANNELS, [](uint32_t i, uint32_t) { return (i & 1) ? PCM24_MAX : PCM24_MIN; } });
+	cases.push_back({ "white noise", FRAMES, CHANNELS, [](uint32_t, uint32_t)
+		{ return (int32_t)(rng() & 0xffffff) - 0x800000; } });
+	cases.push_back({ "quiet noise", FRAMES, CHANNELS, [](uint32_t, uint32_t)
+		{ return (int32_t)(rng() & 0xff) - 0x80; } });
+	cases.push_back({ "head switch levels", FRAMES, CHANNELS, [](uint32_t i, uint32_t c)
+		{ return (c == 2) ? ((i / 40) & 1 ? PCM24_MAX & ~0xff : PCM24_MIN) : 0; } });
+	cases.push_back({ "escapes past verbatim, 1 channel", FRAMES, 1, escapes_past_verbatim });
+	cases.push_back({ "escapes past verbatim", FRAMES, CHANNELS, escapes_past_verbatim });
+	cases.push_back({ "escapes past verbatim, max frames", PCM_CODEC_MAX_FRAMES, PCM_CODEC_MAX_CHANNELS, escapes_past_verbatim });
+	return cases;
+}
+
+static void put24(uint8_t* p, int32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+}
+
+static bool run_case(const test_case& t, bool verbose)
+{
+	size_t raw_bytes = (size_t)t.frames * t.channels * 3;
+	std::vector<uint8_t> raw(raw_bytes);
+	for(uint32_t i=0; i<t.frames; ++i)
+		for(uint32_t c=0; c<t.channels; ++c)
+			put24(raw.data() + (i * t.channels + c) * 3, t.sample(i, c));
+
+	size_t max_block = PCM_CODEC_MAX_BLOCK_BYTES(t.frames, t.channels);
+	std::vector<uint8_t> block(max_block + GUARD_BYTES, GUARD_VALUE);
+	size_t n = pcm_codec_encode(raw.data(), t.frames, t.channels, block.data());
+
+	bool guard_ok = true;
+	for(size_t i=max_block; i<block.size(); ++i)
+		guard_ok = guard_ok && block[i] == GUARD_VALUE;
+
+	std::vector<uint8_t> decoded(raw_bytes);
+	uint16_t frames = 0;
+	uint8_t channels = 0;
+	size_t used = n ? pcm_codec_decode(block.data(), n, decoded.data(), decoded.size(), &frames, &channels) : 0;
+	bool round_trip = used == n && frames == t.frames && channels == t.channels && decoded == raw;
+
+	bool ok = n != 0 && n <= max_block && guard_ok && round_trip;
+	if( verbose || !ok )
+		printf("%-36s %4u x %u: %5zu bytes of %5zu max (%.2f)%s%s%s: %s\n", t.name, t.frames, t.channels, n, max_block,
+			(double)n / raw_bytes, (n > max_block) ? ", over the bound" : "", guard_ok ? "" : ", wrote past the bound",
+			round_trip ? "" : ", round trip differs", ok ? "PASS" : "FAIL");
+	return ok;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options]\n", me);
+	printf("  --quiet              only print failures\n");
+	printf("Encodes and decodes every test input, fails if a block is over PCM_CODEC_MAX_BLOCK_BYTES() or does not round trip.\n");
+}
+
+int main(int argc, char** argv)
+{
+	bool verbose = true;
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		if( a == "--quiet" )
+			verbose = false;
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	bool pass = true;
+	for(const test_case& t : make_cases())
+		pass = run_case(t, verbose) && pass;
+	return pass ? 0 : 2;
+}
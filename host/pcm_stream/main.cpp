@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Reads the compressed PCM stream from the vendor interface and writes plain S24_3LE, see README.md
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_monitor.h"
+#include "pcm_codec.h"
+#include "stream_tag.h"
+#include "usb_device.h"
+
+// see firmware/src/usb_descriptors.c and usb_vendor.h
+#define VENDOR_ITF        2
+#define VENDOR_EP_IN      0x82
+#define VENDOR_REQ_STREAM 0x01
+#define REQ_TYPE_VENDOR_INTERFACE_OUT 0x41
+
+// same as the firmware, used for --encode
+#define FRAMES_PER_BLOCK 96
+#define CHANNELS         3
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+	stop = 1;
+}
+
+struct stream_stats
+{
+	uint64_t blocks = 0;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	uint64_t skipped = 0;
+	// places where blocks were damaged, and the zero frames written for them
+	uint64_t damaged = 0;
+	uint64_t filled_frames = 0;
+	// of those, the ones where the count had to be estimated from the skipped bytes (no stream tags)
+	uint64_t estimated = 0;
+};
+
+// Finds and decodes blocks in a byte stream, a bad block costs one byte of resync.
+// The frames of damaged blocks are written as zeros so the output stays on the capture timeline: a block is one
+// tagged USB buffer, so the tag sequence says how many are missing, without tags it is estimated from the bytes skipped.
+class block_parser
+{
+public:
+	block_parser(FILE* out, audio_monitor* monitor) : out(out), monitor(monitor), frames(PCM_CODEC_MAX_FRAMES * PCM_CODEC_MAX_CHANNELS * 3) {}
+
+	bool feed(const uint8_t* data, size_t len)
+	{
+		pending.insert(pending.end(), data, data + len);
+		size_t pos = 0;
+		while( pending.size() - pos >= sizeof(pcm_codec_header) )
+		{
+			uint16_t n_frames;
+			uint8_t channels;
+			const uint8_t* p = pending.data() + pos;
+			size_t avail = pending.size() - pos;
+
+			pcm_codec_header h;
+			memcpy(&h, p, sizeof(h));
+			if( h.magic == PCM_CODEC_MAGIC && avail < sizeof(h) + h.payload_bytes )
+				break; // might be a block that is not complete yet
+
+			size_t used = pcm_codec_decode(p, avail, frames.data(), frames.size(), &n_frames, &channels);
+			if( used == 0 )
+			{
+				++stats.skipped;
+				++skip_run;
+				++pos;
+				continue;
+			}
+
+			size_t frame_bytes = (size_t)channels * 3;
+			stream_tag tag;
+			bool tagged = frame_bytes == STREAM_TAG_FRAME_BYTES && n_frames >= sizeof(stream_tag) && stream_tag_extract(frames.data(), &tag);
+			if( skip_run )
+			{
+				// a sequence that went back is a device that restarted, nothing to count by
+				uint32_t delta = tagged ? tag.sequence - sequence : 0;
+				uint64_t lost;
+				if( have_sequence && delta != 0 && delta < 0x80000000u )
+					lost = delta - 1;
+				else
+				{
+					lost = estimate_lost();
+					++stats.estimated;
+				}
+				++stats.damaged;
+				skip_run = 0;
+				if( !fill(lost * n_frames, frame_bytes) )
+					return false;
+			}
+			if( tagged )
+			{
+				have_sequence = true;
+				sequence = tag.sequence;
+			}
+
+			size_t n = (size_t)n_frames * frame_bytes;
+			if( !write(frames.data(), n) )
+				return false;
+			++stats.blocks;
+			stats.bytes_in += used;
+			stats.bytes_out += n;
+			last_frames = n_frames;
+			last_frame_bytes = frame_bytes;
+			pos += used;
+		}
+		pending.erase(pending.begin(), pending.begin() + pos);
+		return true;
+	}
+
+	// at the end of the input, what is left could not be a whole block anymore
+	bool finish()
+	{
+		stats.skipped += pending.size();
+		skip_run += pending.size();
+		pending.clear();
+		if( !skip_run )
+			return true;
+		++stats.damaged;
+		++stats.estimated;
+		uint64_t lost = estimate_lost();
+		skip_run = 0;
+		return fill(lost * last_frames, last_frame_bytes);
+	}
+
+	stream_stats stats;
+
+private:
+	bool write(const uint8_t* data, size_t n)
+	{
+		if( fwrite(data, 1, n, out) != n )
+			return false;
+		if( monitor )
+			monitor->push(data, n);
+		return true;
+	}
+
+	bool fill(uint64_t n_frames, size_t frame_bytes)
+	{
+		stats.filled_frames += n_frames;
+		uint64_t bytes = n_frames * frame_bytes;
+		std::vector<uint8_t> zeros(std::min<uint64_t>(bytes, 65536), 0);
+		while( bytes )
+		{
+			size_t n = (size_t)std::min<uint64_t>(bytes, zeros.size());
+			if( !write(zeros.data(), n) )
+				return false;
+			bytes -= n;
+		}
+		return true;
+	}
+
+	// blocks in skip_run bytes, at least one, from the average compressed block so far
+	uint64_t estimate_lost() const
+	{
+		uint64_t avg = stats.blocks ? stats.bytes_in / stats.blocks : skip_run;
+		uint64_t n = (skip_run + avg / 2) / (avg ? avg : 1);
+		return n ? n : 1;
+	}
+
+	bool have_sequence = false;
+	uint32_t sequence = 0;
+	uint64_t skip_run = 0;
+	// what the fill at the end goes by, the USB layout before the first block
+	uint64_t last_frames = FRAMES_PER_BLOCK;
+	size_t last_frame_bytes = STREAM_TAG_FRAME_BYTES;
+
+	FILE* out;
+	audio_monitor* monitor;
+	std::vector<uint8_t> pending;
+	std::vector<uint8_t> frames;
+};
+
+static void print_stats(const stream_stats& s)
+{
+	fprintf(stderr, "%llu blocks, %llu compressed bytes, %llu decoded bytes, ratio %.3f, %llu bytes skipped\n",
+		(unsigned long long)s.blocks, (unsigned long long)s.bytes_in, (unsigned long long)s.bytes_out,
+		s.bytes_out ? (double)s.bytes_in / s.bytes_out : 0.0, (unsigned long long)s.skipped);
+	if( s.damaged )
+		fprintf(stderr, "damaged in %llu places, %llu frames replaced by zeros (%llu places estimated without stream tags)\n",
+			(unsigned long long)s.damaged, (unsigned long long)s.filled_frames, (unsigned long long)s.estimated);
+}
+
+static int run_encode()
+{
+	std::vector<uint8_t> in(FRAMES_PER_BLOCK * CHANNELS * 3);
+	std::vector<uint8_t> out(PCM_CODEC_MAX_BLOCK_BYTES(FRAMES_PER_BLOCK, CHANNELS));
+	stream_stats s;
+	while( true )
+	{
+		size_t n = fread(in.data(), 1, in.size(), stdin);
+		size_t frames = n / (CHANNELS * 3);
+		if( frames == 0 )
+			break;
+		size_t m = pcm_codec_encode(in.data(), (uint16_t)frames, CHANNELS, out.data());
+		fwrite(out.data(), 1, m, stdout);
+		++s.blocks;
+		s.bytes_in += m;
+		s.bytes_out += frames * CHANNELS * 3;
+	}
+	print_stats(s);
+	return 0;
+}
+
+static int run_decode(audio_monitor* monitor)
+{
+	block_parser parser(stdout, monitor);
+	std::vector<uint8_t> buf(65536);
+	while( size_t n = fread(buf.data(), 1, buf.size(), stdin) )
+		if( !parser.feed(buf.data(), n) )
+			return 1;
+	if( !parser.finish() )
+		return 1;
+	print_stats(parser.stats);
+	return parser.stats.damaged ? 2 : 0;
+}
+
+static int run_capture(const std::string& serial, FILE* raw, audio_monitor* monitor)
+{
+	usb_device dev;
+	std::string err;
+	if( !dev.open(serial, err) || !dev.claim_interface(VENDOR_ITF, err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+	if( !dev.control_out(REQ_TYPE_VENDOR_INTERFACE_OUT, VENDOR_REQ_STREAM, 1, VENDOR_ITF, err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+	fprintf(stderr, "streaming from %s\n", dev.path().c_str());
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	block_parser parser(stdout, monitor);
+	std::vector<uint8_t> buf(16384);
+	int ret = 0;
+	while( !stop )
+	{
+		int n = dev.bulk_in(VENDOR_EP_IN, buf.data(), buf.size(), 500);
+		if( n < 0 )
+		{
+			if( !stop )
+			{
+				perror("bulk read");
+				ret = 1;
+			}
+			break;
+		}
+		if( raw && n > 0 )
+			fwrite(buf.data(), 1, n, raw);
+		if( !parser.feed(buf.data(), n) )
+			break; // stdout closed
+	}
+
+	dev.control_out(REQ_TYPE_VENDOR_INTERFACE_OUT, VENDOR_REQ_STREAM, 0, VENDOR_ITF, err);
+	print_stats(parser.stats);
+	return (ret == 0 && parser.stats.damaged) ? 2 : ret;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] > audio.s24\n", me);
+	printf("  --serial S     device with this serial number (default first one)\n");
+	printf("  --raw FILE     also keep the compressed stream\n");
+	printf("  --decode       compressed stream from stdin to S24_3LE on stdout\n");
+	printf("  --encode       3 channel S24_3LE from stdin to a compressed stream on stdout, same as the firmware\n");
+	printf("  --monitor SINK[,options]  also play the audio, resampled\n");
+	printf("The output is the same as arecord -c 3 -f S24_3LE -t raw would give.\n");
+	printf("%s", audio_monitor::help());
+}
+
+int main(int argc, char** argv)
+{
+	std::string serial, raw_file;
+	bool encode = false, decode = false, monitor = false;
+	audio_monitor::config monitor_cfg;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--serial" )      serial = next();
+		else if( a == "--raw" )    raw_file = next();
+		else if( a == "--encode" ) encode = true;
+		else if( a == "--decode" ) decode = true;
+		else if( a == "--monitor" )
+		{
+			std::string err;
+			if( !audio_monitor::parse(next(), monitor_cfg, err) )
+			{
+				fprintf(stderr, "%s\n", err.c_str());
+				return 1;
+			}
+			monitor = true;
+		}
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( encode )
+		return run_encode();
+
+	// the device rate is in the config, --monitor in= tells it for anything but 78125 Hz
+	std::unique_ptr<audio_monitor> mon;
+	if( monitor )
+		mon = std::make_unique<audio_monitor>(monitor_cfg);
+	if( decode )
+		return run_decode(mon.get());
+
+	FILE* raw = nullptr;
+	if( !raw_file.empty() && !(raw = fopen(raw_file.c_str(), "wb")) )
+	{
+		perror(raw_file.c_str());
+		return 1;
+	}
+	int ret = run_capture(serial, raw, mon.get());
+	if( raw )
+		fclose(raw);
+	return ret;
+}
@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Cycle level test bench for the PCM1802 PIO receiver, see README.md
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "pcm_signal.h"
+#include "pio_asm.h"
+#include "pio_sm.h"
+
+// PCM_PIO_ADC0_SYNC, the jmp pin of the program, away from the waveform pins
+#define BENCH_SYNC_GPIO 14
+
+#ifndef PIO_BENCH_DEFAULT_PROGRAM
+#define PIO_BENCH_DEFAULT_PROGRAM "pcm1802_fmt00.pio"
+#endif
+
+struct bench_settings
+{
+	std::string pio_file = PIO_BENCH_DEFAULT_PROGRAM;
+	std::string program;
+	double sys_hz = 120e6;
+	// GPIO inputs go through a 2 flip flop synchronizer before the PIO sees them
+	int sync_cycles = 2;
+	uint64_t frames = 2000;
+	// the sync input is high for one whole frame out of this many, low otherwise. 0 keeps it low
+	uint64_t sync_every = 50;
+	pcm_signal_settings signal;
+};
+
+struct bench_result
+{
+	uint64_t frames_expected = 0;
+	uint64_t words = 0;
+	uint64_t value_errors = 0;
+	uint64_t flag_errors = 0;
+	uint64_t sync_errors = 0;
+	uint64_t missing = 0;
+	uint64_t rx_dropped = 0;
+	std::vector<pio_wait_stats> waits;
+
+	bool pass() const
+	{
+		return value_errors == 0 && flag_errors == 0 && sync_errors == 0 && missing == 0 && rx_dropped == 0;
+	}
+};
+
+// pulses start and end with the frame, so the idle bits of its left channel always see the same level
+static bool sync_high(const bench_settings& s, int64_t frame)
+{
+	return s.sync_every && frame >= 0 && (uint64_t)frame % s.sync_every == s.sync_every / 2;
+}
+
+static bench_result run_bench(const pio_program_image& prog, const bench_settings& s)
+{
+	bench_result r;
+	pcm_signal sig(s.signal);
+	pio_sm_settings sm_cfg;
+	sm_cfg.jmp_pin = BENCH_SYNC_GPIO;
+	pio_sm_emu sm(prog, sm_cfg);
+
+	std::vector<uint32_t> words;
+	std::vector<uint32_t> sync(s.sync_cycles + 1, 0);
+	uint64_t cycles = (uint64_t)std::ceil((s.frames + 1) * sig.frame_period() * s.sys_hz);
+
+	for(uint64_t n=0; n<cycles; ++n)
+	{
+		double t = n / s.sys_hz;
+		// simple delay line for the input synchronizer
+		for(int i=s.sync_cycles; i>0; --i)
+			sync[i] = sync[i-1];
+		int64_t sig_frame = (int64_t)std::floor((t - s.signal.phase_ns * 1e-9) / sig.frame_period());
+		sync[0] = sig.levels(t) | (sync_high(s, sig_frame) ? (1u << BENCH_SYNC_GPIO) : 0);
+		sm.step(sync[s.sync_cycles]);
+
+		// core1 pops much faster than samples arrive, so the FIFO is drained right away
+		uint32_t w;
+		while( sm.rx_pop(w) )
+			words.push_back(w);
+	}
+
+	r.words = words.size();
+	r.rx_dropped = sm.rx_dropped;
+	r.waits = sm.wait_stats;
+
+	// the first complete left word starts the comparison
+	size_t i = 0;
+	while( i < words.size() && (words[i] & 0x01000000) )
+		++i;
+
+	int64_t frame = -1;
+	if( i < words.size() )
+	{
+		for(int64_t f=0; f<4; ++f)
+		{
+			if( sig.sample(f, 0) == (words[i] & 0xffffff) )
+			{
+				frame = f;
+				break;
+			}
+		}
+	}
+
+	if( frame < 0 )
+	{
+		// never locked
+		r.frames_expected = s.frames;
+		r.missing = s.frames * 2;
+		return r;
+	}
+
+	int64_t first = frame;
+	int ch = 0;
+	for(; i<words.size(); ++i)
+	{
+		uint32_t w = words[i];
+		int flag = (w >> 24) & 1;
+		uint32_t v = w & 0xffffff;
+
+		if( flag != ch || (w >> 26) != 0 )
+			++r.flag_errors;
+		// bit 25 is the sync input, only ever on a right word
+		int sync_bit = (w >> 25) & 1;
+		if( sync_bit != (ch == 1 && sync_high(s, frame)) )
+			++r.sync_errors;
+
+		if( v != sig.sample(frame, ch) )
+		{
+			++r.value_errors;
+			// try to find where we are again
+			for(int64_t f=frame-4; f<frame+8; ++f)
+			{
+				if( f >= 0 && sig.sample(f, flag) == v )
+				{
+					frame = f;
+					ch = flag;
+					break;
+				}
+			}
+		}
+
+		ch ^= 1;
+		if( ch == 0 )
+			++frame;
+	}
+
+	// the very last frame may have been cut short by the end of the simulation
+	r.frames_expected = s.frames - first - 1;
+	uint64_t got = frame - first;
+	r.missing = (got < r.frames_expected) ? (r.frames_expected - got) : 0;
+	return r;
+}
+
+static void print_result(const pio_program_image& prog, const bench_settings& s, const bench_result& r)
+{
+	double bck = s.signal.fs_hz * s.signal.bck_per_frame;
+	printf("sys clock      %.3f MHz\n", s.sys_hz / 1e6);
+	printf("fs             %.1f Hz, BCK %.3f MHz, %.2f cycles per bit\n", s.signal.fs_hz, bck / 1e6, s.sys_hz / bck);
+	printf("jitter/phase   %.1f ns / %.1f ns\n", s.signal.jitter_ns, s.signal.phase_ns);
+	printf("frames         %llu expected, %llu words pushed\n", (unsigned long long)r.frames_expected, (unsigned long long)r.words);
+	printf("errors         %llu value, %llu right channel flag, %llu sync flag, %llu frames missing, %llu pushes dropped\n",
+		(unsigned long long)r.value_errors, (unsigned long long)r.flag_errors, (unsigned long long)r.sync_errors,
+		(unsigned long long)r.missing, (unsigned long long)r.rx_dropped);
+	printf("wait margins (cycles stalled before the condition became true)\n");
+	for(size_t pc=0; pc<r.waits.size(); ++pc)
+	{
+		const pio_wait_stats& w = r.waits[pc];
+		if( w.executions == 0 )
+			continue;
+		printf("  %2zu %-40s min %4llu avg %7.1f max %6llu\n", pc, prog.source[pc].c_str(),
+			(unsigned long long)w.stall_min, (double)w.stall_total / w.executions, (unsigned long long)w.stall_max);
+	}
+	printf("result         %s\n", r.pass() ? "PASS" : "FAIL");
+}
+
+static uint64_t bit_margin(const pio_program_image& prog, const bench_result& r)
+{
+	// smallest slack in front of a rising edge on the bit clock, the data is sampled right after it so this runs out first
+	auto bck = prog.defines.find("pcm1802_index_bitclk");
+	int bck_index = (bck != prog.defines.end()) ? bck->second : 1;
+	uint16_t wait_rising_bck = 0x2000 | (1 << 7) | (1 << 5) | bck_index;
+
+	uint64_t m = UINT64_MAX;
+	for(size_t pc=0; pc<r.waits.size(); ++pc)
+	{
+		if( r.waits[pc].executions == 0 )
+			continue;
+		if( (prog.instructions[pc] & 0xe0ff) != wait_rising_bck )
+			continue;
+		if( r.waits[pc].stall_min < m )
+			m = r.waits[pc].stall_min;
+	}
+	return m;
+}
+
+static void sweep(const pio_program_image& prog, bench_settings s, double fs_start, double fs_stop, double fs_step)
+{
+	printf("%12s %10s %10s %8s %s\n", "fs [Hz]", "BCK [MHz]", "cyc/bit", "margin", "result");
+	double last_pass = 0;
+	bool failed = false;
+	for(double fs=fs_start; fs<=fs_stop; fs+=fs_step)
+	{
+		s.signal.fs_hz = fs;
+		bench_result r = run_bench(prog, s);
+		uint64_t m = bit_margin(prog, r);
+		double bck = fs * s.signal.bck_per_frame;
+		printf("%12.1f %10.3f %10.2f %8lld %s\n", fs, bck / 1e6, s.sys_hz / bck, (m == UINT64_MAX) ? -1ll : (long long)m, r.pass() ? "PASS" : "FAIL");
+		if( r.pass() && !failed )
+			last_pass = fs;
+		if( !r.pass() )
+			failed = true;
+	}
+	printf("max fs before the first failure at %.3f MHz: %.1f Hz\n", s.sys_hz / 1e6, last_pass);
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options]\n", me);
+	printf("  --pio FILE            .pio source (default %s)\n", PIO_BENCH_DEFAULT_PROGRAM);
+	printf("  --program NAME        program in the file (default first)\n");
+	printf("  --sys-mhz F           state machine clock (default 120)\n");
+	printf("  --fs HZ               sample rate (default 78125)\n");
+	printf("  --bck-per-frame N     bit clocks per frame (default 64)\n");
+	printf("  --format lj|i2s       serial format (default lj = PCM1802 format 00)\n");
+	printf("  --jitter-ns NS        gaussian edge jitter, 1 sigma (default 0)\n");
+	printf("  --phase-ns NS         waveform phase against the state machine clock (default 0)\n");
+	printf("  --sync N              input synchronizer delay in cycles (default 2)\n");
+	printf("  --frames N            frames to simulate (default 2000)\n");
+	printf("  --seed N              random seed for data and jitter (default 1)\n");
+	printf("  --sync-every N        pulse the sync input (GPIO%d) for one frame in N (default 50, 0 = always low)\n", BENCH_SYNC_GPIO);
+	printf("  --sweep A:B:STEP      sweep fs from A to B and report the maximum passing rate\n");
+}
+
+int main(int argc, char** argv)
+{
+	bench_settings s;
+	bool do_sweep = false;
+	double sw_a = 0, sw_b = 0, sw_step = 0;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--pio" )                s.pio_file = next();
+		else if( a == "--program" )       s.program = next();
+		else if( a == "--sys-mhz" )       s.sys_hz = atof(next()) * 1e6;
+		else if( a == "--fs" )            s.signal.fs_hz = atof(next());
+		else if( a == "--bck-per-frame" ) s.signal.bck_per_frame = atoi(next());
+		else if( a == "--jitter-ns" )     s.signal.jitter_ns = atof(next());
+		else if( a == "--phase-ns" )      s.signal.phase_ns = atof(next());
+		else if( a == "--sync" )          s.sync_cycles = atoi(next());
+		else if( a == "--frames" )        s.frames = strtoull(next(), nullptr, 0);
+		else if( a == "--seed" )          s.signal.seed = strtoull(next(), nullptr, 0);
+		else if( a == "--sync-every" )    s.sync_every = strtoull(next(), nullptr, 0);
+		else if( a == "--format" )
+		{
+			std::string f = next();
+			if( f == "lj" )       s.signal.format = pcm_format::left_justified;
+			else if( f == "i2s" ) s.signal.format = pcm_format::i2s;
+			else { fprintf(stderr, "unknown format '%s'\n", f.c_str()); return 1; }
+		}
+		else if( a == "--sweep" )
+		{
+			if( sscanf(next(), "%lf:%lf:%lf", &sw_a, &sw_b, &sw_step) != 3 || sw_step <= 0 )
+			{
+				fprintf(stderr, "bad sweep, expected A:B:STEP\n");
+				return 1;
+			}
+			do_sweep = true;
+		}
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( s.signal.bck_per_frame < 50 || (s.signal.bck_per_frame & 1) )
+	{
+		fprintf(stderr, "need an even number of at least 50 bit clocks per frame for 24 bit samples\n");
+		return 1;
+	}
+
+	pio_program_image prog;
+	std::string err;
+	if( !pio_asm_load(s.pio_file, s.program, prog, err) )
+	{
+		fprintf(stderr, "%s: %s\n", s.pio_file.c_str(), err.c_str());
+		return 1;
+	}
+
+	printf("program        %s, %zu instructions\n", prog.name.c_str(), prog.instructions.size());
+
+	if( do_sweep )
+	{
+		sweep(prog, s, sw_a, sw_b, sw_step);
+		return 0;
+	}
+
+	bench_result r = run_bench(prog, s);
+	print_result(prog, s, r);
+	return r.pass() ? 0 : 2;
+}
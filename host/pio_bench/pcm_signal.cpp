@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "pcm_signal.h"
+
+#include <cmath>
+
+namespace
+{
+
+// counter based random numbers, so every edge can be looked up in any order without keeping state
+uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+double uniform(uint64_t key)
+{
+	// (0, 1]
+	return ((splitmix64(key) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+}
+
+pcm_signal::pcm_signal(const pcm_signal_settings& settings)
+	: cfg(settings)
+{
+	cell = 1.0 / (cfg.fs_hz * cfg.bck_per_frame);
+	phase = cfg.phase_ns * 1e-9;
+	jitter_max = cell / 4;
+}
+
+double pcm_signal::edge_jitter(int64_t c, int which) const
+{
+	if( cfg.jitter_ns <= 0 )
+		return 0;
+
+	// Box-Muller
+	uint64_t key = (cfg.seed << 48) ^ ((uint64_t)c << 1) ^ (uint64_t)which;
+	double u1 = uniform(key * 2);
+	double u2 = uniform(key * 2 + 1);
+	double j = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2) * cfg.jitter_ns * 1e-9;
+
+	if( j > jitter_max )  j = jitter_max;
+	if( j < -jitter_max ) j = -jitter_max;
+	return j;
+}
+
+double pcm_signal::fall(int64_t c) const
+{
+	return c * cell + phase + edge_jitter(c, 0);
+}
+
+double pcm_signal::rise(int64_t c) const
+{
+	return (c + 0.5) * cell + phase + edge_jitter(c, 1);
+}
+
+uint32_t pcm_signal::sample(uint64_t frame, int channel) const
+{
+	return (uint32_t)splitmix64(~cfg.seed ^ (frame * 2 + channel)) & 0xffffff;
+}
+
+uint32_t pcm_signal::levels(double t) const
+{
+	// find the bit cell we are in, the jittered edges may have moved the boundary
+	int64_t c = (int64_t)std::floor((t - phase) / cell);
+	if( t < fall(c) )
+		--c;
+	else if( t >= fall(c + 1) )
+		++c;
+
+	if( c < 0 )
+		return 0;
+
+	uint32_t ret = 0;
+	if( t >= rise(c) )
+		ret |= PCM_SIGNAL_BIT_BITCLK;
+
+	int64_t frame = c / cfg.bck_per_frame;
+	int bit = (int)(c % cfg.bck_per_frame);
+	int half = cfg.bck_per_frame / 2;
+	int channel = (bit < half) ? 0 : 1;
+	int pos = bit % half;
+
+	if( cfg.format == pcm_format::left_justified )
+	{
+		if( channel == 0 )
+			ret |= PCM_SIGNAL_BIT_LRCLK;
+	}
+	else
+	{
+		if( channel == 1 )
+			ret |= PCM_SIGNAL_BIT_LRCLK;
+		// I2S: MSB one bit clock after the LRCK edge, the last bit of the previous word falls into the new half
+		if( pos == 0 )
+			return ret;
+		pos -= 1;
+	}
+
+	if( pos < 24 )
+	{
+		uint32_t v = sample(frame, channel);
+		if( (v >> (23 - pos)) & 1 )
+			ret |= PCM_SIGNAL_BIT_DATA;
+	}
+
+	return ret;
+}
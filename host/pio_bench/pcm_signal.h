@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _PCM_SIGNAL_H
+#define _PCM_SIGNAL_H
+
+#include <cstdint>
+
+// Generates the PCM1802 serial output lines as a function of time.
+// Every bit cell starts with a falling edge on BCK, data and LRCK change on that edge,
+// the rising edge in the middle of the cell is where the receiver samples.
+enum class pcm_format
+{
+	// PCM1802 format 00, 24 bit left justified, LRCK high is the left channel
+	left_justified,
+	// 24 bit I2S, data delayed by one bit clock, LRCK low is the left channel
+	i2s,
+};
+
+struct pcm_signal_settings
+{
+	pcm_format format = pcm_format::left_justified;
+	double fs_hz = 78125;
+	// 512 fs master mode gives 64 bit clocks per frame
+	int bck_per_frame = 64;
+	// gaussian edge jitter (1 sigma), clamped to a quarter bit cell
+	double jitter_ns = 0;
+	// offset of the whole waveform against the receiver clock
+	double phase_ns = 0;
+	uint64_t seed = 1;
+};
+
+// pin bits relative to the first PIO input pin, the same order as in pcm1802_fmt00.pio
+#define PCM_SIGNAL_BIT_DATA   (1u << 0)
+#define PCM_SIGNAL_BIT_BITCLK (1u << 1)
+#define PCM_SIGNAL_BIT_LRCLK  (1u << 2)
+
+class pcm_signal
+{
+public:
+	explicit pcm_signal(const pcm_signal_settings& settings);
+
+	// level of all lines at time t (seconds)
+	uint32_t levels(double t) const;
+
+	// the 24 bit value sent in frame 'frame' on channel 0 (left) or 1 (right)
+	uint32_t sample(uint64_t frame, int channel) const;
+
+	double frame_period() const { return 1.0 / cfg.fs_hz; }
+
+private:
+	double edge_jitter(int64_t cell, int which) const;
+	double fall(int64_t cell) const;
+	double rise(int64_t cell) const;
+
+	pcm_signal_settings cfg;
+	double cell;
+	double phase;
+	double jitter_max;
+};
+
+#endif
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "pio_asm.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// See RP2040 datasheet, 3.4 "Instruction Set"
+#define OP_JMP  0x0000
+#define OP_WAIT 0x2000
+#define OP_IN   0x4000
+#define OP_OUT  0x6000
+#define OP_PUSH 0x8000
+#define OP_PULL 0x8080
+#define OP_MOV  0xa000
+#define OP_IRQ  0xc000
+#define OP_SET  0xe000
+
+namespace
+{
+
+struct source_line
+{
+	int number;
+	std::string text;
+	std::vector<std::string> tokens;
+};
+
+std::string strip_comment(const std::string& line)
+{
+	std::string ret = line;
+	size_t pos = ret.find(';');
+	if( pos != std::string::npos )
+		ret.resize(pos);
+	pos = ret.find("//");
+	if( pos != std::string::npos )
+		ret.resize(pos);
+	return ret;
+}
+
+std::vector<std::string> tokenize(const std::string& line)
+{
+	// commas are just separators for us, the brackets of a delay are kept as their own token
+	std::vector<std::string> ret;
+	std::string cur;
+	for(char c : line)
+	{
+		if( std::isspace((unsigned char)c) || c == ',' )
+		{
+			if( !cur.empty() ) ret.push_back(cur);
+			cur.clear();
+		}
+		else if( c == '[' || c == ']' )
+		{
+			if( !cur.empty() ) ret.push_back(cur);
+			cur.clear();
+			ret.push_back(std::string(1, c));
+		}
+		else
+		{
+			cur += c;
+		}
+	}
+	if( !cur.empty() ) ret.push_back(cur);
+	return ret;
+}
+
+std::string lower(std::string s)
+{
+	for(auto& c : s) c = std::tolower((unsigned char)c);
+	return s;
+}
+
+class assembler
+{
+public:
+	assembler(pio_program_image& img, std::string& err) : img(img), err(err) { }
+
+	bool value(const std::string& tok, int& out)
+	{
+		if( tok.empty() )
+			return fail("empty value");
+
+		char* end = nullptr;
+		long v = std::strtol(tok.c_str(), &end, 0);
+		if( *end == 0 )
+		{
+			out = (int)v;
+			return true;
+		}
+
+		auto d = img.defines.find(tok);
+		if( d != img.defines.end() )
+		{
+			out = d->second;
+			return true;
+		}
+
+		auto l = img.labels.find(tok);
+		if( l != img.labels.end() )
+		{
+			out = l->second;
+			return true;
+		}
+
+		return fail("unknown symbol '" + tok + "'");
+	}
+
+	bool encode(const source_line& line, uint16_t& out)
+	{
+		cur_line = line.number;
+		std::vector<std::string> t = line.tokens;
+
+		// optional delay at the end "[n]"
+		int delay = 0;
+		if( t.size() >= 3 && t[t.size()-1] == "]" && t[t.size()-3] == "[" )
+		{
+			if( !value(t[t.size()-2], delay) ) return false;
+			if( delay < 0 || delay > 31 ) return fail("delay out of range");
+			t.resize(t.size()-3);
+		}
+
+		std::string op = lower(t[0]);
+		uint16_t ins = 0;
+
+		if( op == "nop" )
+		{
+			ins = OP_MOV | (2 << 5) | 2; // mov y, y
+		}
+		else if( op == "jmp" )
+		{
+			static const std::map<std::string, int> conds = {
+				{ "!x", 1 }, { "x--", 2 }, { "!y", 3 }, { "y--", 4 }, { "x!=y", 5 }, { "pin", 6 }, { "!osre", 7 },
+			};
+			int cond = 0;
+			size_t target_idx = 1;
+			if( t.size() == 3 )
+			{
+				auto c = conds.find(lower(t[1]));
+				if( c == conds.end() ) return fail("unknown jmp condition '" + t[1] + "'");
+				cond = c->second;
+				target_idx = 2;
+			}
+			else if( t.size() != 2 )
+			{
+				return fail("bad jmp");
+			}
+			int addr;
+			if( !value(t[target_idx], addr) ) return false;
+			ins = OP_JMP | (cond << 5) | (addr & 0x1f);
+		}
+		else if( op == "wait" )
+		{
+			if( t.size() < 4 ) return fail("bad wait");
+			int pol, idx;
+			if( !value(t[1], pol) || !value(t[3], idx) ) return false;
+			std::string src = lower(t[2]);
+			int s;
+			if( src == "gpio" ) s = 0;
+			else if( src == "pin" ) s = 1;
+			else if( src == "irq" ) s = 2;
+			else return fail("unknown wait source '" + src + "'");
+			if( t.size() == 5 && lower(t[4]) == "rel" ) idx |= 0x10;
+			ins = OP_WAIT | ((pol & 1) << 7) | (s << 5) | (idx & 0x1f);
+		}
+		else if( op == "in" || op == "out" )
+		{
+			if( t.size() != 3 ) return fail("bad " + op);
+			static const std::map<std::string, int> in_src = {
+				{ "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "isr", 6 }, { "osr", 7 },
+			};
+			static const std::map<std::string, int> out_dst = {
+				{ "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "pindirs", 4 }, { "pc", 5 }, { "isr", 6 }, { "exec", 7 },
+			};
+			const auto& table = (op == "in") ? in_src : out_dst;
+			auto s = table.find(lower(t[1]));
+			if( s == table.end() ) return fail("unknown " + op + " operand '" + t[1] + "'");
+			int count;
+			if( !value(t[2], count) ) return false;
+			if( count < 1 || count > 32 ) return fail("bit count out of range");
+			ins = ((op == "in") ? OP_IN : OP_OUT) | (s->second << 5) | (count & 0x1f);
+		}
+		else if( op == "push" || op == "pull" )
+		{
+			bool block = true;
+			bool cond = false;
+			for(size_t i=1; i<t.size(); ++i)
+			{
+				std::string a = lower(t[i]);
+				if( a == "block" ) block = true;
+				else if( a == "noblock" ) block = false;
+				else if( a == "iffull" || a == "ifempty" ) cond = true;
+				else return fail("unknown " + op + " argument '" + a + "'");
+			}
+			ins = ((op == "push") ? OP_PUSH : OP_PULL) | (cond ? 0x40 : 0) | (block ? 0x20 : 0);
+		}
+		else if( op == "mov" )
+		{
+			if( t.size() != 3 ) return fail("bad mov");
+			static const std::map<std::string, int> dst = {
+				{ "pins", 0 }, { "x", 1 }, { "y", 2 }, { "exec", 4 }, { "pc", 5 }, { "isr", 6 }, { "osr", 7 },
+			};
+			static const std::map<std::string, int> src = {
+				{ "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "status", 5 }, { "isr", 6 }, { "osr", 7 },
+			};
+			auto d = dst.find(lower(t[1]));
+			if( d == dst.end() ) return fail("unknown mov destination '" + t[1] + "'");
+			std::string s = lower(t[2]);
+			int mop = 0;
+			if( s.rfind("::", 0) == 0 ) { mop = 2; s = s.substr(2); }
+			else if( s[0] == '!' || s[0] == '~' ) { mop = 1; s = s.substr(1); }
+			auto sv = src.find(s);
+			if( sv == src.end() ) return fail("unknown mov source '" + s + "'");
+			ins = OP_MOV | (d->second << 5) | (mop << 3) | sv->second;
+		}
+		else if( op == "set" )
+		{
+			if( t.size() != 3 ) return fail("bad set");
+			static const std::map<std::string, int> dst = {
+				{ "pins", 0 }, { "x", 1 }, { "y", 2 }, { "pindirs", 4 },
+			};
+			auto d = dst.find(lower(t[1]));
+			if( d == dst.end() ) return fail("unknown set destination '" + t[1] + "'");
+			int v;
+			if( !value(t[2], v) ) return false;
+			if( v < 0 || v > 31 ) return fail("set value out of range");
+			ins = OP_SET | (d->second << 5) | v;
+		}
+		else if( op == "irq" )
+		{
+			bool clr = false, wait = false;
+			size_t i = 1;
+			for(; i<t.size()-1; ++i)
+			{
+				std::string a = lower(t[i]);
+				if( a == "clear" ) clr = true;
+				else if( a == "wait" ) wait = true;
+				else if( a == "set" || a == "nowait" ) { }
+				else break;
+			}
+			int idx;
+			if( !value(t[i], idx) ) return false;
+			if( i+1 < t.size() && lower(t[i+1]) == "rel" ) idx |= 0x10;
+			ins = OP_IRQ | (clr ? 0x40 : 0) | (wait ? 0x20 : 0) | (idx & 0x1f);
+		}
+		else
+		{
+			return fail("unknown instruction '" + op + "'");
+		}
+
+		out = ins | (delay << 8);
+		return true;
+	}
+
+	bool fail(const std::string& msg)
+	{
+		err = "line " + std::to_string(cur_line) + ": " + msg;
+		return false;
+	}
+
+	int cur_line = 0;
+
+private:
+	pio_program_image& img;
+	std::string& err;
+};
+
+}
+
+bool pio_asm_load(const std::string& path, const std::string& program, pio_program_image& out, std::string& error)
+{
+	std::ifstream in(path);
+	if( !in )
+	{
+		error = "can't open '" + path + "'";
+		return false;
+	}
+
+	out = pio_program_image();
+	assembler as(out, error);
+
+	// first pass: collect defines and labels, and the instruction lines of our program
+	std::vector<source_line> lines;
+	std::string current;
+	bool selected = false;
+	bool done = false;
+	int number = 0;
+	std::string text;
+
+	while( std::getline(in, text) )
+	{
+		++number;
+		as.cur_line = number;
+		std::vector<std::string> t = tokenize(strip_comment(text));
+		if( t.empty() )
+			continue;
+
+		if( t[0] == ".program" )
+		{
+			if( t.size() != 2 ) return as.fail("bad .program");
+			if( selected ) done = true;
+			current = t[1];
+			selected = !done && (program.empty() || program == current);
+			if( selected ) out.name = current;
+			continue;
+		}
+
+		// defines before the first program are global, otherwise only of interest for the selected one
+		bool global = current.empty();
+		if( !global && !selected )
+			continue;
+
+		if( t[0] == ".define" )
+		{
+			size_t i = 1;
+			if( i < t.size() && lower(t[i]) == "public" ) ++i;
+			if( i + 2 != t.size() ) return as.fail("bad .define");
+			int v;
+			if( !as.value(t[i+1], v) ) return false;
+			out.defines[t[i]] = v;
+			continue;
+		}
+
+		if( global )
+			return as.fail("instruction outside of a program");
+
+		if( t[0] == ".wrap_target" ) { out.wrap_target = (int)lines.size(); continue; }
+		if( t[0] == ".wrap" )        { out.wrap = (int)lines.size() - 1; continue; }
+		if( t[0] == ".side_set" )    return as.fail("side set is not supported");
+		if( t[0][0] == '.' )         continue; // .origin, .lang_opt etc. do not change the encoding for us
+
+		size_t i = 0;
+		if( lower(t[0]) == "public" ) ++i;
+		if( i < t.size() && t[i].back() == ':' )
+		{
+			out.labels[t[i].substr(0, t[i].size()-1)] = (int)lines.size();
+			++i;
+		}
+		if( i == t.size() )
+			continue;
+
+		source_line l;
+		l.number = number;
+		l.text = text;
+		l.tokens.assign(t.begin() + i, t.end());
+		lines.push_back(l);
+	}
+
+	if( out.name.empty() )
+	{
+		error = program.empty() ? "no program in '" + path + "'" : "no program '" + program + "' in '" + path + "'";
+		return false;
+	}
+
+	if( lines.size() > 32 )
+	{
+		error = "program too long";
+		return false;
+	}
+
+	// second pass: encode, now that all labels are known
+	for(const auto& l : lines)
+	{
+		uint16_t ins;
+		if( !as.encode(l, ins) )
+			return false;
+		out.instructions.push_back(ins);
+
+		std::string src = strip_comment(l.text);
+		size_t b = src.find_first_not_of(" \t");
+		size_t e = src.find_last_not_of(" \t");
+		out.source.push_back(b == std::string::npos ? "" : src.substr(b, e - b + 1));
+	}
+
+	if( out.wrap < 0 )
+		out.wrap = (int)out.instructions.size() - 1;
+
+	return true;
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _PIO_ASM_H
+#define _PIO_ASM_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// A small assembler for the subset of the pioasm syntax we use in the firmware.
+// It produces the very same 16 bit machine words pioasm would, so the emulator
+// runs exactly what ends up on the RP2040. Side set is not supported.
+struct pio_program_image
+{
+	std::string name;
+	std::vector<uint16_t> instructions;
+	// source text of each instruction, for reporting
+	std::vector<std::string> source;
+	std::map<std::string, int> labels;
+	std::map<std::string, int> defines;
+	int wrap_target = 0;
+	int wrap = -1;
+};
+
+// Assembles the program 'program' (or the first one if empty) from the .pio file at 'path'.
+// Returns false and fills 'error' if something could not be parsed.
+bool pio_asm_load(const std::string& path, const std::string& program, pio_program_image& out, std::string& error);
+
+#endif
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include "pio_sm.h"
+
+pio_sm_emu::pio_sm_emu(const pio_program_image& program, const pio_sm_settings& settings)
+	// pio_sm_init() starts at the program offset, which is address 0 here
+	: prog(program), cfg(settings), pc(0)
+{
+	wait_stats.resize(prog.instructions.size());
+}
+
+bool pio_sm_emu::rx_pop(uint32_t& value)
+{
+	if( rx.empty() )
+		return false;
+	value = rx.front();
+	rx.pop_front();
+	return true;
+}
+
+void pio_sm_emu::next_pc()
+{
+	if( pc == prog.wrap )
+		pc = prog.wrap_target;
+	else
+		pc = (pc + 1) & 0x1f;
+}
+
+uint32_t pio_sm_emu::in_pins(uint32_t gpio) const
+{
+	// the input mapping is a rotate by in_base
+	int b = cfg.in_base & 0x1f;
+	if( b == 0 )
+		return gpio;
+	return (gpio >> b) | (gpio << (32 - b));
+}
+
+void pio_sm_emu::shift_in(uint32_t data, int count)
+{
+	uint32_t mask = (count == 32) ? 0xffffffff : ((1u << count) - 1);
+	data &= mask;
+	if( cfg.in_shift_right )
+		isr = (count == 32) ? data : ((isr >> count) | (data << (32 - count)));
+	else
+		isr = (count == 32) ? data : ((isr << count) | data);
+	isr_count += count;
+	if( isr_count > 32 )
+		isr_count = 32;
+}
+
+bool pio_sm_emu::do_push(bool block)
+{
+	if( (int)rx.size() >= cfg.rx_depth )
+	{
+		if( block )
+			return false;
+		// noblock push on a full FIFO: data is lost and FDEBUG.RXSTALL is set
+		rxstall = true;
+		++rx_dropped;
+	}
+	else
+	{
+		rx.push_back(isr);
+	}
+	isr = 0;
+	isr_count = 0;
+	return true;
+}
+
+void pio_sm_emu::step(uint32_t gpio)
+{
+	++cycles;
+
+	if( delay > 0 )
+	{
+		--delay;
+		return;
+	}
+
+	uint16_t ins = prog.instructions[pc];
+	int op = ins >> 13;
+	int arg1 = (ins >> 5) & 0x7;
+	int arg2 = ins & 0x1f;
+	bool jumped = false;
+	bool stalled = false;
+
+	switch( op )
+	{
+		case 0: // JMP
+		{
+			bool take = false;
+			switch( arg1 )
+			{
+				case 0: take = true; break;
+				case 1: take = (x == 0); break;
+				case 2: take = (x != 0); --x; break;
+				case 3: take = (y == 0); break;
+				case 4: take = (y != 0); --y; break;
+				case 5: take = (x != y); break;
+				case 6: take = ((gpio >> cfg.jmp_pin) & 1) != 0; break;
+				case 7: take = (osr_count < 32); break;
+			}
+			if( take )
+			{
+				pc = arg2;
+				jumped = true;
+			}
+			break;
+		}
+
+		case 1: // WAIT
+		{
+			int pol = (ins >> 7) & 1;
+			int src = (ins >> 5) & 3;
+			int idx = ins & 0x1f;
+			int level = pol;
+			if( src == 0 )      level = (gpio >> idx) & 1;
+			else if( src == 1 ) level = (in_pins(gpio) >> idx) & 1;
+			// IRQ waits are not modelled, nobody would ever set the flag
+			stalled = (level != pol);
+			break;
+		}
+
+		case 2: // IN
+		{
+			int count = (arg2 == 0) ? 32 : arg2;
+			uint32_t data = 0;
+			switch( arg1 )
+			{
+				case 0: data = in_pins(gpio); break;
+				case 1: data = x; break;
+				case 2: data = y; break;
+				case 6: data = isr; break;
+				case 7: data = osr; break;
+			}
+			shift_in(data, count);
+			if( cfg.autopush && isr_count >= cfg.push_threshold )
+				do_push(false);
+			break;
+		}
+
+		case 3: // OUT, TX FIFO is never used so this only shifts OSR
+		{
+			int count = (arg2 == 0) ? 32 : arg2;
+			uint32_t data = (count == 32) ? osr : (osr >> (32 - count));
+			osr = (count == 32) ? 0 : (osr << count);
+			osr_count += count;
+			if( arg1 == 1 ) x = data;
+			if( arg1 == 2 ) y = data;
+			if( arg1 == 5 ) { pc = data & 0x1f; jumped = true; }
+			break;
+		}
+
+		case 4: // PUSH / PULL
+		{
+			bool is_pull = (ins >> 7) & 1;
+			bool cond = (ins >> 6) & 1;
+			bool block = (ins >> 5) & 1;
+			if( !is_pull )
+			{
+				if( !cond || isr_count >= cfg.push_threshold )
+					stalled = !do_push(block);
+			}
+			else
+			{
+				// empty TX FIFO: blocking pull stalls forever, noblock copies X
+				if( block )
+					stalled = true;
+				else
+				{
+					osr = x;
+					osr_count = 0;
+				}
+			}
+			break;
+		}
+
+		case 5: // MOV
+		{
+			int mop = (ins >> 3) & 3;
+			int src = ins & 7;
+			uint32_t data = 0;
+			switch( src )
+			{
+				case 0: data = in_pins(gpio); break;
+				case 1: data = x; break;
+				case 2: data = y; break;
+				case 6: data = isr; break;
+				case 7: data = osr; break;
+			}
+			if( mop == 1 )
+				data = ~data;
+			if( mop == 2 )
+			{
+				uint32_t r = 0;
+				for(int i=0; i<32; ++i)
+					if( data & (1u << i) ) r |= 1u << (31 - i);
+				data = r;
+			}
+			switch( arg1 )
+			{
+				case 1: x = data; break;
+				case 2: y = data; break;
+				case 5: pc = data & 0x1f; jumped = true; break;
+				case 6: isr = data; isr_count = 0; break;
+				case 7: osr = data; osr_count = 0; break;
+			}
+			break;
+		}
+
+		case 6: // IRQ, no other state machines to talk to
+			break;
+
+		case 7: // SET, output pins are not of interest
+		{
+			if( arg1 == 1 ) x = arg2;
+			if( arg1 == 2 ) y = arg2;
+			break;
+		}
+	}
+
+	if( stalled )
+	{
+		++stall;
+		return;
+	}
+
+	if( op == 1 )
+	{
+		pio_wait_stats& s = wait_stats[pc];
+		++s.executions;
+		s.stall_total += stall;
+		if( stall < s.stall_min ) s.stall_min = stall;
+		if( stall > s.stall_max ) s.stall_max = stall;
+	}
+	stall = 0;
+
+	delay = (ins >> 8) & 0x1f;
+	if( !jumped )
+		next_pc();
+}
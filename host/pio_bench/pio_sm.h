@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#ifndef _PIO_SM_H
+#define _PIO_SM_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "pio_asm.h"
+
+// Cycle level model of a single PIO state machine running at clk_sys (clock divider 1), as configured in pcm1802.c.
+// Only the receive side is modelled, there is nothing ever written to the TX FIFO.
+struct pio_sm_settings
+{
+	// first pin for "in pins", "wait pin" and "mov x, pins"
+	int in_base = 0;
+	// absolute GPIO for "jmp pin", the sync input in pcm1802.c
+	int jmp_pin = 0;
+	// pcm1802.c shifts left, MSB first
+	bool in_shift_right = false;
+	bool autopush = false;
+	int push_threshold = 32;
+	// 8 with the FIFOs joined (PIO_FIFO_JOIN_RX), 4 otherwise
+	int rx_depth = 8;
+};
+
+struct pio_wait_stats
+{
+	uint64_t executions = 0;
+	uint64_t stall_total = 0;
+	uint64_t stall_min = UINT64_MAX;
+	uint64_t stall_max = 0;
+};
+
+class pio_sm_emu
+{
+public:
+	pio_sm_emu(const pio_program_image& program, const pio_sm_settings& settings);
+
+	// Advance one clock cycle, 'gpio' is the (already synchronized) input of all 32 GPIOs, bit n == GPIO n
+	void step(uint32_t gpio);
+
+	bool     rx_pop(uint32_t& value);
+	size_t   rx_level() const { return rx.size(); }
+
+	// like FDEBUG.RXSTALL, sticky, also set when a "push noblock" dropped data
+	bool     rxstall = false;
+	uint64_t rx_dropped = 0;
+	uint64_t cycles = 0;
+
+	// indexed by program address, only filled for WAIT instructions
+	std::vector<pio_wait_stats> wait_stats;
+
+private:
+	void     next_pc();
+	uint32_t in_pins(uint32_t gpio) const;
+	void     shift_in(uint32_t data, int count);
+	bool     do_push(bool block);
+
+	const pio_program_image& prog;
+	pio_sm_settings cfg;
+
+	std::deque<uint32_t> rx;
+	int      pc;
+	uint32_t x = 0, y = 0, isr = 0, osr = 0;
+	int      isr_count = 0;
+	int      osr_count = 32;
+	int      delay = 0;
+	uint64_t stall = 0;
+};
+
+#endif
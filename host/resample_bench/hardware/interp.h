@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+// Model of the RP2040 interpolator, enough of hardware/interp.h for resample.c to build on the host and run the way
+// it does on core1. The results are worked out when they are read, like the hardware does combinationally:
+//
+// - lane n: (ACCUMn >> SHIFT) masked to MASK_LSB..MASK_MSB, sign extended from MASK_MSB if SIGNED
+// - PEEK0 = BASE0 + lane 0, PEEK1 = BASE1 + lane 1, PEEK2 = BASE2 + lane 0 + lane 1
+// - with BLEND on lane 0: PEEK1 = BASE0 + (BASE1 - BASE0) * alpha / 256 (signed if lane 1 is), alpha being the low
+//   8 bits of lane 1, PEEK0 is just alpha and PEEK2 leaves lane 1 out
+// - a write to BASE01 puts the low half in BASE0 and the high half in BASE1, each sign extended if its lane is SIGNED
+//
+// CROSS_INPUT, CROSS_RESULT, ADD_RAW, FORCE_MSB, CLAMP and the POP side effects are not modeled.
+
+#include <cstdint>
+
+#define SIO_INTERP0_CTRL_LANE0_SHIFT_LSB    0
+#define SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB 5
+#define SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB 10
+#define SIO_INTERP0_CTRL_LANE0_SIGNED_BITS  (1u << 15)
+#define SIO_INTERP0_CTRL_LANE0_BLEND_BITS   (1u << 21)
+
+struct interp_hw_t
+{
+	uint32_t accum[2] = {};
+	uint32_t base[3] = {};
+	uint32_t ctrl[2] = {};
+
+	struct peek_regs
+	{
+		const interp_hw_t* hw;
+		uint32_t operator[](int i) const { return hw->result(i); }
+	};
+	struct base01_reg
+	{
+		interp_hw_t* hw;
+		base01_reg& operator=(uint32_t v)
+		{
+			hw->base[0] = hw->lane_signed(0) ? (uint32_t)(int32_t)(int16_t)v : (v & 0xffff);
+			hw->base[1] = hw->lane_signed(1) ? (uint32_t)(int32_t)(int16_t)(v >> 16) : (v >> 16);
+			return *this;
+		}
+	};
+	peek_regs peek{ this };
+	base01_reg base01{ this };
+
+	bool lane_signed(int lane) const { return ctrl[lane] & SIO_INTERP0_CTRL_LANE0_SIGNED_BITS; }
+
+	uint32_t lane(int n) const
+	{
+		uint32_t shift = (ctrl[n] >> SIO_INTERP0_CTRL_LANE0_SHIFT_LSB) & 31;
+		uint32_t lsb = (ctrl[n] >> SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB) & 31;
+		uint32_t msb = (ctrl[n] >> SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB) & 31;
+		uint32_t mask = (msb >= lsb) ? (uint32_t)((2ull << msb) - (1ull << lsb)) : 0;
+		uint32_t v = (accum[n] >> shift) & mask;
+		if( lane_signed(n) && msb < 31 && (v & (1u << msb)) )
+			v |= ~(uint32_t)((2ull << msb) - 1);
+		return v;
+	}
+
+	uint32_t result(int i) const
+	{
+		bool blend = ctrl[0] & SIO_INTERP0_CTRL_LANE0_BLEND_BITS;
+		if( !blend )
+			return (i == 2) ? base[2] + lane(0) + lane(1) : base[i] + lane(i);
+		uint32_t alpha = lane(1) & 0xff;
+		if( i == 0 )
+			return alpha;
+		if( i == 2 )
+			return base[2] + lane(0);
+		if( lane_signed(1) )
+			return (uint32_t)(int32_t)((int32_t)base[0] + (((int64_t)(int32_t)base[1] - (int32_t)base[0]) * alpha >> 8));
+		return (uint32_t)(base[0] + (((int64_t)base[1] - base[0]) * alpha >> 8));
+	}
+};
+
+inline interp_hw_t interp0_model;
+#define interp0 (&interp0_model)
+
+struct interp_config
+{
+	uint32_t ctrl;
+};
+
+static inline interp_config interp_default_config()
+{
+	// no shift, full mask
+	return { 31u << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB };
+}
+
+static inline void interp_config_set_shift(interp_config* c, uint32_t shift)
+{
+	c->ctrl = (c->ctrl & ~(31u << SIO_INTERP0_CTRL_LANE0_SHIFT_LSB)) | (shift << SIO_INTERP0_CTRL_LANE0_SHIFT_LSB);
+}
+
+static inline void interp_config_set_mask(interp_config* c, uint32_t lsb, uint32_t msb)
+{
+	c->ctrl = (c->ctrl & ~((31u << SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB) | (31u << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB)))
+		| (lsb << SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB) | (msb << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB);
+}
+
+static inline void interp_config_set_signed(interp_config* c, bool s)
+{
+	c->ctrl = s ? (c->ctrl | SIO_INTERP0_CTRL_LANE0_SIGNED_BITS) : (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_SIGNED_BITS);
+}
+
+static inline void interp_config_set_blend(interp_config* c, bool b)
+{
+	c->ctrl = b ? (c->ctrl | SIO_INTERP0_CTRL_LANE0_BLEND_BITS) : (c->ctrl & ~SIO_INTERP0_CTRL_LANE0_BLEND_BITS);
+}
+
+static inline void interp_set_config(interp_hw_t* interp, unsigned lane, interp_config* config)
+{
+	interp->ctrl[lane] = config->ctrl;
+}
@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Measures the firmware resampler (resample.c, built against a model of interp0) with test tones, see README.md
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "resample.h"
+
+// edges of the pass and stop band as fractions of the output rate, see resample_taps_for()
+#define PASS_EDGE       0.41
+#define STOP_EDGE       0.59
+
+#define DEFAULT_ADC_HZ  78125
+#define AMPLITUDE       (0.9 * 0x7fffff)
+
+struct bench_settings
+{
+	uint32_t adc_hz = DEFAULT_ADC_HZ;
+	std::vector<uint32_t> rates;
+	uint32_t points = 64;
+	uint32_t outputs = 4000;
+	double min_stopband_db = 80;
+	double max_ripple_db = 0.01;
+	double min_snr_db = 70;
+};
+
+struct tone_result
+{
+	double gain_db = 0;
+	// against the ideal tone at the time each output frame is at, this is where a wrong delay shows up
+	double snr_db = 0;
+};
+
+// one tone on both channels, left and right with opposite sign so a swapped channel shows up too
+static tone_result run_tone(uint32_t adc_hz, uint32_t out_hz, uint32_t outputs, double f)
+{
+	resample_start(adc_hz, out_hz, 0);
+	uint32_t settle = resample_get_taps();
+	double w = 2 * M_PI * f / adc_hz;
+	double phase = 0.3;
+
+	double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0, yy = 0, err = 0, ideal_energy = 0;
+	uint32_t n_out = 0;
+	for(uint64_t k=0; n_out < settle + outputs; ++k)
+	{
+		uint64_t n = resample_next_index();
+		int32_t x = (int32_t)lround(AMPLITUDE * sin(w * k + phase));
+		int32_t l, r;
+		if( !resample_push(x, -x, &l, &r) )
+			continue;
+		if( n_out++ < settle )
+			continue;
+		if( l != -r && l != -r - 1 && l != -r + 1 )
+			return { NAN, NAN };
+
+		// output frame n is at ADC frame n * adc_hz / out_hz
+		double t = (double)n * adc_hz / out_hz;
+		double s = sin(w * t + phase), c = cos(w * t + phase);
+		ss += s * s; sc += s * c; cc += c * c;
+		ys += l * s; yc += l * c; yy += (double)l * l;
+		double ideal = AMPLITUDE * s;
+		err += (l - ideal) * (l - ideal);
+		ideal_energy += ideal * ideal;
+	}
+
+	// least squares fit of a * s + b * c, the amplitude is the gain at f even if the phase is off
+	double det = ss * cc - sc * sc;
+	double gain;
+	if( fabs(det) > 1e-9 * ss * cc )
+	{
+		double a = (ys * cc - yc * sc) / det;
+		double b = (yc * ss - ys * sc) / det;
+		gain = hypot(a, b) / AMPLITUDE;
+	}
+	else
+	{
+		// aliased to DC or the output Nyquist, nothing to fit against, the RMS is the gain
+		gain = sqrt(yy / outputs) / (AMPLITUDE / sqrt(2.0));
+	}
+	// in the stop band the tone folds back to another frequency, the output is whatever got through
+	if( f > out_hz / 2.0 )
+		gain = sqrt(yy / outputs) / (AMPLITUDE / sqrt(2.0));
+
+	return { 20 * log10(gain), 10 * log10(ideal_energy / err) };
+}
+
+struct rate_result
+{
+	uint32_t taps = 0;
+	double ripple_db = 0;
+	double min_snr_db = INFINITY;
+	double min_snr_hz = 0;
+	double stopband_db = INFINITY;
+	double stopband_hz = 0;
+	bool channels_ok = true;
+};
+
+static rate_result run_rate(const bench_settings& s, uint32_t out_hz)
+{
+	rate_result r;
+	r.taps = resample_taps_for(s.adc_hz, out_hz);
+
+	for(uint32_t i=0; i<s.points; ++i)
+	{
+		double f = out_hz * PASS_EDGE * (i + 0.5) / s.points;
+		tone_result t = run_tone(s.adc_hz, out_hz, s.outputs, f);
+		if( std::isnan(t.gain_db) )
+		{
+			r.channels_ok = false;
+			continue;
+		}
+		r.ripple_db = fmax(r.ripple_db, fabs(t.gain_db));
+		if( t.snr_db < r.min_snr_db )
+		{
+			r.min_snr_db = t.snr_db;
+			r.min_snr_hz = f;
+		}
+	}
+
+	double stop_lo = out_hz * STOP_EDGE, stop_hi = s.adc_hz / 2.0;
+	for(uint32_t i=0; i<=s.points; ++i)
+	{
+		double f = stop_lo + (stop_hi - stop_lo) * i / s.points;
+		tone_result t = run_tone(s.adc_hz, out_hz, s.outputs, f);
+		if( std::isnan(t.gain_db) )
+		{
+			r.channels_ok = false;
+			continue;
+		}
+		if( -t.gain_db < r.stopband_db )
+		{
+			r.stopband_db = -t.gain_db;
+			r.stopband_hz = f;
+		}
+	}
+	return r;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options]\n", me);
+	printf("  --adc-hz HZ          ADC rate (default %u)\n", DEFAULT_ADC_HZ);
+	printf("  --rate HZ            output rate, can be given more than once (default the standard ones it can make)\n");
+	printf("  --points N           test tones per band (default 64)\n");
+	printf("  --outputs N          output frames measured per tone (default 4000)\n");
+	printf("  --min-stopband DB    fail below this (default 80)\n");
+	printf("  --max-ripple DB      fail above this pass band deviation (default 0.01)\n");
+	printf("  --min-snr DB         fail below this against the ideal tone in the pass band (default 70)\n");
+	printf("Pass band is 0 to %.2f of the output rate, stop band from %.2f of it to half the ADC rate.\n", PASS_EDGE, STOP_EDGE);
+}
+
+int main(int argc, char** argv)
+{
+	bench_settings s;
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--adc-hz" )             s.adc_hz = (uint32_t)atoi(next());
+		else if( a == "--rate" )          s.rates.push_back((uint32_t)atoi(next()));
+		else if( a == "--points" )        s.points = (uint32_t)atoi(next());
+		else if( a == "--outputs" )       s.outputs = (uint32_t)atoi(next());
+		else if( a == "--min-stopband" )  s.min_stopband_db = atof(next());
+		else if( a == "--max-ripple" )    s.max_ripple_db = atof(next());
+		else if( a == "--min-snr" )       s.min_snr_db = atof(next());
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( s.rates.empty() )
+	{
+		const uint32_t standard[RESAMPLE_RATE_COUNT] = RESAMPLE_RATES;
+		for(uint32_t rate : standard)
+			if( resample_taps_for(s.adc_hz, rate) )
+				s.rates.push_back(rate);
+	}
+	if( s.rates.empty() || s.points == 0 || s.outputs == 0 )
+	{
+		fprintf(stderr, "nothing to measure at %u Hz\n", s.adc_hz);
+		return 1;
+	}
+
+	bool pass = true;
+	for(uint32_t rate : s.rates)
+	{
+		if( !resample_taps_for(s.adc_hz, rate) )
+		{
+			fprintf(stderr, "%u Hz can't be made from %u Hz\n", rate, s.adc_hz);
+			return 1;
+		}
+		rate_result r = run_rate(s, rate);
+		bool ok = r.channels_ok && r.ripple_db <= s.max_ripple_db && r.min_snr_db >= s.min_snr_db && r.stopband_db >= s.min_stopband_db;
+		pass = pass && ok;
+		printf("%u -> %u Hz, %u taps: pass band ripple %.4f dB, SNR %.1f dB (worst at %.0f Hz), stop band %.1f dB (worst at %.0f Hz)%s: %s\n",
+			s.adc_hz, rate, r.taps, r.ripple_db, r.min_snr_db, r.min_snr_hz, r.stopband_db, r.stopband_hz,
+			r.channels_ok ? "" : ", channels differ", ok ? "PASS" : "FAIL");
+	}
+	return pass ? 0 : 2;
+}
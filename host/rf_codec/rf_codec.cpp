@@ -0,0 +1,527 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#include <algorithm>
+#include <cstring>
+
+#include "rf_codec.h"
+
+// unary part this long is an escape, the zigzag residual follows in 12 bits (order 3 of 8 bit samples stays below 4096)
+#define RICE_ESCAPE   16
+#define ESCAPE_BITS   12
+#define RICE_MAX_K    11
+// partition header: 3 bits mode, 4 bits Rice parameter
+#define MODE_VERBATIM 7
+
+namespace {
+
+struct bit_writer
+{
+	std::vector<uint8_t>& out;
+	uint64_t acc = 0;
+	uint32_t bits = 0;
+
+	explicit bit_writer(std::vector<uint8_t>& out) : out(out) {}
+
+	// n <= 32, less than 32 bits are pending before
+	void put(uint32_t value, uint32_t n)
+	{
+		acc = (acc << n) | (value & ((n == 32) ? 0xffffffffu : ((1u << n) - 1)));
+		bits += n;
+		if( bits >= 32 )
+		{
+			bits -= 32;
+			uint32_t word = (uint32_t)(acc >> bits);
+			uint8_t bytes[4] = { (uint8_t)(word >> 24), (uint8_t)(word >> 16), (uint8_t)(word >> 8), (uint8_t)word };
+			out.insert(out.end(), bytes, bytes + 4);
+		}
+	}
+
+	void flush()
+	{
+		while( bits >= 8 )
+		{
+			bits -= 8;
+			out.push_back((uint8_t)(acc >> bits));
+		}
+		if( bits )
+			out.push_back((uint8_t)(acc << (8 - bits)));
+		bits = 0;
+		acc = 0;
+	}
+};
+
+struct bit_reader
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	uint64_t acc = 0;
+	uint32_t bits = 0;
+	// bytes made up past the end, a few are fine (the last partial byte), more means a damaged block
+	uint32_t overrun = 0;
+
+	bit_reader(const uint8_t* p, size_t len) : p(p), end(p + len) {}
+
+	void refill()
+	{
+		while( bits <= 56 )
+		{
+			uint8_t b = 0;
+			if( p < end )
+				b = *(p++);
+			else
+				++overrun;
+			acc = (acc << 8) | b;
+			bits += 8;
+		}
+	}
+
+	uint32_t get(uint32_t n)
+	{
+		if( bits < n )
+			refill();
+		bits -= n;
+		return (uint32_t)(acc >> bits) & ((1u << n) - 1);
+	}
+
+	// ones up to the terminating zero, at most RICE_ESCAPE
+	uint32_t unary()
+	{
+		if( bits < RICE_ESCAPE + 1 )
+			refill();
+		uint64_t v = ~(acc << (64 - bits));
+		uint32_t ones = v ? (uint32_t)__builtin_clzll(v) : 64;
+		if( ones >= RICE_ESCAPE )
+		{
+			bits -= RICE_ESCAPE;
+			return RICE_ESCAPE;
+		}
+		bits -= ones + 1;
+		return ones;
+	}
+};
+
+inline uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+inline int32_t predict(uint32_t order, int32_t x1, int32_t x2, int32_t x3)
+{
+	switch( order )
+	{
+	case 1:  return x1;
+	case 2:  return 2 * x1 - x2;
+	case 3:  return 3 * x1 - 3 * x2 + x3;
+	default: return 0;
+	}
+}
+
+void encode_partition(bit_writer& w, const uint8_t* s, size_t begin, size_t end)
+{
+	// samples before begin are the history, begin >= 3
+	uint64_t sum[4] = { 0, 0, 0, 0 };
+	for(size_t i=begin; i<end; ++i)
+	{
+		int32_t x = s[i], x1 = s[i - 1], x2 = s[i - 2], x3 = s[i - 3];
+		int32_t e1 = x - x1;
+		int32_t e2 = e1 - (x1 - x2);
+		int32_t e3 = e2 - (x1 - 2 * x2 + x3);
+		sum[0] += x;
+		sum[1] += (e1 < 0) ? -e1 : e1;
+		sum[2] += (e2 < 0) ? -e2 : e2;
+		sum[3] += (e3 < 0) ? -e3 : e3;
+	}
+
+	uint32_t order = 0;
+	for(uint32_t o=1; o<4; ++o)
+		if( sum[o] < sum[order] )
+			order = o;
+
+	// Rice parameter from the mean of the zigzag residuals (twice the mean absolute value)
+	uint64_t n = end - begin;
+	uint64_t mean2 = sum[order] * 2;
+	uint32_t k = 0;
+	while( k < RICE_MAX_K && (n << (k + 1)) < mean2 )
+		++k;
+
+	uint64_t estimate = n * (k + 1) + (mean2 >> k);
+	if( estimate >= n * 8 )
+	{
+		w.put(MODE_VERBATIM, 3);
+		w.put(0, 4);
+		for(size_t i=begin; i<end; ++i)
+			w.put(s[i], 8);
+		return;
+	}
+
+	w.put(order, 3);
+	w.put(k, 4);
+	uint32_t mask = (1u << k) - 1;
+	for(size_t i=begin; i<end; ++i)
+	{
+		uint32_t u = zigzag((int32_t)s[i] - predict(order, s[i - 1], s[i - 2], s[i - 3]));
+		uint32_t q = u >> k;
+		if( q < RICE_ESCAPE )
+		{
+			// q ones, the terminating zero and the low bits in one go
+			w.put((((1u << q) - 1) << (k + 1)) | (u & mask), q + 1 + k);
+		}
+		else
+		{
+			w.put((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+			w.put(u, ESCAPE_BITS);
+		}
+	}
+}
+
+// https://en.wikipedia.org/wiki/Cyclic_redundancy_check, the zlib one
+struct crc_table
+{
+	uint32_t t[8][256];
+
+	crc_table()
+	{
+		for(uint32_t i=0; i<256; ++i)
+		{
+			uint32_t c = i;
+			for(int j=0; j<8; ++j)
+				c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+			t[0][i] = c;
+		}
+		// slicing by 8
+		for(uint32_t i=0; i<256; ++i)
+			for(int s=1; s<8; ++s)
+				t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+	}
+};
+
+const crc_table crc;
+
+} // namespace
+
+uint32_t rf_crc32(const uint8_t* data, size_t len, uint32_t c)
+{
+	c = ~c;
+	while( len >= 8 )
+	{
+		uint32_t a, b;
+		memcpy(&a, data, 4);
+		memcpy(&b, data + 4, 4);
+		a ^= c;
+		c = crc.t[7][a & 0xff] ^ crc.t[6][(a >> 8) & 0xff] ^ crc.t[5][(a >> 16) & 0xff] ^ crc.t[4][a >> 24]
+			^ crc.t[3][b & 0xff] ^ crc.t[2][(b >> 8) & 0xff] ^ crc.t[1][(b >> 16) & 0xff] ^ crc.t[0][b >> 24];
+		data += 8;
+		len -= 8;
+	}
+	while( len-- )
+		c = crc.t[0][(c ^ *(data++)) & 0xff] ^ (c >> 8);
+	return ~c;
+}
+
+void rf_encode_block(const uint8_t* samples, size_t n, std::vector<uint8_t>& out)
+{
+	out.clear();
+	out.reserve(n + n / 64 + 16);
+
+	// the first 3 samples are the history for every predictor
+	size_t warm = std::min<size_t>(3, n);
+	out.insert(out.end(), samples, samples + warm);
+
+	bit_writer w(out);
+	for(size_t begin=warm; begin<n; begin+=RF_PARTITION_SAMPLES)
+		encode_partition(w, samples, begin, std::min<size_t>(n, begin + RF_PARTITION_SAMPLES));
+	w.flush();
+}
+
+bool rf_decode_block(const uint8_t* payload, size_t len, uint8_t* out, size_t n)
+{
+	size_t warm = std::min<size_t>(3, n);
+	if( len < warm )
+		return false;
+	memcpy(out, payload, warm);
+
+	bit_reader r(payload + warm, len - warm);
+	for(size_t begin=warm; begin<n; begin+=RF_PARTITION_SAMPLES)
+	{
+		size_t end = std::min<size_t>(n, begin + RF_PARTITION_SAMPLES);
+		uint32_t order = r.get(3);
+		uint32_t k = r.get(4);
+		if( order == MODE_VERBATIM )
+		{
+			for(size_t i=begin; i<end; ++i)
+				out[i] = (uint8_t)r.get(8);
+			continue;
+		}
+		if( order > 3 || k > RICE_MAX_K )
+			return false;
+
+		for(size_t i=begin; i<end; ++i)
+		{
+			uint32_t q = r.unary();
+			uint32_t u = (q == RICE_ESCAPE) ? r.get(ESCAPE_BITS) : ((q << k) | (k ? r.get(k) : 0));
+			int32_t x = unzigzag(u) + predict(order, out[i - 1], out[i - 2], out[i - 3]);
+			if( x < 0 || x > 255 )
+				return false;
+			out[i] = (uint8_t)x;
+		}
+		if( r.overrun > 8 )
+			return false;
+	}
+	return r.overrun <= 8;
+}
+
+rf_writer::rf_writer(sink out, uint32_t block_samples, unsigned n_threads)
+	: out(std::move(out)), block_samples(block_samples), max_in_flight(std::max(2u, 2 * n_threads))
+{
+	current.reserve(block_samples);
+
+	rf_file_header h{};
+	h.magic = RF_FILE_MAGIC;
+	h.version = RF_FILE_VERSION;
+	h.block_samples = block_samples;
+	put(&h, sizeof(h));
+
+	for(unsigned i=0; i<n_threads; ++i)
+		threads.emplace_back(&rf_writer::worker, this);
+}
+
+rf_writer::~rf_writer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		cv.notify_all();
+	}
+	for(std::thread& t : threads)
+		t.join();
+	for(job* j : jobs)
+		delete j;
+}
+
+bool rf_writer::put(const void* data, size_t len)
+{
+	ok = ok && out((const uint8_t*)data, len);
+	offset += len;
+	return ok;
+}
+
+void rf_writer::encode(job* j)
+{
+	j->crc = rf_crc32(j->raw.data(), j->raw.size());
+	rf_encode_block(j->raw.data(), j->raw.size(), j->payload);
+}
+
+void rf_writer::worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while( true )
+	{
+		cv.wait(lock, [this] { return quit || !todo.empty(); });
+		if( quit )
+			return;
+		job* j = todo.front();
+		todo.pop_front();
+
+		lock.unlock();
+		encode(j);
+		lock.lock();
+
+		j->done = true;
+		cv.notify_all();
+	}
+}
+
+void rf_writer::submit()
+{
+	job* j = new job;
+	j->first_sample = total_samples - current.size();
+	j->raw.swap(current);
+	current.reserve(block_samples);
+
+	if( threads.empty() )
+	{
+		encode(j);
+		j->done = true;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	jobs.push_back(j);
+	if( !threads.empty() )
+	{
+		todo.push_back(j);
+		cv.notify_one();
+	}
+}
+
+bool rf_writer::emit_ready(bool wait_all)
+{
+	while( true )
+	{
+		job* j;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			// only waits when too many blocks are in flight, otherwise the caller goes on reading
+			bool wait = wait_all || jobs.size() >= max_in_flight;
+			if( jobs.empty() || (!jobs.front()->done && !wait) )
+				return ok;
+			cv.wait(lock, [this] { return jobs.front()->done; });
+			j = jobs.front();
+			jobs.pop_front();
+		}
+
+		rf_block_header h{};
+		h.magic = RF_BLOCK_MAGIC;
+		h.raw_bytes = (uint32_t)j->raw.size();
+		h.payload_bytes = (uint32_t)j->payload.size();
+		h.crc32 = j->crc;
+		h.first_sample = j->first_sample;
+		index.push_back(offset);
+		put(&h, sizeof(h));
+		put(j->payload.data(), j->payload.size());
+		delete j;
+	}
+}
+
+bool rf_writer::write(const uint8_t* data, size_t len)
+{
+	while( len && ok )
+	{
+		size_t n = std::min<size_t>(len, block_samples - current.size());
+		current.insert(current.end(), data, data + n);
+		total_samples += n;
+		data += n;
+		len -= n;
+		if( current.size() == block_samples )
+		{
+			submit();
+			emit_ready(false);
+		}
+	}
+	return ok;
+}
+
+bool rf_writer::finish()
+{
+	if( !current.empty() )
+		submit();
+	emit_ready(true);
+
+	uint64_t index_offset = offset;
+	uint32_t head[2] = { RF_INDEX_MAGIC, (uint32_t)index.size() };
+	put(head, sizeof(head));
+	put(index.data(), index.size() * sizeof(uint64_t));
+
+	rf_file_footer footer{};
+	footer.index_offset = index_offset;
+	footer.total_samples = total_samples;
+	footer.magic = RF_FOOTER_MAGIC;
+	put(&footer, sizeof(footer));
+	return ok;
+}
+
+bool rf_reader::open(std::string& err)
+{
+	if( fread(&header, sizeof(header), 1, f) != 1 || header.magic != RF_FILE_MAGIC )
+	{
+		err = "not a .cxrf file";
+		return false;
+	}
+	if( header.version != RF_FILE_VERSION || header.block_samples == 0 )
+	{
+		err = "unsupported .cxrf version";
+		return false;
+	}
+	return true;
+}
+
+bool rf_reader::next(std::vector<uint8_t>& out, uint64_t& first_sample, std::string& err)
+{
+	err.clear();
+	rf_block_header h;
+	uint32_t magic;
+	if( fread(&magic, sizeof(magic), 1, f) != 1 )
+	{
+		err = "file ends without an index, the capture was cut short";
+		return false;
+	}
+	if( magic == RF_INDEX_MAGIC )
+		return false;
+	h.magic = magic;
+	if( magic != RF_BLOCK_MAGIC || fread((uint8_t*)&h + sizeof(magic), sizeof(h) - sizeof(magic), 1, f) != 1 )
+	{
+		err = "damaged block header";
+		return false;
+	}
+	if( h.raw_bytes > header.block_samples || h.payload_bytes > h.raw_bytes + h.raw_bytes / 8 + 64 )
+	{
+		err = "damaged block header";
+		return false;
+	}
+
+	payload.resize(h.payload_bytes);
+	if( fread(payload.data(), 1, payload.size(), f) != payload.size() )
+	{
+		err = "file ends in the middle of a block";
+		return false;
+	}
+
+	out.resize(h.raw_bytes);
+	first_sample = h.first_sample;
+	if( !rf_decode_block(payload.data(), payload.size(), out.data(), out.size()) || rf_crc32(out.data(), out.size()) != h.crc32 )
+	{
+		++bad_blocks;
+		std::fill(out.begin(), out.end(), 0);
+	}
+	return true;
+}
+
+bool rf_reader::load_index(std::string& err)
+{
+	rf_file_footer footer;
+	if( fseeko(f, -(off_t)sizeof(footer), SEEK_END) != 0 || fread(&footer, sizeof(footer), 1, f) != 1 || footer.magic != RF_FOOTER_MAGIC )
+	{
+		err = "no index, the file is not seekable or was cut short";
+		return false;
+	}
+
+	uint32_t head[2];
+	if( fseeko(f, (off_t)footer.index_offset, SEEK_SET) != 0 || fread(head, sizeof(head), 1, f) != 1 || head[0] != RF_INDEX_MAGIC )
+	{
+		err = "damaged index";
+		return false;
+	}
+	index.resize(head[1]);
+	if( fread(index.data(), sizeof(uint64_t), index.size(), f) != index.size() )
+	{
+		err = "damaged index";
+		return false;
+	}
+	total_samples = footer.total_samples;
+	return true;
+}
+
+bool rf_reader::seek(uint64_t sample, size_t& skip, std::string& err)
+{
+	if( index.empty() && !load_index(err) )
+		return false;
+	if( sample >= total_samples )
+	{
+		err = "past the end (" + std::to_string(total_samples) + " samples)";
+		return false;
+	}
+	// all blocks but the last have block_samples
+	uint64_t block = sample / header.block_samples;
+	skip = (size_t)(sample % header.block_samples);
+	if( block >= index.size() || fseeko(f, (off_t)index[block], SEEK_SET) != 0 )
+	{
+		err = "damaged index";
+		return false;
+	}
+	return true;
+}
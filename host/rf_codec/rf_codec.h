@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lossless compression of 8 bit RF captures (cxadc), a FLAC style fixed predictor (order 0-3) and Rice coded residuals
+// like firmware/src/pcm_codec.c, picked per partition of 4096 samples. Blocks are independent, so they are encoded
+// on as many threads as there are and any block can be decoded on its own.
+//
+// File layout (.cxrf), all little endian:
+//  rf_file_header
+//  rf_block_header + payload, repeated
+//  RF_INDEX_MAGIC, block count, the file offset of every block header (u64 each)
+//  rf_file_footer, fixed size at the very end so a reader can find the index
+// A streaming reader never needs the index, it stops at RF_INDEX_MAGIC.
+
+#define RF_FILE_MAGIC   0x46525843 // "CXRF"
+#define RF_BLOCK_MAGIC  0x42525843 // "CXRB"
+#define RF_INDEX_MAGIC  0x49525843 // "CXRI"
+#define RF_FOOTER_MAGIC 0x45525843 // "CXRE"
+#define RF_FILE_VERSION 1
+
+// 1 MiB samples, about 26 ms at 40 MHz
+#define RF_DEFAULT_BLOCK_SAMPLES (1u << 20)
+#define RF_PARTITION_SAMPLES     4096
+
+struct __attribute__((packed)) rf_file_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	// every block but the last one has this many samples
+	uint32_t block_samples;
+	uint32_t reserved2;
+};
+
+struct __attribute__((packed)) rf_block_header
+{
+	uint32_t magic;
+	uint32_t raw_bytes;
+	uint32_t payload_bytes;
+	// of the decoded samples
+	uint32_t crc32;
+	uint64_t first_sample;
+};
+
+struct __attribute__((packed)) rf_file_footer
+{
+	uint64_t index_offset;
+	uint64_t total_samples;
+	uint32_t magic;
+	uint32_t reserved;
+};
+
+uint32_t rf_crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+// one block payload, without the header
+void rf_encode_block(const uint8_t* samples, size_t n, std::vector<uint8_t>& out);
+// false if the payload is damaged, out must hold n samples
+bool rf_decode_block(const uint8_t* payload, size_t len, uint8_t* out, size_t n);
+
+// Splits a stream into blocks, encodes them on a pool of threads and writes them out in order.
+// Everything is written through the sink, so it works on pipes and the caller decides how the bytes reach the disk.
+class rf_writer
+{
+public:
+	using sink = std::function<bool(const uint8_t*, size_t)>;
+
+	// threads = 0 encodes on the calling thread
+	rf_writer(sink out, uint32_t block_samples = RF_DEFAULT_BLOCK_SAMPLES, unsigned threads = 0);
+	~rf_writer();
+
+	// returns false once the sink failed
+	bool write(const uint8_t* data, size_t len);
+	// last partial block, index and footer
+	bool finish();
+
+	uint64_t raw_bytes() const { return total_samples; }
+	uint64_t file_bytes() const { return offset; }
+
+private:
+	struct job
+	{
+		uint64_t first_sample = 0;
+		std::vector<uint8_t> raw;
+		std::vector<uint8_t> payload;
+		uint32_t crc = 0;
+		bool done = false;
+	};
+
+	bool put(const void* data, size_t len);
+	void submit();
+	bool emit_ready(bool wait_all);
+	void worker();
+	static void encode(job* j);
+
+	sink out;
+	uint32_t block_samples;
+	std::vector<uint8_t> current;
+	uint64_t total_samples = 0;
+	uint64_t offset = 0;
+	std::vector<uint64_t> index;
+	bool ok = true;
+
+	std::vector<std::thread> threads;
+	size_t max_in_flight;
+	std::mutex mutex;
+	std::condition_variable cv;
+	// in submission order, the front one is written next
+	std::deque<job*> jobs;
+	std::deque<job*> todo;
+	bool quit = false;
+};
+
+// Reads a .cxrf file block by block, seeking needs a regular file
+class rf_reader
+{
+public:
+	explicit rf_reader(FILE* f) : f(f) {}
+
+	bool open(std::string& err);
+	// the next block in file order, false at the end (err empty) or on an error.
+	// A block with a bad checksum is returned as zeros of the right length and counted, so the timing stays intact
+	bool next(std::vector<uint8_t>& out, uint64_t& first_sample, std::string& err);
+	// next() then returns the block holding sample, skip is the position of the sample in it
+	bool seek(uint64_t sample, size_t& skip, std::string& err);
+
+	uint32_t block_samples() const { return header.block_samples; }
+	uint64_t bad_blocks = 0;
+
+private:
+	bool load_index(std::string& err);
+
+	FILE* f;
+	rf_file_header header{};
+	std::vector<uint64_t> index;
+	uint64_t total_samples = 0;
+	std::vector<uint8_t> payload;
+};
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Compresses 8 bit RF captures to .cxrf and back, see README.md
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rf_codec.h"
+
+static double seconds_since(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+static int run_encode(FILE* in, FILE* out, uint32_t block_samples, unsigned threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	rf_writer w([out](const uint8_t* data, size_t len) { return fwrite(data, 1, len, out) == len; }, block_samples, threads);
+
+	std::vector<uint8_t> buf(1 << 20);
+	size_t n;
+	while( (n = fread(buf.data(), 1, buf.size(), in)) > 0 )
+	{
+		if( !w.write(buf.data(), n) )
+			break;
+	}
+	bool ok = w.finish() && fflush(out) == 0;
+
+	double s = seconds_since(start);
+	fprintf(stderr, "%llu samples to %llu bytes, ratio %.3f, %.1f MB/s on %u threads\n", (unsigned long long)w.raw_bytes(),
+		(unsigned long long)w.file_bytes(), w.raw_bytes() ? (double)w.file_bytes() / w.raw_bytes() : 0.0,
+		w.raw_bytes() / 1e6 / s, threads);
+	if( !ok )
+	{
+		fprintf(stderr, "write failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int run_decode(FILE* in, FILE* out, bool do_seek, uint64_t seek, uint64_t count)
+{
+	rf_reader r(in);
+	std::string err;
+	if( !r.open(err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+
+	size_t skip = 0;
+	if( do_seek && !r.seek(seek, skip, err) )
+	{
+		fprintf(stderr, "can't seek: %s\n", err.c_str());
+		return 1;
+	}
+
+	std::vector<uint8_t> block;
+	uint64_t first_sample, written = 0;
+	while( written < count && r.next(block, first_sample, err) )
+	{
+		size_t n = std::min<uint64_t>(block.size() - std::min(skip, block.size()), count - written);
+		if( fwrite(block.data() + skip, 1, n, out) != n )
+		{
+			fprintf(stderr, "write failed\n");
+			return 1;
+		}
+		written += n;
+		skip = 0;
+	}
+
+	if( !err.empty() )
+		fprintf(stderr, "%s\n", err.c_str());
+	if( r.bad_blocks )
+		fprintf(stderr, "%llu damaged blocks replaced by zeros\n", (unsigned long long)r.bad_blocks);
+	return (err.empty() && !r.bad_blocks) ? 0 : 2;
+}
+
+static int run_info(FILE* in)
+{
+	rf_reader r(in);
+	std::string err;
+	if( !r.open(err) )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return 1;
+	}
+
+	std::vector<uint8_t> block;
+	uint64_t first_sample, samples = 0, blocks = 0;
+	while( r.next(block, first_sample, err) )
+	{
+		samples += block.size();
+		++blocks;
+	}
+	long long bytes = ftello(in);
+	printf("%llu blocks of %u samples, %llu samples, %lld bytes so far, ratio %.3f, %llu damaged blocks\n", (unsigned long long)blocks,
+		r.block_samples(), (unsigned long long)samples, bytes, samples ? (double)bytes / samples : 0.0, (unsigned long long)r.bad_blocks);
+	if( !err.empty() )
+		printf("%s\n", err.c_str());
+	return (err.empty() && !r.bad_blocks) ? 0 : 2;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] [FILE]\n", me);
+	printf("  (default)        compress 8 bit samples from FILE or stdin to stdout\n");
+	printf("  -d               decompress FILE or stdin to stdout\n");
+	printf("  --seek N         with -d, start at sample N (needs FILE)\n");
+	printf("  --count N        with -d, stop after N samples\n");
+	printf("  --info           check every block of FILE and print the ratio\n");
+	printf("  --threads N      encoder threads (default all cpus)\n");
+	printf("  --block-kb N     block size in KiB samples (default %u)\n", RF_DEFAULT_BLOCK_SAMPLES / 1024);
+}
+
+int main(int argc, char** argv)
+{
+	bool decode = false, info = false, do_seek = false;
+	uint64_t seek = 0, count = UINT64_MAX;
+	unsigned threads = std::thread::hardware_concurrency();
+	uint32_t block_samples = RF_DEFAULT_BLOCK_SAMPLES;
+	std::string file;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "-d" )                  decode = true;
+		else if( a == "--info" )         info = true;
+		else if( a == "--seek" )         { seek = strtoull(next(), nullptr, 0); do_seek = true; }
+		else if( a == "--count" )        count = strtoull(next(), nullptr, 0);
+		else if( a == "--threads" )      threads = atoi(next());
+		else if( a == "--block-kb" )     block_samples = atoi(next()) * 1024;
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a[0] != '-' && file.empty() ) file = a;
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( block_samples == 0 )
+	{
+		fprintf(stderr, "--block-kb must not be 0\n");
+		return 1;
+	}
+
+	FILE* in = stdin;
+	if( !file.empty() && !(in = fopen(file.c_str(), "rb")) )
+	{
+		perror(file.c_str());
+		return 1;
+	}
+	if( (do_seek || info) && file.empty() )
+	{
+		fprintf(stderr, "--seek and --info need a file\n");
+		return 1;
+	}
+
+	if( info )
+		return run_info(in);
+	if( decode )
+		return run_decode(in, stdout, do_seek, seek, count);
+	return run_encode(in, stdout, block_samples, threads);
+}
@@ -0,0 +1,464 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Captures any number of cxadc cards to disk, one pinned reader and one O_DIRECT writer per card, see README.md
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rf_codec.h"
+
+// O_DIRECT wants the buffer, the size and the file offset aligned to the logical block size, 4 KiB covers every disk
+#define DIRECT_ALIGN 4096
+
+using clock_type = std::chrono::steady_clock;
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+	stop = 1;
+}
+
+static double ms_since(clock_type::time_point t)
+{
+	return std::chrono::duration<double, std::milli>(clock_type::now() - t).count();
+}
+
+struct block
+{
+	uint8_t* data = nullptr;
+	size_t used = 0;
+};
+
+// One card: the reader fills blocks from the device, the writer puts them on disk in the same order
+struct card
+{
+	std::string in_path;
+	std::string out_path;
+	int cpu = -1;
+
+	int in_fd = -1;
+	int out_fd = -1;
+	bool direct = false;
+	size_t block_size = 0;
+	// --compress, the writer hands the blocks to the encoder instead of the disk
+	std::unique_ptr<rf_writer> encoder;
+
+	std::vector<block> blocks;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<block*> free_blocks;
+	std::deque<block*> full_blocks;
+	bool reader_done = false;
+	bool failed = false;
+
+	std::thread reader;
+	std::thread writer;
+
+	// everything below is under mutex
+	uint64_t bytes_read = 0;
+	uint64_t bytes_written = 0;
+	// blocks waiting for the writer, the high water mark is what to size --buffer-mb by
+	size_t peak_fill = 0;
+	size_t interval_peak_fill = 0;
+	// the reader had to wait for a free block, the card keeps going meanwhile and overruns its own buffer
+	uint64_t stalls = 0;
+	double max_write_ms = 0;
+};
+
+static void fail(card* c, const char* what)
+{
+	fprintf(stderr, "%s: %s: %s\n", c->out_path.c_str(), what, strerror(errno));
+	std::lock_guard<std::mutex> lock(c->mutex);
+	c->failed = true;
+	stop = 1;
+	c->cv.notify_all();
+}
+
+static void pin(card* c)
+{
+	if( c->cpu < 0 )
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(c->cpu, &set);
+	if( pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0 )
+		fprintf(stderr, "%s: can't pin the reader to cpu %d\n", c->in_path.c_str(), c->cpu);
+}
+
+static void reader(card* c)
+{
+	pin(c);
+
+	bool eof = false;
+	while( !eof && !stop )
+	{
+		block* b;
+		{
+			std::unique_lock<std::mutex> lock(c->mutex);
+			if( c->free_blocks.empty() )
+			{
+				++c->stalls;
+				c->cv.wait(lock, [c] { return !c->free_blocks.empty() || c->failed; });
+			}
+			if( c->failed )
+				break;
+			b = c->free_blocks.front();
+			c->free_blocks.pop_front();
+		}
+
+		// only whole blocks are handed over, so the writer always has aligned sizes
+		b->used = 0;
+		while( b->used < c->block_size && !stop )
+		{
+			ssize_t n = read(c->in_fd, b->data + b->used, c->block_size - b->used);
+			if( n < 0 && errno == EINTR )
+				continue;
+			if( n < 0 )
+			{
+				fail(c, "read");
+				eof = true;
+				break;
+			}
+			if( n == 0 )
+			{
+				eof = true;
+				break;
+			}
+			b->used += n;
+		}
+
+		std::lock_guard<std::mutex> lock(c->mutex);
+		c->bytes_read += b->used;
+		c->full_blocks.push_back(b);
+		c->peak_fill = std::max(c->peak_fill, c->full_blocks.size());
+		c->interval_peak_fill = std::max(c->interval_peak_fill, c->full_blocks.size());
+		c->cv.notify_all();
+	}
+
+	std::lock_guard<std::mutex> lock(c->mutex);
+	c->reader_done = true;
+	c->cv.notify_all();
+}
+
+static bool write_all(card* c, const uint8_t* data, size_t len)
+{
+	while( len )
+	{
+		ssize_t n = write(c->out_fd, data, len);
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void writer(card* c)
+{
+	while( true )
+	{
+		block* b;
+		{
+			std::unique_lock<std::mutex> lock(c->mutex);
+			c->cv.wait(lock, [c] { return !c->full_blocks.empty() || c->reader_done || c->failed; });
+			if( c->full_blocks.empty() || c->failed )
+				break;
+			b = c->full_blocks.front();
+			c->full_blocks.pop_front();
+		}
+
+		if( c->direct && (b->used % DIRECT_ALIGN) != 0 )
+		{
+			// the tail at the end of the capture, the file offset is still aligned but the size is not
+			fcntl(c->out_fd, F_SETFL, fcntl(c->out_fd, F_GETFL) & ~O_DIRECT);
+			c->direct = false;
+		}
+
+		auto t = clock_type::now();
+		bool ok = c->encoder ? c->encoder->write(b->data, b->used) : write_all(c, b->data, b->used);
+		if( !ok )
+		{
+			fail(c, "write");
+			break;
+		}
+		double ms = ms_since(t);
+
+		std::lock_guard<std::mutex> lock(c->mutex);
+		c->bytes_written = c->encoder ? c->encoder->file_bytes() : c->bytes_written + b->used;
+		c->max_write_ms = std::max(c->max_write_ms, ms);
+		c->free_blocks.push_back(b);
+		c->cv.notify_all();
+	}
+
+	if( c->encoder && !c->failed )
+	{
+		if( !c->encoder->finish() )
+			fail(c, "write");
+		std::lock_guard<std::mutex> lock(c->mutex);
+		c->bytes_written = c->encoder->file_bytes();
+	}
+}
+
+static bool open_card(card* c, size_t buffer_bytes, uint64_t prealloc, unsigned compress_threads)
+{
+	c->in_fd = open(c->in_path.c_str(), O_RDONLY);
+	if( c->in_fd < 0 )
+	{
+		perror(c->in_path.c_str());
+		return false;
+	}
+
+	// O_DIRECT keeps 40 MB/s per card out of the page cache, tmpfs and pipes don't have it.
+	// The encoder writes blocks of any size, so compressed output always goes through the page cache
+	c->out_fd = -1;
+	if( !compress_threads )
+	{
+		c->out_fd = open(c->out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		c->direct = c->out_fd >= 0;
+	}
+	if( c->out_fd < 0 && (compress_threads || errno == EINVAL) )
+		c->out_fd = open(c->out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if( c->out_fd < 0 )
+	{
+		perror(c->out_path.c_str());
+		return false;
+	}
+	if( !c->direct && !compress_threads )
+		fprintf(stderr, "%s: no O_DIRECT, writing through the page cache\n", c->out_path.c_str());
+
+	if( compress_threads )
+		c->encoder = std::make_unique<rf_writer>([c](const uint8_t* data, size_t len) { return write_all(c, data, len); },
+			RF_DEFAULT_BLOCK_SAMPLES, compress_threads);
+
+	// so the file system does not have to find space while the capture runs
+	if( prealloc && fallocate(c->out_fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)prealloc) != 0 )
+		fprintf(stderr, "%s: can't preallocate: %s\n", c->out_path.c_str(), strerror(errno));
+
+	size_t count = std::max<size_t>(2, buffer_bytes / c->block_size);
+	c->blocks.resize(count);
+	for(block& b : c->blocks)
+	{
+		if( posix_memalign((void**)&b.data, DIRECT_ALIGN, c->block_size) != 0 )
+		{
+			fprintf(stderr, "out of memory\n");
+			return false;
+		}
+		// touch every page now, a page fault in the reader is time the card keeps running
+		memset(b.data, 0, c->block_size);
+		c->free_blocks.push_back(&b);
+	}
+	for(block& b : c->blocks)
+	{
+		if( mlock(b.data, c->block_size) != 0 )
+		{
+			fprintf(stderr, "%s: can't lock the buffer in memory (ulimit -l), it may get swapped\n", c->in_path.c_str());
+			break;
+		}
+	}
+	return true;
+}
+
+static void close_card(card* c)
+{
+	// the preallocation beyond the end is given back
+	if( c->out_fd >= 0 && ftruncate(c->out_fd, (off_t)c->bytes_written) != 0 )
+		fprintf(stderr, "%s: ftruncate: %s\n", c->out_path.c_str(), strerror(errno));
+	if( c->out_fd >= 0 )
+		close(c->out_fd);
+	if( c->in_fd >= 0 )
+		close(c->in_fd);
+	for(block& b : c->blocks)
+		free(b.data);
+	c->encoder.reset();
+}
+
+static std::vector<int> parse_cpus(const std::string& s)
+{
+	std::vector<int> ret;
+	size_t pos = 0;
+	while( pos < s.size() )
+	{
+		size_t comma = s.find(',', pos);
+		ret.push_back(atoi(s.substr(pos, comma - pos).c_str()));
+		if( comma == std::string::npos )
+			break;
+		pos = comma + 1;
+	}
+	return ret;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] DEVICE=FILE...\n", me);
+	printf("  --buffer-mb N     buffer per card (default 256)\n");
+	printf("  --block-kb N      read and write size (default 4096)\n");
+	printf("  --prealloc-gb N   preallocate each output file (default 0)\n");
+	printf("  --cpus A,B,...    pin the reader of card i to the i-th cpu (default the last cpus, one per card, -1 to not pin)\n");
+	printf("  --duration S      stop after S seconds (default until ctrl+c or end of input)\n");
+	printf("  --interval S      seconds between status lines (default 5)\n");
+	printf("  --compress        write .cxrf files (see rf_compress) instead of raw samples\n");
+	printf("  --compress-threads N  encoder threads per card (default the cpus left over after the readers, at least 1)\n");
+	printf("Example: %s /dev/cxadc0=video.u8 /dev/cxadc1=hifi.u8\n", me);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<card*> cards;
+	size_t buffer_mb = 256, block_kb = 4096;
+	uint64_t prealloc_gb = 0;
+	std::vector<int> cpus;
+	bool cpus_given = false;
+	double duration = 0, interval = 5;
+	bool compress = false;
+	int compress_threads = 0;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--buffer-mb" )        buffer_mb = atoll(next());
+		else if( a == "--block-kb" )    block_kb = atoll(next());
+		else if( a == "--prealloc-gb" ) prealloc_gb = atoll(next());
+		else if( a == "--cpus" )        { cpus = parse_cpus(next()); cpus_given = true; }
+		else if( a == "--duration" )    duration = atof(next());
+		else if( a == "--interval" )    interval = atof(next());
+		else if( a == "--compress" )    compress = true;
+		else if( a == "--compress-threads" ) compress_threads = atoi(next());
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a.find('=') != std::string::npos && a[0] != '-' )
+		{
+			card* c = new card;
+			c->in_path = a.substr(0, a.find('='));
+			c->out_path = a.substr(a.find('=') + 1);
+			cards.push_back(c);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( cards.empty() )
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if( block_kb == 0 || (block_kb * 1024) % DIRECT_ALIGN != 0 )
+	{
+		fprintf(stderr, "--block-kb must be a multiple of %d\n", DIRECT_ALIGN / 1024);
+		return 1;
+	}
+
+	int ncpu = (int)std::thread::hardware_concurrency();
+	if( compress && compress_threads <= 0 )
+		compress_threads = std::max(1, (ncpu - (int)cards.size()) / (int)cards.size());
+	if( !compress )
+		compress_threads = 0;
+	for(size_t i=0; i<cards.size(); ++i)
+	{
+		cards[i]->block_size = block_kb * 1024;
+		if( cpus_given )
+			cards[i]->cpu = (i < cpus.size()) ? cpus[i] : -1;
+		else
+			cards[i]->cpu = (ncpu > (int)i) ? ncpu - 1 - (int)i : -1;
+		if( !open_card(cards[i], buffer_mb << 20, prealloc_gb << 30, compress_threads) )
+			return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	for(card* c : cards)
+	{
+		c->writer = std::thread(writer, c);
+		c->reader = std::thread(reader, c);
+	}
+
+	auto start = clock_type::now();
+	auto last = start;
+	std::vector<uint64_t> last_read(cards.size(), 0);
+	while( !stop )
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if( duration > 0 && ms_since(start) >= duration * 1000 )
+			stop = 1;
+
+		bool all_done = true;
+		for(card* c : cards)
+		{
+			std::lock_guard<std::mutex> lock(c->mutex);
+			all_done = all_done && c->reader_done;
+		}
+
+		double span = ms_since(last) / 1000;
+		if( span < interval && !all_done )
+			continue;
+		last = clock_type::now();
+
+		for(size_t i=0; i<cards.size(); ++i)
+		{
+			card* c = cards[i];
+			std::lock_guard<std::mutex> lock(c->mutex);
+			fprintf(stderr, "%s: %7.2f MB/s, %llu MB written, buffer %3zu%% (peak %3zu%%, ever %3zu%%), %llu stalls, slowest write %.1f ms\n",
+				c->in_path.c_str(), (c->bytes_read - last_read[i]) / 1e6 / span, (unsigned long long)(c->bytes_written >> 20),
+				c->full_blocks.size() * 100 / c->blocks.size(), c->interval_peak_fill * 100 / c->blocks.size(),
+				c->peak_fill * 100 / c->blocks.size(), (unsigned long long)c->stalls, c->max_write_ms);
+			last_read[i] = c->bytes_read;
+			c->interval_peak_fill = c->full_blocks.size();
+		}
+
+		if( all_done )
+			break;
+	}
+
+	// the readers notice stop after their current read, the writers empty the buffers
+	stop = 1;
+	bool failed = false;
+	for(card* c : cards)
+	{
+		c->reader.join();
+		c->writer.join();
+		close_card(c);
+		failed = failed || c->failed || c->stalls;
+		fprintf(stderr, "%s: %llu bytes to %s, buffer peak %zu%%, %llu stalls\n", c->in_path.c_str(), (unsigned long long)c->bytes_written,
+			c->out_path.c_str(), c->peak_fill * 100 / c->blocks.size(), (unsigned long long)c->stalls);
+		if( compress && c->bytes_read )
+			fprintf(stderr, "%s: %llu samples compressed to ratio %.3f\n", c->in_path.c_str(), (unsigned long long)c->bytes_read,
+				(double)c->bytes_written / c->bytes_read);
+	}
+	return failed ? 2 : 0;
+}
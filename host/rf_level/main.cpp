@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Picks the cxadc level and sixdb from histograms of the live RF, see README.md
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define LEVEL_MAX 31
+#define READ_BYTES (1 << 20)
+
+struct histogram
+{
+	uint64_t count[256] = {};
+	uint64_t total = 0;
+};
+
+// Four tables, so a run of the same value doesn't wait on its own increment every sample. This is what keeps up
+// with several cards, a single table is bound by the store to load latency on typical RF
+static void add_samples(histogram& h, const uint8_t* p, size_t n)
+{
+	uint32_t t[4][256] = {};
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4)
+	{
+		++t[0][p[i]];
+		++t[1][p[i + 1]];
+		++t[2][p[i + 2]];
+		++t[3][p[i + 3]];
+	}
+	for(; i < n; ++i)
+		++t[0][p[i]];
+	for(int v=0; v<256; ++v)
+		h.count[v] += (uint64_t)t[0][v] + t[1][v] + t[2][v] + t[3][v];
+	h.total += n;
+}
+
+struct level_stats
+{
+	double clip_rate = 0;
+	// the range without the rarest tail at both ends
+	int lo = 0;
+	int hi = 0;
+	double used = 0;
+};
+
+static level_stats analyze(const histogram& h, double tail)
+{
+	level_stats s;
+	if( !h.total )
+		return s;
+	s.clip_rate = (double)(h.count[0] + h.count[255]) / h.total;
+	uint64_t skip = (uint64_t)(tail * h.total);
+	uint64_t sum = 0;
+	for(s.lo = 0; s.lo < 255 && (sum += h.count[s.lo]) <= skip; ++s.lo) {}
+	sum = 0;
+	for(s.hi = 255; s.hi > 0 && (sum += h.count[s.hi]) <= skip; --s.hi) {}
+	s.used = (s.hi >= s.lo) ? (s.hi - s.lo + 1) / 256.0 : 0;
+	return s;
+}
+
+struct config
+{
+	double window_ms = 200;
+	double settle_ms = 100;
+	double tail = 1e-4;
+	double max_clip = 1e-6;
+	double target = 0.9;
+	// -1 tries without first, then with if level 31 is not enough
+	int sixdb = -1;
+	bool sweep = false;
+	bool dry_run = false;
+};
+
+struct card
+{
+	int n;
+	std::string dev;
+	std::string params;
+	std::string orig_level, orig_sixdb, orig_tenbit;
+	int level = 0;
+	int sixdb = 0;
+	level_stats stats;
+	bool ok = false;
+	bool failed = false;
+	std::vector<std::string> log;
+};
+
+static std::mutex print_mutex;
+
+static std::string read_param(const card& c, const char* name)
+{
+	std::ifstream f(c.params + "/" + name);
+	std::string s;
+	std::getline(f, s);
+	return s;
+}
+
+static bool write_param(const card& c, const char* name, const std::string& value)
+{
+	std::ofstream f(c.params + "/" + name);
+	f << value << "\n";
+	f.flush();
+	if( !f )
+	{
+		std::lock_guard<std::mutex> lock(print_mutex);
+		fprintf(stderr, "%s/%s: can't write, run as root or fix the permissions\n", c.params.c_str(), name);
+		return false;
+	}
+	return true;
+}
+
+// reopened for every window, so nothing from the ring of the previous setting is in it
+static bool measure(card& c, const config& cfg, histogram& h)
+{
+	int fd = open(c.dev.c_str(), O_RDONLY);
+	if( fd < 0 )
+	{
+		std::lock_guard<std::mutex> lock(print_mutex);
+		fprintf(stderr, "%s: %s\n", c.dev.c_str(), strerror(errno));
+		return false;
+	}
+	// cxadc always runs at 8 bit 40 MSps here, tenbit is off while measuring
+	uint64_t settle = (uint64_t)(cfg.settle_ms * 40000), window = (uint64_t)(cfg.window_ms * 40000);
+	std::vector<uint8_t> buf(READ_BYTES);
+	uint64_t got = 0;
+	while( got < settle + window )
+	{
+		ssize_t n = read(fd, buf.data(), std::min<uint64_t>(buf.size(), settle + window - got));
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			break;
+		if( got + n > settle )
+		{
+			size_t skip = (got < settle) ? settle - got : 0;
+			add_samples(h, buf.data() + skip, n - skip);
+		}
+		got += n;
+	}
+	close(fd);
+	return h.total > 0;
+}
+
+static bool try_setting(card& c, const config& cfg, int sixdb, int level, level_stats& s)
+{
+	if( !write_param(c, "sixdb", std::to_string(sixdb)) || !write_param(c, "level", std::to_string(level)) )
+		return false;
+	histogram h;
+	if( !measure(c, cfg, h) )
+		return false;
+	s = analyze(h, cfg.tail);
+	char line[160];
+	snprintf(line, sizeof(line), "sixdb %d level %2d: clips %.6f %%, range %3d..%3d (%.0f %%)", sixdb, level,
+		s.clip_rate * 100, s.lo, s.hi, s.used * 100);
+	c.log.push_back(line);
+	return true;
+}
+
+static bool good(const level_stats& s, const config& cfg)
+{
+	return s.clip_rate <= cfg.max_clip && s.used <= cfg.target;
+}
+
+// the highest level that is still good, -1 if not even level 0 is
+static int search(card& c, const config& cfg, int sixdb, level_stats& best)
+{
+	level_stats s;
+	if( cfg.sweep )
+	{
+		int found = -1;
+		for(int level=0; level<=LEVEL_MAX; ++level)
+		{
+			if( !try_setting(c, cfg, sixdb, level, s) )
+				return -2;
+			if( good(s, cfg) )
+			{
+				found = level;
+				best = s;
+			}
+		}
+		return found;
+	}
+
+	// more level is more gain, so the good ones are a prefix
+	int lo = 0, hi = LEVEL_MAX, found = -1;
+	while( lo <= hi )
+	{
+		int mid = (lo + hi) / 2;
+		if( !try_setting(c, cfg, sixdb, mid, s) )
+			return -2;
+		if( good(s, cfg) )
+		{
+			found = mid;
+			best = s;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+	return found;
+}
+
+static void calibrate(card* c, const config* cfg)
+{
+	c->orig_level = read_param(*c, "level");
+	c->orig_sixdb = read_param(*c, "sixdb");
+	c->orig_tenbit = read_param(*c, "tenbit");
+	if( c->orig_level.empty() )
+	{
+		std::lock_guard<std::mutex> lock(print_mutex);
+		fprintf(stderr, "%s: no cxadc card there\n", c->params.c_str());
+		c->failed = true;
+		return;
+	}
+	if( c->orig_tenbit != "0" && !write_param(*c, "tenbit", "0") )
+	{
+		c->failed = true;
+		return;
+	}
+
+	level_stats s;
+	int sixdb = (cfg->sixdb < 0) ? 0 : cfg->sixdb;
+	int level = search(*c, *cfg, sixdb, s);
+	// +6 dB only if the most gain without it still leaves range unused
+	if( level == LEVEL_MAX && cfg->sixdb < 0 )
+	{
+		level_stats s6;
+		int level6 = search(*c, *cfg, 1, s6);
+		if( level6 >= 0 && s6.used > s.used )
+		{
+			sixdb = 1;
+			level = level6;
+			s = s6;
+		}
+	}
+
+	c->failed = (level == -2);
+	c->ok = (level >= 0);
+	c->level = c->ok ? level : 0;
+	c->sixdb = c->ok ? sixdb : 0;
+	c->stats = s;
+
+	// what was there before on a dry run or an error. If it clips even at level 0 that is the least gain there is
+	if( cfg->dry_run || c->failed )
+	{
+		write_param(*c, "sixdb", c->orig_sixdb);
+		write_param(*c, "level", c->orig_level);
+	}
+	else
+	{
+		write_param(*c, "sixdb", std::to_string(c->sixdb));
+		write_param(*c, "level", std::to_string(c->level));
+	}
+	if( c->orig_tenbit != "0" )
+		write_param(*c, "tenbit", c->orig_tenbit);
+}
+
+// the same numbers for a recording, one line per window
+static int run_stats(const std::string& path, const config& cfg)
+{
+	FILE* f = (path == "-") ? stdin : fopen(path.c_str(), "rb");
+	if( !f )
+	{
+		perror(path.c_str());
+		return 1;
+	}
+	uint64_t window = (uint64_t)(cfg.window_ms * 40000);
+	std::vector<uint8_t> buf(READ_BYTES);
+	histogram h, all;
+	uint64_t pos = 0;
+	size_t n;
+	bool clipped = false;
+	auto flush = [&](histogram& w)
+	{
+		level_stats s = analyze(w, cfg.tail);
+		clipped |= s.clip_rate > cfg.max_clip;
+		printf("%10.3f s: clips %.6f %%, range %3d..%3d (%.0f %%)\n", (double)(pos - w.total) / 40e6, s.clip_rate * 100,
+			s.lo, s.hi, s.used * 100);
+		w = histogram();
+	};
+	while( (n = fread(buf.data(), 1, std::min<uint64_t>(buf.size(), window - h.total), f)) > 0 )
+	{
+		add_samples(h, buf.data(), n);
+		add_samples(all, buf.data(), n);
+		pos += n;
+		if( h.total == window )
+			flush(h);
+	}
+	if( h.total )
+		flush(h);
+	if( f != stdin )
+		fclose(f);
+	level_stats s = analyze(all, cfg.tail);
+	printf("all: clips %.6f %%, range %d..%d (%.0f %%)\n", s.clip_rate * 100, s.lo, s.hi, s.used * 100);
+	return clipped ? 2 : 0;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] CARD...\n", me);
+	printf("  CARD             the number of a cxadc card, or /dev/cxadcN\n");
+	printf("  --target F       most of the 0-255 range to use (default 0.9)\n");
+	printf("  --max-clip F     fraction of samples at 0 or 255 that is still fine (default 1e-6)\n");
+	printf("  --tail F         fraction at each end left out of the range (default 1e-4)\n");
+	printf("  --window-ms N    measure this long per setting (default 200)\n");
+	printf("  --settle-ms N    and drop this much after a change first (default 100)\n");
+	printf("  --sixdb 0|1      only this, default tries without first\n");
+	printf("  --sweep          measure every level instead of a binary search, print them all\n");
+	printf("  --dry-run        put the old settings back afterwards\n");
+	printf("  --stats FILE     print the same numbers per window for an 8 bit recording instead\n");
+	printf("The cards are measured at the same time, so the signal should be playing already.\n");
+}
+
+int main(int argc, char** argv)
+{
+	config cfg;
+	std::string stats;
+	std::vector<card> cards;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--target" )           cfg.target = atof(next());
+		else if( a == "--max-clip" )    cfg.max_clip = atof(next());
+		else if( a == "--tail" )        cfg.tail = atof(next());
+		else if( a == "--window-ms" )   cfg.window_ms = atof(next());
+		else if( a == "--settle-ms" )   cfg.settle_ms = atof(next());
+		else if( a == "--sixdb" )       cfg.sixdb = atoi(next()) ? 1 : 0;
+		else if( a == "--sweep" )       cfg.sweep = true;
+		else if( a == "--dry-run" )     cfg.dry_run = true;
+		else if( a == "--stats" )       stats = next();
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a[0] != '-' )
+		{
+			card c;
+			if( sscanf(a.c_str(), "/dev/cxadc%d", &c.n) != 1 && sscanf(a.c_str(), "%d", &c.n) != 1 )
+			{
+				fprintf(stderr, "'%s' is not a cxadc card\n", a.c_str());
+				return 1;
+			}
+			c.dev = "/dev/cxadc" + std::to_string(c.n);
+			c.params = "/sys/class/cxadc/cxadc" + std::to_string(c.n) + "/device/parameters";
+			cards.push_back(c);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( cfg.window_ms <= 0 || cfg.settle_ms < 0 )
+	{
+		fprintf(stderr, "--window-ms must be more than 0\n");
+		return 1;
+	}
+	if( !stats.empty() )
+		return run_stats(stats, cfg);
+	if( cards.empty() )
+	{
+		fprintf(stderr, "no cards given, see --help\n");
+		return 1;
+	}
+
+	std::vector<std::thread> threads;
+	for(card& c : cards)
+		threads.emplace_back(calibrate, &c, &cfg);
+	for(std::thread& t : threads)
+		t.join();
+
+	int ret = 0;
+	for(const card& c : cards)
+	{
+		if( cfg.sweep )
+			for(const std::string& line : c.log)
+				fprintf(stderr, "cxadc%d: %s\n", c.n, line.c_str());
+		if( c.failed )
+		{
+			if( c.orig_level.empty() )
+				fprintf(stderr, "cxadc%d: failed\n", c.n);
+			else
+				fprintf(stderr, "cxadc%d: failed, left at level %s sixdb %s\n", c.n, c.orig_level.c_str(), c.orig_sixdb.c_str());
+			ret = 1;
+			continue;
+		}
+		if( !c.ok )
+		{
+			fprintf(stderr, "cxadc%d: clips even at level 0, attenuate the signal\n", c.n);
+			ret = std::max(ret, 2);
+		}
+		else
+			fprintf(stderr, "cxadc%d: clips %.6f %%, range %d..%d (%.0f %%)\n", c.n, c.stats.clip_rate * 100,
+				c.stats.lo, c.stats.hi, c.stats.used * 100);
+		// for the capture script
+		printf("cxadc%d level=%d sixdb=%d\n", c.n, c.level, c.sixdb);
+	}
+	return ret;
+}
@@ -0,0 +1,365 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Merges the captures of several devices on the same clock into one sample aligned file by their sync marks, see README.md
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "stream_tag.h"
+
+#define CHANNELS 3
+// frames per output round
+#define CHUNK_FRAMES 4096
+// frames read per round while looking for tags, plus room for a tag that starts at the end
+#define SCAN_FRAMES  65536
+#define TAG_FRAMES   sizeof(stream_tag)
+
+// a run of frames in the file with consecutive sample indices, one per tag
+struct segment
+{
+	uint64_t file_frame;
+	uint64_t sample_index;
+	uint64_t frames;
+};
+
+struct device
+{
+	std::string path;
+	FILE* f = nullptr;
+
+	std::vector<segment> segments;
+	std::vector<uint64_t> syncs;
+	// sample index of this device at the first sync of the first device
+	int64_t offset = 0;
+
+	uint64_t tags = 0;
+	uint64_t gap_buffers = 0;
+	uint64_t missing_buffers = 0;
+	// sample indices without frames between two tags, the device or the host lost them
+	uint64_t missing_frames = 0;
+
+	// output side
+	size_t seg = 0;
+	uint64_t file_pos = UINT64_MAX;
+	uint64_t zero_frames = 0;
+	std::vector<uint8_t> frames;
+};
+
+static bool scan(device& d)
+{
+	std::vector<uint8_t> buf((SCAN_FRAMES + TAG_FRAMES) * STREAM_TAG_FRAME_BYTES);
+	size_t have = 0;
+	uint64_t base = 0;
+	bool have_last = false;
+	stream_tag last{};
+
+	auto close_segment = [&](uint64_t end_frame)
+	{
+		if( !d.segments.empty() )
+		{
+			segment& s = d.segments.back();
+			s.frames = end_frame - s.file_frame;
+		}
+	};
+
+	while( true )
+	{
+		size_t n = fread(buf.data() + have, 1, buf.size() - have, d.f);
+		have += n;
+		size_t frames = have / STREAM_TAG_FRAME_BYTES;
+		// a tag at the very end of the file is only complete if nothing more comes
+		size_t usable = (n == 0) ? (frames >= TAG_FRAMES ? frames - TAG_FRAMES + 1 : 0) : (frames > TAG_FRAMES ? frames - TAG_FRAMES : 0);
+
+		for(size_t i=0; i<usable; ++i)
+		{
+			const uint8_t* p = buf.data() + i * STREAM_TAG_FRAME_BYTES;
+			// cheap check on the first magic byte before the whole tag
+			if( p[STREAM_TAG_BYTE_OFFSET] != (STREAM_TAG_MAGIC & 0xff) )
+				continue;
+			stream_tag tag;
+			if( !stream_tag_extract(p, &tag) )
+				continue;
+
+			uint64_t file_frame = base + i;
+			close_segment(file_frame);
+			if( have_last )
+			{
+				const segment& s = d.segments.back();
+				if( tag.sample_index > s.sample_index + s.frames )
+					d.missing_frames += tag.sample_index - (s.sample_index + s.frames);
+				d.missing_buffers += tag.sequence - last.sequence - 1;
+			}
+			d.segments.push_back({ file_frame, tag.sample_index, 0 });
+			if( tag.flags & STREAM_TAG_FLAG_GAP )
+				++d.gap_buffers;
+			if( tag.flags & STREAM_TAG_FLAG_SYNC )
+				d.syncs.push_back(tag.sample_index + tag.sync_offset);
+			++d.tags;
+			last = tag;
+			have_last = true;
+		}
+
+		if( n == 0 )
+		{
+			close_segment(base + frames);
+			break;
+		}
+		memmove(buf.data(), buf.data() + usable * STREAM_TAG_FRAME_BYTES, have - usable * STREAM_TAG_FRAME_BYTES);
+		have -= usable * STREAM_TAG_FRAME_BYTES;
+		base += usable;
+	}
+
+	// the next tag may show the buffer was cut short, the segment only has the frames that are there
+	for(size_t i=0; i+1<d.segments.size(); ++i)
+	{
+		segment& s = d.segments[i];
+		s.frames = std::min(s.frames, d.segments[i + 1].sample_index > s.sample_index ? d.segments[i + 1].sample_index - s.sample_index : 0);
+	}
+	return !ferror(d.f);
+}
+
+// frames for sample indices index..index+n of the device, zeros where it has none
+static bool read_frames(device& d, uint64_t index, size_t n, uint8_t* out)
+{
+	while( n )
+	{
+		while( d.seg + 1 < d.segments.size() && d.segments[d.seg].sample_index + d.segments[d.seg].frames <= index )
+			++d.seg;
+		const segment& s = d.segments[d.seg];
+
+		size_t k;
+		if( index < s.sample_index || index >= s.sample_index + s.frames )
+		{
+			k = (index < s.sample_index) ? std::min<uint64_t>(n, s.sample_index - index) : n;
+			memset(out, 0, k * STREAM_TAG_FRAME_BYTES);
+			d.zero_frames += k;
+		}
+		else
+		{
+			k = std::min<uint64_t>(n, s.sample_index + s.frames - index);
+			uint64_t pos = s.file_frame + (index - s.sample_index);
+			if( pos != d.file_pos && fseeko(d.f, (off_t)(pos * STREAM_TAG_FRAME_BYTES), SEEK_SET) != 0 )
+				return false;
+			if( fread(out, STREAM_TAG_FRAME_BYTES, k, d.f) != k )
+				return false;
+			d.file_pos = pos + k;
+		}
+		index += k;
+		n -= k;
+		out += k * STREAM_TAG_FRAME_BYTES;
+	}
+	return true;
+}
+
+// Pairs the syncs of a device with the ones of the first device, returns false if any is off by more than tolerance or missing
+static bool check_syncs(const device& ref, const device& d, uint64_t tolerance, uint64_t window)
+{
+	uint64_t matched = 0, missing = 0, off = 0;
+	int64_t max_dev = 0, first_dev = 0, last_dev = 0;
+	uint64_t first_at = 0, last_at = 0;
+	size_t j = 0;
+	for(uint64_t r : ref.syncs)
+	{
+		int64_t expected = (int64_t)r + d.offset - ref.offset;
+		while( j + 1 < d.syncs.size() && (int64_t)d.syncs[j + 1] <= expected )
+			++j;
+		// nearest of the two around the expected position
+		size_t best = j;
+		if( j + 1 < d.syncs.size() && llabs((int64_t)d.syncs[j + 1] - expected) < llabs((int64_t)d.syncs[j] - expected) )
+			best = j + 1;
+		int64_t dev = (int64_t)d.syncs[best] - expected;
+		if( (uint64_t)llabs(dev) > window )
+		{
+			++missing;
+			continue;
+		}
+		if( matched++ == 0 )
+		{
+			first_dev = dev;
+			first_at = r;
+		}
+		last_dev = dev;
+		last_at = r;
+		if( llabs(dev) > llabs(max_dev) )
+			max_dev = dev;
+		if( (uint64_t)llabs(dev) > tolerance )
+		{
+			if( off++ < 10 )
+				fprintf(stderr, "%s: sync at sample index %llu is %+lld frames off\n", d.path.c_str(), (unsigned long long)d.syncs[best],
+					(long long)dev);
+		}
+	}
+
+	double ppm = (last_at > first_at) ? (double)(last_dev - first_dev) * 1e6 / (double)(last_at - first_at) : 0;
+	fprintf(stderr, "%s: %llu of %zu syncs matched, %llu not found, %llu off by more than %llu frames, largest %+lld, drift %.2f ppm\n",
+		d.path.c_str(), (unsigned long long)matched, ref.syncs.size(), (unsigned long long)missing, (unsigned long long)off,
+		(unsigned long long)tolerance, (long long)max_dev, ppm);
+	return missing == 0 && off == 0 && d.syncs.size() == ref.syncs.size();
+}
+
+static std::vector<int> parse_channels(const std::string& s)
+{
+	std::vector<int> ret;
+	size_t pos = 0;
+	while( pos < s.size() )
+	{
+		size_t comma = s.find(',', pos);
+		ret.push_back(atoi(s.substr(pos, comma - pos).c_str()));
+		if( comma == std::string::npos )
+			break;
+		pos = comma + 1;
+	}
+	return ret;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options] FILE... > merged.s24\n", me);
+	printf("  --channels A,B,...  channels of every device to keep (default 0,1,2)\n");
+	printf("  --tolerance N       frames a sync may be off against the first device (default 1)\n");
+	printf("  --window N          a sync further off than this counts as missing (default 1000)\n");
+	printf("Every FILE is a tagged 3 channel S24_3LE capture of one device. The output is S24_3LE with the kept channels\n");
+	printf("of the first device, then the second one and so on, aligned on the first sync of each.\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<device*> devices;
+	std::vector<int> channels = { 0, 1, 2 };
+	uint64_t tolerance = 1, window = 1000;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--channels" )       channels = parse_channels(next());
+		else if( a == "--tolerance" ) tolerance = strtoull(next(), nullptr, 0);
+		else if( a == "--window" )    window = strtoull(next(), nullptr, 0);
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else if( a[0] != '-' )
+		{
+			device* d = new device;
+			d->path = a;
+			devices.push_back(d);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( devices.empty() )
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	for(int c : channels)
+	{
+		if( c < 0 || c >= CHANNELS )
+		{
+			fprintf(stderr, "channel %d out of range\n", c);
+			return 1;
+		}
+	}
+
+	for(device* d : devices)
+	{
+		if( !(d->f = fopen(d->path.c_str(), "rb")) )
+		{
+			perror(d->path.c_str());
+			return 1;
+		}
+		if( !scan(*d) )
+		{
+			perror(d->path.c_str());
+			return 1;
+		}
+		fprintf(stderr, "%s: %llu tags, %zu syncs, %llu buffers with the gap flag, %llu buffers missing, %llu frames missing\n",
+			d->path.c_str(), (unsigned long long)d->tags, d->syncs.size(), (unsigned long long)d->gap_buffers,
+			(unsigned long long)d->missing_buffers, (unsigned long long)d->missing_frames);
+		if( d->syncs.empty() )
+		{
+			fprintf(stderr, "%s: no sync found, is GPIO14 connected?\n", d->path.c_str());
+			return 1;
+		}
+		d->offset = (int64_t)d->syncs[0];
+	}
+
+	// check against the first device
+	device* ref = devices[0];
+	bool ok = true;
+	for(size_t i=1; i<devices.size(); ++i)
+		ok = check_syncs(*ref, *devices[i], tolerance, window) && ok;
+
+	// range every device has, in sample indices of the first device
+	int64_t start = INT64_MIN, end = INT64_MAX;
+	for(device* d : devices)
+	{
+		const segment& first = d->segments.front();
+		const segment& last = d->segments.back();
+		start = std::max(start, (int64_t)first.sample_index - d->offset);
+		end = std::min(end, (int64_t)(last.sample_index + last.frames) - d->offset);
+	}
+	if( end <= start )
+	{
+		fprintf(stderr, "the captures do not overlap\n");
+		return 1;
+	}
+
+	size_t out_frame = devices.size() * channels.size() * 3;
+	std::vector<uint8_t> out(CHUNK_FRAMES * out_frame);
+	for(device* d : devices)
+		d->frames.resize(CHUNK_FRAMES * STREAM_TAG_FRAME_BYTES);
+
+	for(int64_t t = start; t < end; t += CHUNK_FRAMES)
+	{
+		size_t n = (size_t)std::min<int64_t>(CHUNK_FRAMES, end - t);
+		for(size_t di=0; di<devices.size(); ++di)
+		{
+			device* d = devices[di];
+			if( !read_frames(*d, (uint64_t)(t + d->offset), n, d->frames.data()) )
+			{
+				fprintf(stderr, "%s: read failed\n", d->path.c_str());
+				return 1;
+			}
+			for(size_t i=0; i<n; ++i)
+				for(size_t c=0; c<channels.size(); ++c)
+					memcpy(out.data() + i * out_frame + (di * channels.size() + c) * 3,
+						d->frames.data() + i * STREAM_TAG_FRAME_BYTES + channels[c] * 3, 3);
+		}
+		if( fwrite(out.data(), out_frame, n, stdout) != n )
+		{
+			fprintf(stderr, "write failed\n");
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%lld frames of %zu channels, the first sync is at frame %lld\n", (long long)(end - start),
+		devices.size() * channels.size(), (long long)(-start));
+	for(device* d : devices)
+	{
+		if( d->zero_frames )
+			fprintf(stderr, "%s: %llu frames filled with zeros\n", d->path.c_str(), (unsigned long long)d->zero_frames);
+		ok = ok && d->zero_frames == 0;
+	}
+	return ok ? 0 : 2;
+}
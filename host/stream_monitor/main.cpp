@@ -0,0 +1,605 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2024 namazso <admin@namazso.eu>
+
+// Sits in the capture pipes of the CXADC and audio streams and checks them against each other, see README.md
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "audio_monitor.h"
+#include "capture.h"
+#include "stream_scanner.h"
+
+#define FRAMES_PER_BUFFER CLOCKGEN_FRAMES_PER_BUFFER
+// the ADC rate with clock 0 at 40 MHz, for a recording without --rate
+#define DEFAULT_RATE      78125
+
+// CXADC at 40 MHz, one byte per sample in 8 bit mode, the default ratio is this over the audio rate
+#define RF_RATE           40e6
+
+#define READ_CHUNK        (1 << 20)
+#define POLL_MS           100
+// pipes fill up while the capture processes start, no comparisons before that
+#define SETTLE_MS         1000
+// an offset has to stay this long to count, a stalled pipe catches up again
+#define PERSIST_POLLS     10
+// it is a jump (lost chunk) if it was not there this long before, drift otherwise
+#define HISTORY_POLLS     (2 * PERSIST_POLLS)
+
+using clock_type = std::chrono::steady_clock;
+
+static volatile sig_atomic_t stop = 0;
+static clock_type::time_point start_time;
+
+static void on_signal(int)
+{
+	stop = 1;
+}
+
+static double seconds_since_start()
+{
+	return std::chrono::duration<double>(clock_type::now() - start_time).count();
+}
+
+static std::mutex log_mutex;
+
+template<typename... Args>
+static void event(const char* fmt, Args... args)
+{
+	std::lock_guard<std::mutex> lock(log_mutex);
+	fprintf(stderr, "[%10.3f] ", seconds_since_start());
+	fprintf(stderr, fmt, args...);
+}
+
+// One input, optionally passed on to an output file or FIFO
+struct stream
+{
+	std::string name;
+	std::string in_path;
+	std::string out_path;
+	// RF bytes per audio frame, 0 until the audio rate is known
+	double ratio = 0;
+
+	FILE* in = nullptr;
+	FILE* out = nullptr;
+	std::thread thread;
+	std::atomic<bool> done{false};
+
+	std::mutex mutex;
+	uint64_t bytes = 0;
+};
+
+struct audio_stream : stream
+{
+	// the audio can also come from the device itself
+	std::unique_ptr<capture_source> source;
+	// frames per second, from the source or --rate
+	unsigned rate = 0;
+	// --monitor, gets the same bytes as out=
+	audio_monitor* monitor = nullptr;
+	// --edges, head switch edges from the tags
+	FILE* edges = nullptr;
+	uint64_t edge_count = 0;
+
+	// latest position on the device timeline: sample index of the last tag plus the frames received since
+	bool have_tag = false;
+	uint64_t sample_index = 0;
+
+	uint64_t tags = 0;
+	uint64_t device_gap_frames = 0;
+	uint64_t device_fill_frames = 0;
+	uint64_t missing_buffers = 0;
+	uint64_t transit_lost_frames = 0;
+	uint64_t resyncs = 0;
+};
+
+static bool open_output(stream& s)
+{
+	if( !s.out_path.empty() )
+	{
+		s.out = (s.out_path == "-") ? stdout : fopen(s.out_path.c_str(), "wb");
+		if( !s.out )
+		{
+			perror(s.out_path.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool open_stream(stream& s)
+{
+	s.in = (s.in_path == "-") ? stdin : fopen(s.in_path.c_str(), "rb");
+	if( !s.in )
+	{
+		perror(s.in_path.c_str());
+		return false;
+	}
+	return open_output(s);
+}
+
+static bool open_audio(audio_stream& s)
+{
+	std::string err;
+	s.source = capture_source::open(s.in_path, s.rate, err);
+	if( !s.source )
+	{
+		fprintf(stderr, "%s\n", err.c_str());
+		return false;
+	}
+	if( s.source->rate() )
+		s.rate = s.source->rate();
+	else if( !s.rate )
+		s.rate = DEFAULT_RATE;
+	return open_output(s);
+}
+
+static bool pass_on(stream& s, const uint8_t* data, size_t n)
+{
+	if( s.out && fwrite(data, 1, n, s.out) != n )
+	{
+		event("%s: writing %s failed\n", s.name.c_str(), s.out_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// whatever is there, fread() would wait for the whole chunk
+static size_t read_some(stream* s, std::vector<uint8_t>& buf)
+{
+	ssize_t n = read(fileno(s->in), buf.data(), buf.size());
+	return (n > 0) ? (size_t)n : 0;
+}
+
+static void rf_reader(stream* s)
+{
+	std::vector<uint8_t> buf(READ_CHUNK);
+	size_t n;
+	while( !stop && (n = read_some(s, buf)) > 0 )
+	{
+		if( !pass_on(*s, buf.data(), n) )
+			break;
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->bytes += n;
+	}
+	s->done = true;
+}
+
+// Finds the stream tags and tells apart what the device lost (gap flag), what it never sent (tag sequence)
+// and what got lost on the way to us (frames missing between two tags)
+class audio_parser
+{
+public:
+	explicit audio_parser(audio_stream* s) : s(s)
+	{
+		scanner.on_buffer = [this](const stream_tag& tag, std::span<const uint8_t>, uint64_t offset)
+		{
+			found(tag, offset);
+		};
+	}
+
+	void feed(const uint8_t* data, size_t len)
+	{
+		scanner.feed({ data, len });
+
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->bytes += len;
+		if( have_last )
+			s->sample_index = last.sample_index + (s->bytes - last_offset) / STREAM_TAG_FRAME_BYTES;
+	}
+
+private:
+	static constexpr size_t BUFFER_BYTES = CLOCKGEN_BUFFER_BYTES;
+
+	void found(const stream_tag& tag, uint64_t offset)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		++s->tags;
+		if( have_last )
+		{
+			uint32_t seq_delta = tag.sequence - last.sequence;
+			uint64_t gap = offset - last_offset;
+			uint64_t received = gap / STREAM_TAG_FRAME_BYTES;
+			uint64_t sent = (uint64_t)seq_delta * FRAMES_PER_BUFFER;
+
+			if( gap % BUFFER_BYTES != 0 || received < sent )
+			{
+				// only part of a buffer went missing, that happened on the host side
+				uint64_t lost = (sent > received) ? sent - received : 0;
+				++s->resyncs;
+				s->transit_lost_frames += lost;
+				const char* what = (lost * 1000 < (uint64_t)s->rate * 2) ? "dropped USB packet" : "xrun";
+				event("%s: %llu frames lost on the host side (%s) before sample index %llu, byte %llu\n", s->name.c_str(),
+					(unsigned long long)lost, what, (unsigned long long)tag.sample_index, (unsigned long long)offset);
+			}
+			else if( seq_delta > 1 )
+			{
+				s->missing_buffers += seq_delta - 1;
+				event("%s: %u buffers missing (dropped by the device or lost whole) before sample index %llu, byte %llu\n", s->name.c_str(),
+					seq_delta - 1, (unsigned long long)tag.sample_index, (unsigned long long)offset);
+			}
+
+			uint64_t expected = last.sample_index + sent;
+			if( tag.sample_index > expected )
+			{
+				s->device_gap_frames += tag.sample_index - expected;
+				event("%s: device lost %llu frames%s at sample index %llu, byte %llu\n", s->name.c_str(),
+					(unsigned long long)(tag.sample_index - expected), (tag.flags & STREAM_TAG_FLAG_GAP) ? "" : " (no gap flag!)",
+					(unsigned long long)tag.sample_index, (unsigned long long)offset);
+			}
+		}
+		else
+		{
+			event("%s: first tag, sample index %llu\n", s->name.c_str(), (unsigned long long)tag.sample_index);
+		}
+
+		// an outage comes as a run of buffers with fill frames, reported once it is over
+		if( tag.flags & STREAM_TAG_FLAG_FILL )
+		{
+			if( fill_run == 0 )
+				fill_start = tag.sample_index;
+			fill_run += tag.fill_frames;
+			s->device_fill_frames += tag.fill_frames;
+		}
+		else if( fill_run )
+		{
+			event("%s: device had no ADC data for %llu frames from sample index %llu on, sent as fill frames\n", s->name.c_str(),
+				(unsigned long long)fill_run, (unsigned long long)fill_start);
+			fill_run = 0;
+		}
+
+		if( s->edges && (tag.flags & STREAM_TAG_FLAG_HEAD_SWITCH) )
+		{
+			// sample index and 1/64 frames, exact in 6 decimals
+			int64_t pos = (int64_t)tag.sample_index * 64 + tag.head_switch_offset;
+			fprintf(s->edges, "%lld.%06u %s\n", (long long)(pos / 64), (unsigned)(pos % 64) * 15625,
+				(tag.flags & STREAM_TAG_FLAG_HEAD_SWITCH_HIGH) ? "rise" : "fall");
+			++s->edge_count;
+		}
+
+		have_last = true;
+		last = tag;
+		last_offset = offset;
+		s->have_tag = true;
+		s->sample_index = tag.sample_index;
+	}
+
+	audio_stream* s;
+	stream_scanner scanner;
+	bool have_last = false;
+	stream_tag last{};
+	uint64_t last_offset = 0;
+	uint64_t fill_run = 0;
+	uint64_t fill_start = 0;
+};
+
+static void audio_reader(audio_stream* s)
+{
+	audio_parser parser(s);
+	std::vector<uint8_t> buf(READ_CHUNK / 16);
+	size_t n;
+	while( !stop && (n = s->source->read(buf)) > 0 )
+	{
+		if( !pass_on(*s, buf.data(), n) )
+			break;
+		if( s->monitor )
+			s->monitor->push(buf.data(), n);
+		parser.feed(buf.data(), n);
+	}
+	s->done = true;
+}
+
+// RF bytes against the audio timeline, d = rf_bytes - ratio * sample_index should stay constant on a shared clock
+struct rf_tracker
+{
+	bool have_base = false;
+	double base = 0;
+	uint64_t base_index = 0;
+	// d of the last polls, and for how many of them it was out of tolerance
+	std::deque<double> history;
+	uint32_t out_polls = 0;
+	// where it first went out of tolerance
+	uint64_t onset_bytes = 0;
+	uint64_t onset_index = 0;
+	uint64_t jumps = 0;
+	uint64_t drifts = 0;
+};
+
+static void check_rf(stream& rf, rf_tracker& t, uint64_t rf_bytes, uint64_t sample_index, unsigned rate, double tolerance_ms, bool report)
+{
+	double d = (double)rf_bytes - rf.ratio * (double)sample_index;
+	double tolerance = rf.ratio * rate * tolerance_ms / 1000.0;
+	double ms_per_byte = 1000.0 / (rf.ratio * rate);
+
+	t.history.push_back(d);
+	if( t.history.size() > HISTORY_POLLS )
+		t.history.pop_front();
+
+	if( !t.have_base )
+	{
+		t.have_base = true;
+		t.base = d;
+		t.base_index = sample_index;
+		return;
+	}
+
+	double off = d - t.base;
+	t.out_polls = (fabs(off) > tolerance) ? t.out_polls + 1 : 0;
+	if( t.out_polls == 1 )
+	{
+		t.onset_bytes = rf_bytes;
+		t.onset_index = sample_index;
+	}
+	if( t.out_polls >= PERSIST_POLLS )
+	{
+		// the average of the persisting polls is the new base, single polls jitter by a read chunk
+		double settled = 0;
+		for(size_t i=t.history.size() - PERSIST_POLLS; i<t.history.size(); ++i)
+			settled += t.history[i];
+		settled /= PERSIST_POLLS;
+		off = settled - t.base;
+
+		if( t.history.size() == HISTORY_POLLS && fabs(t.history.front() - t.base) < tolerance )
+		{
+			// a whole chunk of one stream is missing
+			++t.jumps;
+			event("%s: %+.0f bytes (%+.1f ms) against the audio at rf byte %llu, audio sample index %llu%s\n", rf.name.c_str(),
+				off, off * ms_per_byte, (unsigned long long)t.onset_bytes, (unsigned long long)t.onset_index,
+				(off < 0) ? " (cxadc overrun?)" : " (audio lost?)");
+		}
+		else
+		{
+			// slowly walking away, the two streams are not on the same clock or the ratio is wrong
+			++t.drifts;
+			double ppm = off / (rf.ratio * (double)(sample_index - t.base_index)) * 1e6;
+			event("%s: drifted %+.0f bytes (%+.1f ppm) against the audio since sample index %llu\n", rf.name.c_str(),
+				off, ppm, (unsigned long long)t.base_index);
+		}
+		t.base = settled;
+		t.base_index = sample_index;
+		t.out_polls = 0;
+	}
+	else if( report && sample_index > t.base_index )
+	{
+		event("%s: %+.1f ms against the audio since sample index %llu\n", rf.name.c_str(),
+			off * ms_per_byte, (unsigned long long)t.base_index);
+	}
+}
+
+static bool parse_stream(const std::string& arg, stream& s)
+{
+	// PATH[,out=FILE][,ratio=N]
+	size_t comma = arg.find(',');
+	s.in_path = arg.substr(0, comma);
+	while( comma != std::string::npos )
+	{
+		size_t next = arg.find(',', comma + 1);
+		std::string opt = arg.substr(comma + 1, next == std::string::npos ? std::string::npos : next - comma - 1);
+		if( opt.rfind("out=", 0) == 0 )
+			s.out_path = opt.substr(4);
+		else if( opt.rfind("ratio=", 0) == 0 )
+			s.ratio = atof(opt.c_str() + 6);
+		else
+		{
+			fprintf(stderr, "unknown stream option '%s'\n", opt.c_str());
+			return false;
+		}
+		comma = next;
+	}
+	return !s.in_path.empty() && s.ratio >= 0;
+}
+
+static void usage(const char* me)
+{
+	printf("Usage: %s [options]\n", me);
+	printf("  --audio SRC[,out=FILE]           tagged 3 channel S24_3LE, see below\n");
+	printf("  --rate HZ                        audio rate, asked from the device, needed for a recording made at\n");
+	printf("                                   another rate than %u\n", DEFAULT_RATE);
+	printf("  --rf SRC[,out=FILE][,ratio=N]    CXADC bytes, N per audio frame (default 40 MHz / rate, 512 at %u,\n", DEFAULT_RATE);
+	printf("                                   double it for 16 bit)\n");
+	printf("  --tolerance-ms T                 buffering jitter allowed between the streams (default 100)\n");
+	printf("  --interval S                     seconds between status lines (default 10)\n");
+	printf("  --monitor SINK[,options]         also play the audio, resampled\n");
+	printf("  --edges FILE                     write the head switch edges from the tags, one per line\n");
+	printf("Every input is passed on to its out= file or FIFO unchanged, - for stdout.\n");
+	printf("%s", capture_source::help());
+	printf("%s", audio_monitor::help());
+}
+
+int main(int argc, char** argv)
+{
+	audio_stream audio;
+	bool have_audio = false;
+	bool monitor = false;
+	audio_monitor::config monitor_cfg;
+	std::vector<stream*> rfs;
+	double tolerance_ms = 100;
+	double interval = 10;
+
+	for(int i=1; i<argc; ++i)
+	{
+		std::string a = argv[i];
+		auto next = [&]() -> const char*
+		{
+			if( i + 1 >= argc )
+			{
+				fprintf(stderr, "missing value for %s\n", a.c_str());
+				exit(1);
+			}
+			return argv[++i];
+		};
+
+		if( a == "--audio" )
+		{
+			if( !parse_stream(next(), audio) )
+				return 1;
+			audio.name = "audio";
+			have_audio = true;
+		}
+		else if( a == "--rf" )
+		{
+			stream* s = new stream;
+			if( !parse_stream(next(), *s) )
+				return 1;
+			s->name = "rf" + std::to_string(rfs.size());
+			rfs.push_back(s);
+		}
+		else if( a == "--monitor" )
+		{
+			std::string err;
+			if( !audio_monitor::parse(next(), monitor_cfg, err) )
+			{
+				fprintf(stderr, "%s\n", err.c_str());
+				return 1;
+			}
+			monitor = true;
+		}
+		else if( a == "--edges" )
+		{
+			const char* path = next();
+			audio.edges = fopen(path, "w");
+			if( !audio.edges )
+			{
+				perror(path);
+				return 1;
+			}
+		}
+		else if( a == "--rate" )         audio.rate = (unsigned)atoi(next());
+		else if( a == "--tolerance-ms" ) tolerance_ms = atof(next());
+		else if( a == "--interval" )     interval = atof(next());
+		else if( a == "--help" || a == "-h" )
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			fprintf(stderr, "unknown option '%s', see --help\n", a.c_str());
+			return 1;
+		}
+	}
+
+	if( !have_audio && rfs.empty() )
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	start_time = clock_type::now();
+
+	if( have_audio )
+	{
+		if( !open_audio(audio) )
+			return 1;
+		// in= of the monitor follows the audio unless it was given
+		if( monitor && monitor_cfg.in_rate == audio_monitor::config{}.in_rate )
+			monitor_cfg.in_rate = audio.rate;
+		if( monitor )
+			audio.monitor = new audio_monitor(monitor_cfg);
+		audio.thread = std::thread(audio_reader, &audio);
+	}
+	for(stream* s : rfs)
+	{
+		if( s->ratio == 0 )
+			s->ratio = RF_RATE / (audio.rate ? audio.rate : DEFAULT_RATE);
+		if( !open_stream(*s) )
+			return 1;
+		s->thread = std::thread(rf_reader, s);
+	}
+
+	std::vector<rf_tracker> trackers(rfs.size());
+	std::vector<uint64_t> last_bytes(rfs.size() + 1, 0);
+	double last_report = 0;
+	while( !stop )
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+		double now = seconds_since_start();
+
+		bool all_done = !have_audio || audio.done;
+		for(stream* s : rfs)
+			all_done = all_done && s->done;
+
+		bool have_index = false;
+		uint64_t sample_index = 0, audio_bytes = 0;
+		if( have_audio )
+		{
+			std::lock_guard<std::mutex> lock(audio.mutex);
+			have_index = audio.have_tag;
+			sample_index = audio.sample_index;
+			audio_bytes = audio.bytes;
+		}
+
+		bool report = (now - last_report) >= interval;
+		if( report )
+		{
+			// rates against the host clock, these include the host's own crystal error
+			double span = now - last_report;
+			if( have_audio )
+				event("audio: %llu bytes, %.1f frames/s, sample index %llu\n", (unsigned long long)audio_bytes,
+					(audio_bytes - last_bytes[0]) / STREAM_TAG_FRAME_BYTES / span, (unsigned long long)sample_index);
+			last_bytes[0] = audio_bytes;
+		}
+
+		for(size_t i=0; i<rfs.size(); ++i)
+		{
+			uint64_t rf_bytes;
+			{
+				std::lock_guard<std::mutex> lock(rfs[i]->mutex);
+				rf_bytes = rfs[i]->bytes;
+			}
+			if( report )
+			{
+				event("%s: %llu bytes, %.3f MB/s\n", rfs[i]->name.c_str(), (unsigned long long)rf_bytes,
+					(rf_bytes - last_bytes[i + 1]) / 1e6 / (now - last_report));
+				last_bytes[i + 1] = rf_bytes;
+			}
+			if( have_index && now * 1000 > SETTLE_MS && !audio.done && !rfs[i]->done )
+				check_rf(*rfs[i], trackers[i], rf_bytes, sample_index, audio.rate, tolerance_ms, report);
+		}
+		if( report )
+			last_report = now;
+
+		if( all_done )
+			break;
+	}
+
+	// a reader still blocked in fread() is left behind, the process exits anyway
+	stop = 1;
+	if( have_audio )
+		audio.done ? audio.thread.join() : audio.thread.detach();
+	for(stream* s : rfs)
+		s->done ? s->thread.join() : s->thread.detach();
+	if( audio.monitor )
+		audio.monitor->stop();
+	if( audio.edges )
+		fclose(audio.edges);
+
+	if( have_audio )
+		fprintf(stderr, "audio: %llu tags, %llu frames lost by the device, %llu filled by the device, %llu buffers missing, %llu frames lost on the host side in %llu places, %llu head switch edges\n",
+			(unsigned long long)audio.tags, (unsigned long long)audio.device_gap_frames, (unsigned long long)audio.device_fill_frames, (unsigned long long)audio.missing_buffers,
+			(unsigned long long)audio.transit_lost_frames, (unsigned long long)audio.resyncs, (unsigned long long)audio.edge_count);
+	for(size_t i=0; i<rfs.size(); ++i)
+		fprintf(stderr, "%s: %llu bytes, %llu jumps, %llu drifts against the audio\n", rfs[i]->name.c_str(),
+			(unsigned long long)rfs[i]->bytes, (unsigned long long)trackers[i].jumps, (unsigned long long)trackers[i].drifts);
+
+	bool bad = audio.device_gap_frames || audio.device_fill_frames || audio.missing_buffers || audio.transit_lost_frames;
+	for(const rf_tracker& t : trackers)
+		bad = bad || t.jumps || t.drifts;
+	return bad ? 2 : 0;
+}
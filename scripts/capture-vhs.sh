@@ -19,6 +19,9 @@ CXCARD_AUDIO_DEVICE=1
 CXCARD_AUDIO_LEVEL=0
 CXCARD_AUDIO_VMUX=0
 
+# NOTE set to a built host/rf_level to pick the levels above from the signal instead, the tape has to be playing
+RF_LEVEL_TOOL=
+
 # https://stackoverflow.com/questions/192319/how-do-i-know-the-script-file-name-in-a-bash-script
 MY_NAME=$(basename "$0")
 
@@ -57,6 +60,16 @@ function setup_video_card
 	echo 0                    > $sysfs_dir/tenbit  # 0= 8bit  1=10bit (half rate)
 }
 
+function calibrate_levels
+{
+	if [[ -z "$RF_LEVEL_TOOL" ]] ; then return ; fi
+
+	echo "Calibrating the RF levels, the tape should be playing"
+	"$RF_LEVEL_TOOL" $CXCARD_VIDEO_DEVICE $CXCARD_AUDIO_DEVICE
+	# 2 is clipping even at the lowest level, that still gets captured
+	if [[ $? -eq 1 ]] ; then die "Level calibration failed" ; fi
+}
+
 function downsample_4_u8
 {
 	# https://sox.sourceforge.net/sox.html
@@ -197,5 +210,6 @@ if [[ ! -d "$output_dir" ]] ; then die "Output directory '$output_dir' does not
 sanity_checks
 setup_video_card
 setup_audio_card
+calibrate_levels
 
 do_capture "$output_dir"